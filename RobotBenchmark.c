@@ -0,0 +1,504 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime, mkstemp and dup
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "emulator.h"
+#include "font.h"
+#include "gcode.h"
+#include "layout.h"
+#include "serial.h"
+#include "transform.h"
+
+// Times the hot paths of the robot writer on synthetic text and prints the results as JSON:
+//   RobotBenchmark [--max-bytes N] [--full] [--serial-lines N] [--no-serial]
+
+// GLOBAL CONSTANTS
+
+#define DefaultMaxBytes (1024L * 1024)
+#define FullMaxBytes (100L * 1024 * 1024)
+#define MaxLayoutBytes (16L * 1024 * 1024) // Layout keeps every placed word in memory, so bigger corpora are skipped
+#define DefaultSerialLines 2000
+#define FontLoadRepeats 20
+#define BenchmarkFontSize 5.0f
+
+// GLOBAL VARIABLES
+
+static const long CorpusSizes[] = {1024L, 64L * 1024, 1024L * 1024, 16L * 1024 * 1024, 100L * 1024 * 1024};
+static const char *CorpusKinds[] = {"prose", "dense", "singles", "paragraph"};
+
+static const char *ProseWords[] = {"the", "robot", "writes", "each", "letter", "with", "a", "single", "stroke",
+                                   "pen", "and", "moves", "to", "next", "line", "when", "page", "is", "full",
+                                   "To", "AVOID", "Quick", "brown", "fox", "jumps", "over", "lazy", "dog", "1234"};
+
+static Font BenchmarkFont;
+static char DenseGlyphs[16]; // The printable glyphs with the most strokes, filled in from the font
+static long CommandCount = 0;
+static long CommandBytes = 0;
+static int FirstResult = 1;
+
+static int32_t PlacedX[MaxStrokeCount], PlacedY[MaxStrokeCount];
+
+static char **CapturedLines = NULL;
+static int CapturedCount = 0, CapturedLimit = 0;
+
+// FUNCTION DECLARATIONS
+
+static double SecondsNow(void);
+static unsigned NextRandom(unsigned *pState);
+static void FindDenseGlyphs(void);
+static char *MakeCorpus(const char *Kind, long Bytes);
+static int NextWord(const char **ppText, char *Word);
+static void CountCommand(char *Command);
+static void CaptureCommand(char *Command);
+static void PrintResult(const char *Stage, const char *Kind, long Bytes, double Seconds, long Items, const char *ItemName);
+static void BenchmarkFontLoad(void);
+static void BenchmarkMeasure(const char *Kind, const char *Text, long Bytes);
+static void BenchmarkEmit(const char *Kind, const char *Text, long Bytes);
+static void BenchmarkPlace(const char *Kind, const char *Text, long Bytes);
+static void BenchmarkLayout(const char *Kind, const char *Text, long Bytes, int LineBreakMode);
+static void BenchmarkSerial(int Lines);
+
+// FUNCTIONS
+
+int main(int argc, char *argv[])
+{
+    long MaxBytes = DefaultMaxBytes;
+    int SerialLines = DefaultSerialLines;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--max-bytes") == 0 && i + 1 < argc)
+        {
+            MaxBytes = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--full") == 0) // Includes the 100 MB corpora
+        {
+            MaxBytes = FullMaxBytes;
+        }
+        else if (strcmp(argv[i], "--serial-lines") == 0 && i + 1 < argc)
+        {
+            SerialLines = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-serial") == 0)
+        {
+            SerialLines = 0;
+        }
+        else
+        {
+            int Help = strcmp(argv[i], "--help") == 0;
+            fprintf(Help ? stdout : stderr, "Usage: %s [--max-bytes N] [--full] [--serial-lines N] [--no-serial]\n", argv[0]);
+            return Help ? 0 : 2;
+        }
+    }
+
+    if (LoadFont(&BenchmarkFont, DefaultFontFile) != 0 || BuildKerning(&BenchmarkFont) != 0)
+    {
+        return 1;
+    }
+    ScaleFactor = BenchmarkFontSize / 18.0f;
+    FindDenseGlyphs();
+
+    printf("{\n  \"benchmark\": \"RobotWriter\",\n  \"results\": [");
+
+    BenchmarkFontLoad();
+
+    for (size_t Size = 0; Size < sizeof(CorpusSizes) / sizeof(CorpusSizes[0]); Size++)
+    {
+        if (CorpusSizes[Size] > MaxBytes)
+        {
+            break;
+        }
+
+        for (size_t Kind = 0; Kind < sizeof(CorpusKinds) / sizeof(CorpusKinds[0]); Kind++)
+        {
+            char *Text = MakeCorpus(CorpusKinds[Kind], CorpusSizes[Size]);
+            if (Text == NULL)
+            {
+                fprintf(stderr, "Could not allocate a %ld byte corpus\n", CorpusSizes[Size]);
+                return 1;
+            }
+
+            BenchmarkMeasure(CorpusKinds[Kind], Text, CorpusSizes[Size]);
+            BenchmarkEmit(CorpusKinds[Kind], Text, CorpusSizes[Size]);
+            BenchmarkPlace(CorpusKinds[Kind], Text, CorpusSizes[Size]);
+            if (CorpusSizes[Size] <= MaxLayoutBytes)
+            {
+                BenchmarkLayout(CorpusKinds[Kind], Text, CorpusSizes[Size], GreedyLineBreaks);
+                BenchmarkLayout(CorpusKinds[Kind], Text, CorpusSizes[Size], OptimalLineBreaks);
+            }
+            free(Text);
+        }
+    }
+
+    if (SerialLines > 0)
+    {
+        BenchmarkSerial(SerialLines);
+    }
+
+    printf("\n  ]\n}\n");
+
+    FreeFont(&BenchmarkFont);
+    return 0;
+}
+
+static double SecondsNow(void)
+{
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (double)Now.tv_sec + Now.tv_nsec / 1e9;
+}
+
+static unsigned NextRandom(unsigned *pState) // Fixed generator so every run sees the same corpus
+{
+    *pState = *pState * 1103515245u + 12345u;
+    return *pState >> 8;
+}
+
+static void FindDenseGlyphs(void)
+{
+    int Count = (int)sizeof(DenseGlyphs) - 1;
+
+    for (int Slot = 0; Slot < Count; Slot++) // Picks the heaviest glyphs one at a time
+    {
+        int Best = 'x';
+        for (int ascii = 33; ascii < 127; ascii++)
+        {
+            if (memchr(DenseGlyphs, ascii, (size_t)Slot) == NULL && BenchmarkFont.pGlyphs[ascii].StrokeCount > BenchmarkFont.pGlyphs[Best].StrokeCount)
+            {
+                Best = ascii;
+            }
+        }
+        DenseGlyphs[Slot] = (char)Best;
+    }
+    DenseGlyphs[Count] = '\0';
+}
+
+static char *MakeCorpus(const char *Kind, long Bytes)
+{
+    char *Text = malloc((size_t)Bytes + 1);
+    if (Text == NULL)
+    {
+        return NULL;
+    }
+
+    unsigned Seed = 20576144u;
+    long Length = 0;
+    int LineLength = 0;
+    int Paragraph = (strcmp(Kind, "paragraph") == 0); // One long paragraph, the worst case for optimal line breaking
+
+    while (Length < Bytes)
+    {
+        char Word[32];
+
+        if (strcmp(Kind, "dense") == 0) // Worst-case stroke counts
+        {
+            int WordLength = 4 + (int)(NextRandom(&Seed) % 8);
+            for (int i = 0; i < WordLength; i++)
+            {
+                Word[i] = DenseGlyphs[NextRandom(&Seed) % strlen(DenseGlyphs)];
+            }
+            Word[WordLength] = '\0';
+        }
+        else if (strcmp(Kind, "singles") == 0) // Worst case for per-word overhead
+        {
+            Word[0] = (char)(33 + NextRandom(&Seed) % 94);
+            Word[1] = '\0';
+        }
+        else
+        {
+            strcpy(Word, ProseWords[NextRandom(&Seed) % (sizeof(ProseWords) / sizeof(ProseWords[0]))]);
+        }
+
+        int WordLength = (int)strlen(Word);
+        for (int i = 0; i < WordLength && Length < Bytes; i++)
+        {
+            Text[Length++] = Word[i];
+        }
+        LineLength += WordLength + 1;
+
+        if (Length < Bytes)
+        {
+            Text[Length++] = (!Paragraph && LineLength > 60) ? '\n' : ' ';
+            if (Text[Length - 1] == '\n')
+            {
+                LineLength = 0;
+            }
+        }
+    }
+
+    Text[Length] = '\0';
+    return Text;
+}
+
+static int NextWord(const char **ppText, char *Word)
+{
+    const char *p = *ppText;
+    int Length = 0;
+
+    while (*p == ' ' || *p == '\n')
+    {
+        p++;
+    }
+    while (*p != '\0' && *p != ' ' && *p != '\n')
+    {
+        if (Length < MaxWordLength - 1)
+        {
+            Word[Length++] = *p;
+        }
+        p++;
+    }
+    Word[Length] = '\0';
+
+    *ppText = p;
+    return Length;
+}
+
+static void CountCommand(char *Command) // Null sink that still touches every line
+{
+    CommandCount++;
+    CommandBytes += (long)strlen(Command);
+}
+
+static void CaptureCommand(char *Command)
+{
+    if (CapturedCount < CapturedLimit)
+    {
+        CapturedLines[CapturedCount] = malloc(strlen(Command) + 1);
+        strcpy(CapturedLines[CapturedCount++], Command);
+    }
+}
+
+static void PrintResult(const char *Stage, const char *Kind, long Bytes, double Seconds, long Items, const char *ItemName)
+{
+    printf("%s\n    {\"stage\": \"%s\", \"corpus\": \"%s\", \"bytes\": %ld, \"seconds\": %.6f, \"%s\": %ld, "
+           "\"%s_per_second\": %.1f, \"mb_per_second\": %.3f}",
+           FirstResult ? "" : ",", Stage, Kind, Bytes, Seconds, ItemName, Items, ItemName,
+           Seconds > 0.0 ? Items / Seconds : 0.0, Seconds > 0.0 ? Bytes / Seconds / (1024.0 * 1024.0) : 0.0);
+    FirstResult = 0;
+    fflush(stdout);
+}
+
+static void BenchmarkFontLoad(void)
+{
+    Font Loaded;
+    char BinaryFile[] = "/tmp/RobotBenchmarkFontXXXXXX";
+    int Fd = mkstemp(BinaryFile);
+    if (Fd < 0 || SaveBinaryFont(&BenchmarkFont, BinaryFile) != 0)
+    {
+        fprintf(stderr, "Could not write the binary font\n");
+        return;
+    }
+    close(Fd);
+
+    double Start = SecondsNow();
+    for (int i = 0; i < FontLoadRepeats; i++)
+    {
+        LoadFont(&Loaded, DefaultFontFile);
+        FreeFont(&Loaded);
+    }
+    double TextLoaded = SecondsNow();
+    for (int i = 0; i < FontLoadRepeats; i++)
+    {
+        LoadFont(&Loaded, BinaryFile);
+        FreeFont(&Loaded);
+    }
+    double BinaryLoaded = SecondsNow();
+    LoadFont(&Loaded, DefaultFontFile);
+    double Reloaded = SecondsNow();
+    BuildKerning(&Loaded);
+    double Kerned = SecondsNow();
+    long FontBytes = (long)Loaded.Bytes; // Memory the loaded font holds, the same whichever file it came from
+    FreeFont(&Loaded);
+    remove(BinaryFile);
+
+    PrintResult("load_font", "SingleStrokeFont.txt", FontBytes, (TextLoaded - Start) / FontLoadRepeats, 1, "loads");
+    PrintResult("load_font_binary", "SingleStrokeFont.txt", FontBytes, (BinaryLoaded - TextLoaded) / FontLoadRepeats, 1, "loads");
+    PrintResult("build_kerning", "SingleStrokeFont.txt", FontBytes, Kerned - Reloaded, 1, "builds");
+}
+
+static void BenchmarkMeasure(const char *Kind, const char *Text, long Bytes)
+{
+    char Word[MaxWordLength];
+    long Words = 0;
+    volatile Fixed Total = 0; // Keeps the measurements from being optimised away
+
+    double Start = SecondsNow();
+    for (const char *p = Text; NextWord(&p, Word) > 0; Words++)
+    {
+        Total += CalculateWordWidth(&BenchmarkFont, Word);
+    }
+    double Seconds = SecondsNow() - Start;
+
+    PrintResult("measure_words", Kind, Bytes, Seconds, Words, "words");
+}
+
+static void BenchmarkEmit(const char *Kind, const char *Text, long Bytes)
+{
+    char Word[MaxWordLength];
+
+    EmitCommand = CountCommand;
+    CommandCount = CommandBytes = 0;
+
+    double Start = SecondsNow();
+    for (const char *p = Text; NextWord(&p, Word) > 0;)
+    {
+        XOffset = 0;
+        YOffset = 0;
+        GenerateGCode(&BenchmarkFont, Word);
+    }
+    double Seconds = SecondsNow() - Start;
+
+    PrintResult("generate_gcode", Kind, Bytes, Seconds, CommandCount, "commands");
+}
+
+// Scales every glyph of the corpus with each placement kernel the processor has, one glyph per batch as
+// GenerateGCode does, without the formatting that follows
+static void BenchmarkPlace(const char *Kind, const char *Text, long Bytes)
+{
+    int Automatic = TransformKernel();
+
+    for (int Kernel = 0; Kernel < TransformKernelCount; Kernel++)
+    {
+        if (SetTransformKernel(Kernel) != 0)
+        {
+            continue;
+        }
+
+        char Word[MaxWordLength];
+        char Stage[64];
+        long Placed = 0;
+        StrokeScale Scale = MakeStrokeScale((double)ScaleFactor * FixedPerMm / StrokePerFontUnit);
+
+        double Start = SecondsNow();
+        for (const char *p = Text; NextWord(&p, Word) > 0;)
+        {
+            size_t Index = 0;
+            const Character *pGlyph;
+            while ((pGlyph = FindGlyph(&BenchmarkFont, DecodeUtf8(Word, &Index))) != NULL)
+            {
+                PlaceStrokes(pGlyph->pStrokes, pGlyph->StrokeCount, &Scale, PlacedX, PlacedY);
+                Placed += pGlyph->StrokeCount;
+            }
+        }
+        double Seconds = SecondsNow() - Start;
+
+        snprintf(Stage, sizeof(Stage), "place_strokes_%s", TransformName(Kernel));
+        PrintResult(Stage, Kind, Bytes, Seconds, Placed, "strokes");
+    }
+
+    SetTransformKernel(Automatic);
+}
+
+static void BenchmarkLayout(const char *Kind, const char *Text, long Bytes, int LineBreakMode)
+{
+    char FileName[] = "/tmp/RobotBenchmarkXXXXXX";
+    int Fd = mkstemp(FileName);
+    if (Fd < 0 || write(Fd, Text, (size_t)Bytes) != (ssize_t)Bytes)
+    {
+        fprintf(stderr, "Could not write the layout corpus\n");
+        return;
+    }
+    close(Fd);
+
+    PageSettings Settings;
+    DefaultPageSettings(&Settings);
+    Settings.LineBreakMode = LineBreakMode;
+
+    Layout DocumentLayout;
+    PlacedWord Placed;
+    long Words = 0;
+
+    double Start = SecondsNow();
+    if (StartLayout(&DocumentLayout, FileName, &BenchmarkFont, BenchmarkFontSize, &Settings) == 0)
+    {
+        while (WaitForWord(&DocumentLayout, (int)Words, &Placed) == 0)
+        {
+            Words++;
+        }
+        FinishLayout(&DocumentLayout);
+    }
+    double Seconds = SecondsNow() - Start;
+    remove(FileName);
+
+    PrintResult(LineBreakMode == OptimalLineBreaks ? "layout_optimal" : "layout_greedy", Kind, Bytes, Seconds, Words, "words");
+}
+
+static void BenchmarkSerial(int Lines)
+{
+    Emulator Controller;
+    if (OpenEmulator(&Controller) != 0 || StartEmulator(&Controller) != 0)
+    {
+        return;
+    }
+
+    // The commands are generated up front so only the link is timed
+    CapturedLines = calloc((size_t)Lines, sizeof(char *));
+    CapturedLimit = Lines;
+    CapturedCount = 0;
+    EmitCommand = CaptureCommand;
+    char *Text = MakeCorpus("prose", 64L * 1024);
+    char Word[MaxWordLength];
+    for (const char *p = Text; CapturedCount < Lines && NextWord(&p, Word) > 0;)
+    {
+        XOffset = 0;
+        GenerateGCode(&BenchmarkFont, Word);
+    }
+    free(Text);
+
+    // The serial log echoes lines to the console, which would bury the JSON. CloseRS232Port() flushes the
+    // log, so nothing from it arrives once the console is put back.
+    fflush(stdout);
+    int Console = dup(STDOUT_FILENO);
+    int Null = open("/dev/null", O_WRONLY);
+    dup2(Null, STDOUT_FILENO);
+
+    double Seconds[2] = {0.0, 0.0};
+    long Bytes = 0;
+
+    if (OpenSerialDevice(Controller.SlaveName) == 0)
+    {
+        for (int i = 0; i < CapturedCount; i++)
+        {
+            Bytes += (long)strlen(CapturedLines[i]);
+        }
+
+        double Start = SecondsNow();
+        for (int i = 0; i < CapturedCount; i++)
+        {
+            SendCommand(CapturedLines[i]);
+        }
+        Seconds[0] = SecondsNow() - Start;
+
+        Start = SecondsNow();
+        for (int i = 0; i < CapturedCount; i++)
+        {
+            QueueCommand(CapturedLines[i]);
+        }
+        FlushCommands();
+        Seconds[1] = SecondsNow() - Start;
+
+        CloseRS232Port();
+    }
+
+    fflush(stdout);
+    dup2(Console, STDOUT_FILENO);
+    close(Console);
+    close(Null);
+
+    PrintResult("serial_round_trip", "pty", Bytes, Seconds[0], CapturedCount, "commands");
+    PrintResult("serial_pipelined", "pty", Bytes, Seconds[1], CapturedCount, "commands");
+
+    StopEmulator(&Controller);
+    CloseEmulator(&Controller);
+
+    for (int i = 0; i < CapturedCount; i++)
+    {
+        free(CapturedLines[i]);
+    }
+    free(CapturedLines);
+}
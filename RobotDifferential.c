@@ -0,0 +1,442 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "font.h"
+#include "gcode.h"
+#include "transform.h"
+
+// Checks the G-code emitters against a reference that draws the font strokes directly. Each candidate's output
+// is parsed back into pen-down segments and compared with the reference geometry word by word; any ink more than
+// the tolerance away from the other drawing is reported. Exits with 1 if any candidate disagrees.
+//   RobotDifferential [--words N] [--seed N] [--tolerance MM]
+
+// GLOBAL CONSTANTS
+
+#define DefaultWordCount 20000
+#define DefaultSeed 1u
+#define DefaultTolerance 0.01f // Coordinates are written to two decimal places
+#define MaxTestWordLength 16
+#define MaxCapturedBytes (1024 * 1024)
+#define Pi 3.14159265f
+#define ArcChordTolerance 0.002f // How closely G2/G3 arcs are followed when they are flattened for comparison
+
+// STRUCTS
+
+typedef struct // Struct to hold one straight run of ink
+{
+    float X0, Y0, X1, Y1;
+} Segment;
+
+typedef struct // Struct to hold the ink laid down for one word
+{
+    Segment *pSegments;
+    int Count;
+    int Capacity;
+} Drawing;
+
+typedef struct // Struct to hold an emitter under test, which writes one word at XOffset/YOffset through EmitCommand
+{
+    const char *Name;
+    void (*Emit)(const Font *pFont, const char *Word);
+    float ArcTolerance; // Set while the candidate runs, and allowed on top of the tolerance
+    int Transform;      // Kernel that places the strokes, or -1 for the one this machine would pick
+} Emitter;
+
+typedef struct // Struct to hold the machine state while G-code is read back
+{
+    float X, Y;
+    int PenDown;
+} Plotter;
+
+// GLOBAL VARIABLES
+
+static const Emitter Candidates[] = {
+    {"GenerateGCode", GenerateGCode, 0.0f, ScalarTransform},
+    {"GenerateGCode placed with SSE2", GenerateGCode, 0.0f, Sse2Transform},
+    {"GenerateGCode placed with AVX2", GenerateGCode, 0.0f, Avx2Transform},
+    {"GenerateGCode with arcs", GenerateGCode, DefaultArcTolerance, -1},
+};
+
+static const float FontSizes[] = {1.0f, 5.0f, 12.5f};
+
+static Font TestFont;
+static char Captured[MaxCapturedBytes];
+static size_t CapturedLength = 0;
+static unsigned int RandomState = DefaultSeed;
+
+// FUNCTION DECLARATIONS
+
+static void CaptureCommand(char *Command);
+static void MakeWord(char *Word);
+static float ReferenceStrokes(const char *Word, float X, float Y, Plotter *pPlotter, Drawing *pDrawing);
+static void ReadGCode(const char *Text, Plotter *pPlotter, Drawing *pDrawing);
+static void ReadArc(const char *Line, int Clockwise, Plotter *pPlotter, Drawing *pDrawing);
+static void AddSegment(Drawing *pDrawing, float X0, float Y0, float X1, float Y1);
+static float MatchedDeviation(const Drawing *pExpected, const Drawing *pActual);
+static float Deviation(const Drawing *pFrom, const Drawing *pTo);
+static float DistanceToSegment(float X, float Y, const Segment *pSegment);
+
+// FUNCTIONS
+
+int main(int argc, char **argv)
+{
+    long WordCount = DefaultWordCount;
+    unsigned int Seed = DefaultSeed;
+    float Tolerance = DefaultTolerance;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--words") == 0 && i + 1 < argc)
+        {
+            WordCount = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            Seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+        {
+            Tolerance = (float)atof(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--words N] [--seed N] [--tolerance MM]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (LoadFont(&TestFont, DefaultFontFile) != 0)
+    {
+        return 2;
+    }
+    BuildKerning(&TestFont);
+    EmitCommand = CaptureCommand;
+
+    int Failed = 0;
+    int AutomaticTransform = TransformKernel();
+    Drawing Expected = {0}, Actual = {0};
+
+    for (size_t Candidate = 0; Candidate < sizeof(Candidates) / sizeof(Candidates[0]); Candidate++)
+    {
+        const Emitter *pEmitter = &Candidates[Candidate];
+        if (SetTransformKernel(pEmitter->Transform < 0 ? AutomaticTransform : pEmitter->Transform) != 0)
+        {
+            printf("%s: skipped, this processor cannot run it\n", pEmitter->Name);
+            continue;
+        }
+        float WorstDeviation = 0.0f;
+        float Allowed = Tolerance + pEmitter->ArcTolerance;
+        long Segments = 0, Mismatches = 0, Commands = 0;
+        ArcTolerance = pEmitter->ArcTolerance;
+        RandomState = Seed ? Seed : DefaultSeed; // Every candidate sees the same words
+
+        for (size_t Size = 0; Size < sizeof(FontSizes) / sizeof(FontSizes[0]); Size++)
+        {
+            ScaleFactor = FontSizes[Size] / 18.0f;
+            Plotter ReferencePlotter = {0.0f, 0.0f, 0}, CandidatePlotter = {0.0f, 0.0f, 0};
+
+            for (long i = 0; i < WordCount; i++)
+            {
+                char Word[MaxTestWordLength + 1];
+                MakeWord(Word);
+
+                // Words are written along a line and wrap every so often, so pen moves between words are checked too
+                float X = (float)(i % 8) * FontSizes[Size] * 6.0f;
+                float Y = -(float)((i / 8) % 50) * FontSizes[Size] * 2.0f;
+
+                Expected.Count = 0;
+                float ExpectedEnd = ReferenceStrokes(Word, X, Y, &ReferencePlotter, &Expected);
+
+                CapturedLength = 0;
+                XOffset = ToFixed((double)X * FixedPerMm);
+                YOffset = ToFixed((double)Y * FixedPerMm);
+                pEmitter->Emit(&TestFont, Word);
+                Captured[CapturedLength] = '\0';
+                for (size_t c = 0; c < CapturedLength; c++)
+                {
+                    Commands += Captured[c] == '\n';
+                }
+
+                Actual.Count = 0;
+                ReadGCode(Captured, &CandidatePlotter, &Actual);
+
+                float WordDeviation = MatchedDeviation(&Expected, &Actual);
+                if (WordDeviation > Allowed) // Merged or split segments only show up in the full comparison
+                {
+                    WordDeviation = fmaxf(Deviation(&Expected, &Actual), Deviation(&Actual, &Expected));
+                }
+                float EndDeviation = fabsf((float)((double)XOffset / FixedPerMm) - ExpectedEnd); // The next word must start where the reference says
+                Segments += Expected.Count;
+                WorstDeviation = fmaxf(WorstDeviation, WordDeviation);
+
+                if (WordDeviation > Allowed || EndDeviation > Tolerance)
+                {
+                    if (Mismatches++ < 5)
+                    {
+                        printf("%s: size %.1f word \"%s\" ink off by %.4f mm, advance off by %.4f mm\n",
+                               pEmitter->Name, FontSizes[Size], Word, WordDeviation, EndDeviation);
+                    }
+                }
+            }
+        }
+
+        printf("%s: %ld words, %ld segments, %ld commands, worst deviation %.4f mm, %ld mismatches\n",
+               pEmitter->Name, WordCount * (long)(sizeof(FontSizes) / sizeof(FontSizes[0])), Segments, Commands, WorstDeviation, Mismatches);
+        Failed |= (Mismatches > 0);
+    }
+
+    free(Expected.pSegments);
+    free(Actual.pSegments);
+    FreeFont(&TestFont);
+    return Failed;
+}
+
+static void CaptureCommand(char *Command)
+{
+    size_t Length = strlen(Command);
+    if (CapturedLength + Length < MaxCapturedBytes)
+    {
+        memcpy(Captured + CapturedLength, Command, Length);
+        CapturedLength += Length;
+    }
+}
+
+static void MakeWord(char *Word) // Mostly printable ASCII, with some accented and non-Latin text and stray bytes
+{
+    static const char *Extras[] = {"\xC3\xA9", "\xC3\xBC", "\xCE\xA9", "\xE2\x82\xAC", "\xE4\xB8\xAD", "\xF0\x9F\x96\x8A", "\x80", "\xFF", "\xE2\x82"};
+
+    RandomState = RandomState * 1103515245u + 12345u;
+    int Length = 1 + (int)((RandomState >> 16) % MaxTestWordLength);
+    int Used = 0;
+
+    while (Used < Length)
+    {
+        RandomState = RandomState * 1103515245u + 12345u;
+        unsigned int Pick = (RandomState >> 16) & 0x7FFF;
+        const char *Extra = Extras[Pick % (sizeof(Extras) / sizeof(Extras[0]))];
+
+        if (Pick % 20 == 0 && Used + (int)strlen(Extra) <= MaxTestWordLength)
+        {
+            memcpy(Word + Used, Extra, strlen(Extra));
+            Used += (int)strlen(Extra);
+        }
+        else
+        {
+            Word[Used++] = (char)('!' + Pick % ('~' - '!' + 1));
+        }
+    }
+    Word[Used] = '\0';
+}
+
+static float ReferenceStrokes(const char *Word, float X, float Y, Plotter *pPlotter, Drawing *pDrawing)
+{
+    // The font is read as a list of moves: each stroke goes from wherever the pen is to its point, leaving ink
+    // when its pen flag is 1. Characters follow one another by their last stroke's X plus the pair's kerning.
+    size_t Index = 0;
+    const Character *pCharacter = FindGlyph(&TestFont, DecodeUtf8(Word, &Index));
+
+    while (pCharacter != NULL)
+    {
+        const Character *pNext = FindGlyph(&TestFont, DecodeUtf8(Word, &Index));
+        for (int j = 0; j < pCharacter->StrokeCount; j++)
+        {
+            float NextX = X + (float)pCharacter->pStrokes[j].X / StrokePerFontUnit * ScaleFactor;
+            float NextY = Y + (float)pCharacter->pStrokes[j].Y / StrokePerFontUnit * ScaleFactor;
+            pPlotter->PenDown = (pCharacter->pStrokes[j].Pen == 1);
+            if (pPlotter->PenDown)
+            {
+                AddSegment(pDrawing, pPlotter->X, pPlotter->Y, NextX, NextY);
+            }
+            pPlotter->X = NextX;
+            pPlotter->Y = NextY;
+        }
+
+        if (pCharacter->StrokeCount > 0)
+        {
+            X += (float)pCharacter->pStrokes[pCharacter->StrokeCount - 1].X / StrokePerFontUnit * ScaleFactor;
+        }
+        if (pNext != NULL)
+        {
+            X += (float)PairKerning(&TestFont, pCharacter, pNext) / StrokePerFontUnit * ScaleFactor;
+        }
+        pCharacter = pNext;
+    }
+
+    return X;
+}
+
+static void ReadGCode(const char *Text, Plotter *pPlotter, Drawing *pDrawing)
+{
+    while (*Text != '\0')
+    {
+        const char *LineEnd = strchr(Text, '\n');
+        size_t Length = LineEnd ? (size_t)(LineEnd - Text) : strlen(Text);
+        char Line[128];
+        snprintf(Line, sizeof(Line), "%.*s", (int)Length, Text);
+        Text += Length + (LineEnd != NULL);
+
+        if (Line[0] == 'S')
+        {
+            pPlotter->PenDown = (atof(Line + 1) > 0.0); // The pen is lowered by any spindle speed above zero
+        }
+        else if (strncmp(Line, "G0 ", 3) == 0 || strncmp(Line, "G1 ", 3) == 0 || strncmp(Line, "G00 ", 4) == 0 || strncmp(Line, "G01 ", 4) == 0)
+        {
+            float NextX = pPlotter->X, NextY = pPlotter->Y;
+            const char *pWord;
+            if ((pWord = strchr(Line, 'X')) != NULL)
+            {
+                NextX = (float)atof(pWord + 1);
+            }
+            if ((pWord = strchr(Line, 'Y')) != NULL)
+            {
+                NextY = (float)atof(pWord + 1);
+            }
+            if (pPlotter->PenDown)
+            {
+                AddSegment(pDrawing, pPlotter->X, pPlotter->Y, NextX, NextY);
+            }
+            pPlotter->X = NextX;
+            pPlotter->Y = NextY;
+        }
+        else if (strncmp(Line, "G2 ", 3) == 0 || strncmp(Line, "G3 ", 3) == 0)
+        {
+            ReadArc(Line, Line[1] == '2', pPlotter, pDrawing);
+        }
+    }
+}
+
+static void ReadArc(const char *Line, int Clockwise, Plotter *pPlotter, Drawing *pDrawing)
+{
+    float EndX = pPlotter->X, EndY = pPlotter->Y, I = 0.0f, J = 0.0f;
+    const char *pWord;
+    if ((pWord = strchr(Line, 'X')) != NULL)
+    {
+        EndX = (float)atof(pWord + 1);
+    }
+    if ((pWord = strchr(Line, 'Y')) != NULL)
+    {
+        EndY = (float)atof(pWord + 1);
+    }
+    if ((pWord = strchr(Line, 'I')) != NULL)
+    {
+        I = (float)atof(pWord + 1);
+    }
+    if ((pWord = strchr(Line, 'J')) != NULL)
+    {
+        J = (float)atof(pWord + 1);
+    }
+
+    float CentreX = pPlotter->X + I, CentreY = pPlotter->Y + J;
+    float Radius = hypotf(I, J);
+    float Start = atan2f(-J, -I);
+    float Sweep = atan2f(EndY - CentreY, EndX - CentreX) - Start;
+
+    if (Clockwise && Sweep >= 0.0f) // G2 turns clockwise, G3 anticlockwise; equal ends make a full circle
+    {
+        Sweep -= 2.0f * Pi;
+    }
+    else if (!Clockwise && Sweep <= 0.0f)
+    {
+        Sweep += 2.0f * Pi;
+    }
+
+    int Steps = 1;
+    if (Radius > ArcChordTolerance)
+    {
+        float StepAngle = 2.0f * acosf(1.0f - ArcChordTolerance / Radius);
+        Steps = (int)ceilf(fabsf(Sweep) / StepAngle);
+        Steps = (Steps < 1) ? 1 : (Steps > 10000 ? 10000 : Steps);
+    }
+
+    for (int Step = 1; Step <= Steps; Step++)
+    {
+        float Angle = Start + Sweep * (float)Step / (float)Steps;
+        float NextX = (Step == Steps) ? EndX : CentreX + Radius * cosf(Angle);
+        float NextY = (Step == Steps) ? EndY : CentreY + Radius * sinf(Angle);
+        if (pPlotter->PenDown)
+        {
+            AddSegment(pDrawing, pPlotter->X, pPlotter->Y, NextX, NextY);
+        }
+        pPlotter->X = NextX;
+        pPlotter->Y = NextY;
+    }
+}
+
+static void AddSegment(Drawing *pDrawing, float X0, float Y0, float X1, float Y1)
+{
+    if (pDrawing->Count == pDrawing->Capacity)
+    {
+        int NewCapacity = pDrawing->Capacity ? pDrawing->Capacity * 2 : 256;
+        Segment *pGrown = realloc(pDrawing->pSegments, (size_t)NewCapacity * sizeof(Segment));
+        if (pGrown == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(2);
+        }
+        pDrawing->pSegments = pGrown;
+        pDrawing->Capacity = NewCapacity;
+    }
+
+    Segment *pSegment = &pDrawing->pSegments[pDrawing->Count++];
+    pSegment->X0 = X0;
+    pSegment->Y0 = Y0;
+    pSegment->X1 = X1;
+    pSegment->Y1 = Y1;
+}
+
+static float MatchedDeviation(const Drawing *pExpected, const Drawing *pActual)
+{
+    // When both drawings have the same segments in the same order no straight run can stray further than its ends
+    if (pExpected->Count != pActual->Count)
+    {
+        return INFINITY;
+    }
+
+    float Worst = 0.0f;
+    for (int i = 0; i < pExpected->Count; i++)
+    {
+        const Segment *pA = &pExpected->pSegments[i], *pB = &pActual->pSegments[i];
+        Worst = fmaxf(Worst, fmaxf(hypotf(pA->X0 - pB->X0, pA->Y0 - pB->Y0), hypotf(pA->X1 - pB->X1, pA->Y1 - pB->Y1)));
+    }
+    return Worst;
+}
+
+static float Deviation(const Drawing *pFrom, const Drawing *pTo) // Furthest any ink in pFrom lies from the ink in pTo
+{
+    float Worst = 0.0f;
+
+    for (int i = 0; i < pFrom->Count; i++)
+    {
+        const Segment *pSegment = &pFrom->pSegments[i];
+        float Length = hypotf(pSegment->X1 - pSegment->X0, pSegment->Y1 - pSegment->Y0);
+        int Samples = 1 + (int)(Length / (4.0f * DefaultTolerance)); // Dense enough that nothing can hide between samples
+
+        for (int Sample = 0; Sample <= Samples; Sample++)
+        {
+            float t = (float)Sample / (float)Samples;
+            float X = pSegment->X0 + (pSegment->X1 - pSegment->X0) * t;
+            float Y = pSegment->Y0 + (pSegment->Y1 - pSegment->Y0) * t;
+            float Nearest = INFINITY;
+
+            for (int j = 0; j < pTo->Count && Nearest > Worst; j++) // Stops once this point cannot raise the worst
+            {
+                Nearest = fminf(Nearest, DistanceToSegment(X, Y, &pTo->pSegments[j]));
+            }
+            Worst = fmaxf(Worst, Nearest);
+        }
+    }
+
+    return Worst;
+}
+
+static float DistanceToSegment(float X, float Y, const Segment *pSegment)
+{
+    float DX = pSegment->X1 - pSegment->X0, DY = pSegment->Y1 - pSegment->Y0;
+    float LengthSquared = DX * DX + DY * DY;
+    float t = (LengthSquared > 0.0f) ? ((X - pSegment->X0) * DX + (Y - pSegment->Y0) * DY) / LengthSquared : 0.0f;
+    t = fminf(fmaxf(t, 0.0f), 1.0f);
+
+    return hypotf(X - (pSegment->X0 + DX * t), Y - (pSegment->Y0 + DY * t));
+}
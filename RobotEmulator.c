@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "emulator.h"
+
+// Stand-in for the writing robot: answers the robot writer over a pseudo terminal like a GRBL controller would
+
+int main(int argc, char *argv[])
+{
+    Emulator Controller;
+
+    if (OpenEmulator(&Controller) != 0)
+    {
+        return 1;
+    }
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--delay-us") == 0)
+        {
+            Controller.ReplyDelayUs = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--error-every") == 0)
+        {
+            Controller.ErrorEvery = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--drop-every") == 0)
+        {
+            Controller.DropEvery = atoi(argv[i + 1]);
+        }
+    }
+
+    printf("Emulated robot listening on %s\n", Controller.SlaveName);
+    fflush(stdout);
+
+    RunEmulator(&Controller);
+
+    CloseEmulator(&Controller);
+    return 0;
+}
@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200809L // fmemopen
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drawing.h"
+#include "font.h"
+#include "gcode.h"
+#include "layout.h"
+
+// libFuzzer target for the text, font and drawing parsers. The first byte of each input picks what is fuzzed:
+//   even      - the rest is a document, laid out and turned into G-code with SingleStrokeFont.txt
+//   1 (mod 4) - the rest is a font file in either format, parsed, kerned and used to write every glyph
+//   3 (mod 4) - the rest is an SVG drawing, read, fitted to the page and turned into G-code
+// Built without libFuzzer it replays the files named on the command line instead:
+//   RobotFuzzReplay crash-file...
+
+// GLOBAL CONSTANTS
+
+#define FuzzCommandLength 100 // Size of the buffer GenerateGCode formats into
+
+// GLOBAL VARIABLES
+
+static Font DocumentFont; // SingleStrokeFont.txt, loaded once and kept for the text inputs
+
+// FUNCTION DECLARATIONS
+
+int LLVMFuzzerInitialize(int *pArgc, char ***pArgv);
+int LLVMFuzzerTestOneInput(const uint8_t *pData, size_t Size);
+static void FuzzDocument(const uint8_t *pData, size_t Size);
+static void FuzzFont(const uint8_t *pData, size_t Size);
+static void FuzzDrawing(const uint8_t *pData, size_t Size);
+static void CheckCommand(char *Command);
+
+// FUNCTIONS
+
+int LLVMFuzzerInitialize(int *pArgc, char ***pArgv)
+{
+    (void)pArgc;
+    (void)pArgv;
+
+    if (LoadFont(&DocumentFont, DefaultFontFile) != 0)
+    {
+        fprintf(stderr, "Run the fuzzer from the folder holding SingleStrokeFont.txt\n");
+        exit(1);
+    }
+    BuildKerning(&DocumentFont);
+
+    EmitCommand = CheckCommand;
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *pData, size_t Size)
+{
+    if (Size < 2)
+    {
+        return 0;
+    }
+
+    if ((pData[0] & 3) == 3)
+    {
+        FuzzDrawing(pData + 1, Size - 1);
+    }
+    else if (pData[0] & 1)
+    {
+        FuzzFont(pData + 1, Size - 1);
+    }
+    else
+    {
+        FuzzDocument(pData, Size);
+    }
+    return 0;
+}
+
+static void FuzzDocument(const uint8_t *pData, size_t Size)
+{
+    // The second byte sets the font size and line breaking so those paths are explored too
+    float FontSize = 1.0f + (float)(pData[1] & 0x1F);
+    PageSettings Settings;
+    DefaultPageSettings(&Settings);
+    Settings.LineBreakMode = (pData[1] & 0x20) ? OptimalLineBreaks : GreedyLineBreaks;
+    Settings.Height = (pData[1] & 0x40) ? 20.0f : DefaultPageHeight;
+
+    ScaleFactor = FontSize / 18.0f;
+
+    FILE *pInput = fmemopen((void *)(pData + 2), Size - 2, "rb");
+    if (pInput == NULL)
+    {
+        return;
+    }
+
+    Layout DocumentLayout;
+    if (StartLayoutStream(&DocumentLayout, pInput, &DocumentFont, FontSize, &Settings) != 0)
+    {
+        fclose(pInput);
+        return;
+    }
+
+    PlacedWord Placed;
+    int Page = 1;
+    for (int i = 0; WaitForWord(&DocumentLayout, i, &Placed) == 0; i++) // Same steps as ProcessWord
+    {
+        if (Placed.Page != Page)
+        {
+            ResetPen();
+            Page = Placed.Page;
+        }
+        XOffset = Placed.X;
+        YOffset = Placed.Y;
+        GenerateGCode(Placed.pFont, Placed.Word);
+    }
+    ResetPen();
+
+    FinishLayout(&DocumentLayout);
+}
+
+static void FuzzFont(const uint8_t *pData, size_t Size)
+{
+    FILE *pFontFile = fmemopen((void *)pData, Size, "r");
+    if (pFontFile == NULL)
+    {
+        return;
+    }
+
+    Font Fuzzed;
+    ScaleFactor = 5.0f / 18.0f;
+
+    if (ReadFont(&Fuzzed, pFontFile) == 0)
+    {
+        BuildKerning(&Fuzzed);
+
+        // Every byte value, so glyphs missing from the font and malformed UTF-8 are covered, then a few code points
+        // from each sequence length that the hash table may hold
+        char Glyphs[2 * MaxAscii + 32] = {0};
+        for (int i = 0; i < 2 * MaxAscii - 1; i++)
+        {
+            Glyphs[i] = (char)(i + 1);
+        }
+        strcat(Glyphs, "\xC3\xA9\xCE\xA9\xE2\x82\xAC\xE4\xB8\xAD\xF0\x9F\x96\x8A");
+
+        XOffset = 0;
+        YOffset = 0;
+        CalculateWordWidth(&Fuzzed, Glyphs);
+        GenerateGCode(&Fuzzed, Glyphs);
+    }
+
+    FreeFont(&Fuzzed);
+    fclose(pFontFile);
+}
+
+static void FuzzDrawing(const uint8_t *pData, size_t Size)
+{
+    Drawing Fuzzed;
+    PageSettings Settings;
+    DefaultPageSettings(&Settings);
+
+    if (ReadDrawing(&Fuzzed, (const char *)pData, Size) == 0) // Same steps as a drawing job in RunJob
+    {
+        float Scale = FitDrawing(&Fuzzed, &Settings);
+        XOffset = ToFixed((double)Settings.LeftMargin * FixedPerMm - (double)Fuzzed.MinX * Scale);
+        YOffset = ToFixed((double)-Settings.TopMargin * FixedPerMm - (double)Fuzzed.MaxY * Scale);
+        GenerateStrokes(Fuzzed.pStrokes, Fuzzed.StrokeCount, Scale);
+        FreeDrawing(&Fuzzed);
+    }
+}
+
+static void CheckCommand(char *Command) // Every command must be one terminated line that fitted its buffer
+{
+    size_t Length = strnlen(Command, FuzzCommandLength);
+    if (Length == 0 || Length >= FuzzCommandLength || Command[Length - 1] != '\n' || memchr(Command, '\n', Length) != Command + Length - 1)
+    {
+        fprintf(stderr, "Malformed command: %.*s\n", (int)Length, Command);
+        abort();
+    }
+}
+
+#ifndef ROBOTWRITER_LIBFUZZER
+int main(int argc, char **argv)
+{
+    LLVMFuzzerInitialize(&argc, &argv);
+
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *pFile = fopen(argv[i], "rb");
+        if (pFile == NULL)
+        {
+            fprintf(stderr, "Could not open %s\n", argv[i]);
+            return 1;
+        }
+
+        fseek(pFile, 0, SEEK_END);
+        long Size = ftell(pFile);
+        rewind(pFile);
+
+        uint8_t *pData = malloc(Size > 0 ? (size_t)Size : 1);
+        if (pData == NULL || fread(pData, 1, (size_t)Size, pFile) != (size_t)Size)
+        {
+            fprintf(stderr, "Could not read %s\n", argv[i]);
+            return 1;
+        }
+        fclose(pFile);
+
+        LLVMFuzzerTestOneInput(pData, (size_t)Size);
+        free(pData);
+        printf("%s: ok\n", argv[i]);
+    }
+
+    return 0;
+}
+#endif
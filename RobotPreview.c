@@ -0,0 +1,768 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Draws G-code, as written by RobotWriterExport, into pictures so a layout can be checked without the robot.
+// Sheets are set out in rows, each in a frame the size of the largest sheet. Ink is black; pen-up travel can be
+// shown in grey. The input is read from a file or stdin, where "Page N" lines (or "; Page N" comments in a saved
+// file) start each new sheet and anything that is not G-code is skipped.
+//   RobotPreview [--input FILE] [--png FILE] [--ppm FILE] [--svg FILE] [--scale PX_PER_MM] [--columns N] [--travel]
+
+// GLOBAL CONSTANTS
+
+#define DefaultScale 4.0f    // Pixels per millimetre
+#define DefaultColumns 10    // Sheets side by side before a new row starts
+#define MarginMm 5.0f        // Space around each sheet
+#define MaxPreviewPixels (256L * 1024 * 1024)
+#define MaxPreviewLine 512
+#define Pi 3.14159265f
+#define ArcChordTolerance 0.01f // How closely G2/G3 arcs are followed when they are drawn as straight runs
+#define SvgPenWidthMm 0.3f
+
+#define Paper 255
+#define Ink 0
+#define Travel 170
+#define Frame 220
+
+#define PngMaxRun 258 // Longest match deflate can describe
+
+// STRUCTS
+
+typedef struct // Struct to hold one straight move of the pen
+{
+    float X0, Y0, X1, Y1;
+    int PenDown;
+    int Page;
+} Move;
+
+typedef struct // Struct to hold a whole job read back from G-code
+{
+    Move *pMoves;
+    long Count;
+    long Capacity;
+    int Pages;
+    float MinX, MinY, MaxX, MaxY; // Over every sheet, so all frames are the same size
+} Job;
+
+typedef struct // Struct to hold the machine state while G-code is read back
+{
+    float X, Y;
+    int PenDown;
+} Plotter;
+
+typedef struct // Struct to hold where the sheets sit in the picture
+{
+    int Columns, Rows;
+    float CellWidth, CellHeight; // Millimetres, including the margin
+    float Scale;
+    int Width, Height; // Pixels
+} Sheet;
+
+typedef struct // Struct to hold deflate output as it is built, least significant bit first
+{
+    unsigned char *pData;
+    size_t Length;
+    uint32_t Bits;
+    int BitCount;
+} BitWriter;
+
+// GLOBAL VARIABLES
+
+static uint32_t CrcTable[256];
+
+// FUNCTION DECLARATIONS
+
+static int ReadJob(FILE *pFile, Job *pJob);
+static void ReadArc(const char *Line, int Clockwise, Plotter *pPlotter, Job *pJob);
+static void AddMove(Job *pJob, float X0, float Y0, float X1, float Y1, int PenDown);
+static void PlaceSheets(const Job *pJob, int Columns, float Scale, Sheet *pSheet);
+static void SheetOrigin(const Sheet *pSheet, int Page, float *pX, float *pY);
+static void Rasterize(const Job *pJob, const Sheet *pSheet, int ShowTravel, unsigned char *pPixels);
+static void DrawLine(unsigned char *pPixels, int Width, int Height, int X0, int Y0, int X1, int Y1, unsigned char Shade);
+static int WritePpm(const char *FileName, const unsigned char *pPixels, int Width, int Height);
+static int WritePng(const char *FileName, const unsigned char *pPixels, int Width, int Height);
+static size_t Deflate(const unsigned char *pData, size_t Length, unsigned char *pOut);
+static void PutBits(BitWriter *pWriter, uint32_t Value, int Count);
+static void PutCode(BitWriter *pWriter, uint32_t Code, int Count);
+static void PutLiteral(BitWriter *pWriter, int Literal);
+static void PutRun(BitWriter *pWriter, int Length);
+static void WriteChunk(FILE *pFile, const char *Type, const unsigned char *pData, size_t Length);
+static uint32_t Crc(uint32_t Crc, const unsigned char *pData, size_t Length);
+static void PutBigEndian(unsigned char *pOut, uint32_t Value);
+static int WriteSvg(const char *FileName, const Job *pJob, const Sheet *pSheet, int ShowTravel);
+
+// FUNCTIONS
+
+int main(int argc, char **argv)
+{
+    const char *InputFile = "-";
+    const char *PngFile = NULL, *PpmFile = NULL, *SvgFile = NULL;
+    float Scale = DefaultScale;
+    int Columns = DefaultColumns;
+    int ShowTravel = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+        {
+            InputFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--png") == 0 && i + 1 < argc)
+        {
+            PngFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--ppm") == 0 && i + 1 < argc)
+        {
+            PpmFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--svg") == 0 && i + 1 < argc)
+        {
+            SvgFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+        {
+            Scale = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--columns") == 0 && i + 1 < argc)
+        {
+            Columns = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--travel") == 0)
+        {
+            ShowTravel = 1;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--input FILE] [--png FILE] [--ppm FILE] [--svg FILE] [--scale PX_PER_MM] [--columns N] [--travel]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!(Scale > 0.0f) || Columns < 1 || (PngFile == NULL && PpmFile == NULL && SvgFile == NULL))
+    {
+        fprintf(stderr, "Give a positive scale and column count, and at least one of --png, --ppm and --svg\n");
+        return 2;
+    }
+
+    FILE *pInput = strcmp(InputFile, "-") == 0 ? stdin : fopen(InputFile, "r");
+    if (pInput == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", InputFile);
+        return 1;
+    }
+    Job ReadBack = {0};
+    int Result = ReadJob(pInput, &ReadBack);
+    if (pInput != stdin)
+    {
+        fclose(pInput);
+    }
+    if (Result != 0)
+    {
+        free(ReadBack.pMoves);
+        return 1;
+    }
+
+    Sheet Layout;
+    PlaceSheets(&ReadBack, Columns, Scale, &Layout);
+
+    if (PngFile != NULL || PpmFile != NULL)
+    {
+        if ((long)Layout.Width * Layout.Height > MaxPreviewPixels)
+        {
+            fprintf(stderr, "A %d x %d picture is too big, lower --scale\n", Layout.Width, Layout.Height);
+            free(ReadBack.pMoves);
+            return 1;
+        }
+
+        unsigned char *pPixels = malloc((size_t)Layout.Width * (size_t)Layout.Height);
+        if (pPixels == NULL)
+        {
+            fprintf(stderr, "Not enough memory for a %d x %d picture\n", Layout.Width, Layout.Height);
+            free(ReadBack.pMoves);
+            return 1;
+        }
+        Rasterize(&ReadBack, &Layout, ShowTravel, pPixels);
+        if (PngFile != NULL)
+        {
+            Result |= WritePng(PngFile, pPixels, Layout.Width, Layout.Height);
+        }
+        if (PpmFile != NULL)
+        {
+            Result |= WritePpm(PpmFile, pPixels, Layout.Width, Layout.Height);
+        }
+        free(pPixels);
+    }
+    if (SvgFile != NULL)
+    {
+        Result |= WriteSvg(SvgFile, &ReadBack, &Layout, ShowTravel);
+    }
+
+    printf("%d sheets, %ld moves, %d x %d pixels\n", ReadBack.Pages, ReadBack.Count, Layout.Width, Layout.Height);
+    free(ReadBack.pMoves);
+    return Result != 0;
+}
+
+static int ReadJob(FILE *pFile, Job *pJob)
+{
+    char Line[MaxPreviewLine];
+    Plotter Pen = {0.0f, 0.0f, 0};
+
+    pJob->Pages = 1;
+    pJob->MinX = pJob->MinY = pJob->MaxX = pJob->MaxY = 0.0f; // The origin, where the pen is parked, is always in the frame
+
+    while (fgets(Line, sizeof(Line), pFile) != NULL)
+    {
+        const char *pText = Line;
+        if (*pText == ';' || *pText == '(') // "; Page N" or "(Page N)" in a saved file
+        {
+            pText++;
+            while (*pText == ' ')
+            {
+                pText++;
+            }
+        }
+        if (strncmp(pText, "Page ", 5) == 0)
+        {
+            if (pJob->Count > 0 && pJob->pMoves[pJob->Count - 1].Page == pJob->Pages - 1)
+            {
+                pJob->Pages++;
+            }
+            continue;
+        }
+
+        if (Line[0] == 'S' && Line[1] >= '0' && Line[1] <= '9')
+        {
+            Pen.PenDown = atoi(&Line[1]) > 0;
+        }
+        else if (Line[0] == 'G' && (Line[1] == '0' || Line[1] == '1') && (Line[2] == ' ' || Line[2] == '\n'))
+        {
+            float X = Pen.X, Y = Pen.Y;
+            const char *pWord;
+            if ((pWord = strchr(Line, 'X')) != NULL)
+            {
+                X = strtof(pWord + 1, NULL);
+            }
+            if ((pWord = strchr(Line, 'Y')) != NULL)
+            {
+                Y = strtof(pWord + 1, NULL);
+            }
+            AddMove(pJob, Pen.X, Pen.Y, X, Y, Pen.PenDown);
+            Pen.X = X;
+            Pen.Y = Y;
+        }
+        else if (Line[0] == 'G' && (Line[1] == '2' || Line[1] == '3') && (Line[2] == ' ' || Line[2] == '\n'))
+        {
+            ReadArc(Line, Line[1] == '2', &Pen, pJob);
+        }
+
+        if (pJob->pMoves == NULL && pJob->Capacity != 0)
+        {
+            fprintf(stderr, "Not enough memory for the job\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void ReadArc(const char *Line, int Clockwise, Plotter *pPlotter, Job *pJob)
+{
+    float EndX = pPlotter->X, EndY = pPlotter->Y, I = 0.0f, J = 0.0f;
+    const char *pWord;
+    if ((pWord = strchr(Line, 'X')) != NULL)
+    {
+        EndX = strtof(pWord + 1, NULL);
+    }
+    if ((pWord = strchr(Line, 'Y')) != NULL)
+    {
+        EndY = strtof(pWord + 1, NULL);
+    }
+    if ((pWord = strchr(Line, 'I')) != NULL)
+    {
+        I = strtof(pWord + 1, NULL);
+    }
+    if ((pWord = strchr(Line, 'J')) != NULL)
+    {
+        J = strtof(pWord + 1, NULL);
+    }
+
+    float CentreX = pPlotter->X + I, CentreY = pPlotter->Y + J;
+    float Radius = hypotf(I, J);
+    float Start = atan2f(-J, -I);
+    float Sweep = atan2f(EndY - CentreY, EndX - CentreX) - Start;
+
+    if (Clockwise && Sweep >= 0.0f) // G2 turns clockwise, G3 anticlockwise; equal ends make a full circle
+    {
+        Sweep -= 2.0f * Pi;
+    }
+    else if (!Clockwise && Sweep <= 0.0f)
+    {
+        Sweep += 2.0f * Pi;
+    }
+
+    int Steps = 1;
+    if (Radius > ArcChordTolerance)
+    {
+        float StepAngle = 2.0f * acosf(1.0f - ArcChordTolerance / Radius);
+        Steps = (int)ceilf(fabsf(Sweep) / StepAngle);
+        Steps = (Steps < 1) ? 1 : (Steps > 10000 ? 10000 : Steps);
+    }
+
+    for (int Step = 1; Step <= Steps; Step++)
+    {
+        float Angle = Start + Sweep * (float)Step / (float)Steps;
+        float NextX = (Step == Steps) ? EndX : CentreX + Radius * cosf(Angle);
+        float NextY = (Step == Steps) ? EndY : CentreY + Radius * sinf(Angle);
+        AddMove(pJob, pPlotter->X, pPlotter->Y, NextX, NextY, pPlotter->PenDown);
+        pPlotter->X = NextX;
+        pPlotter->Y = NextY;
+    }
+}
+
+static void AddMove(Job *pJob, float X0, float Y0, float X1, float Y1, int PenDown)
+{
+    if (pJob->Count == pJob->Capacity)
+    {
+        long Capacity = pJob->Capacity ? pJob->Capacity * 2 : 4096;
+        Move *pGrown = realloc(pJob->pMoves, (size_t)Capacity * sizeof(Move));
+        if (pGrown == NULL)
+        {
+            free(pJob->pMoves);
+            pJob->pMoves = NULL; // Reported by ReadJob
+            return;
+        }
+        pJob->pMoves = pGrown;
+        pJob->Capacity = Capacity;
+    }
+
+    Move *pMove = &pJob->pMoves[pJob->Count++];
+    pMove->X0 = X0;
+    pMove->Y0 = Y0;
+    pMove->X1 = X1;
+    pMove->Y1 = Y1;
+    pMove->PenDown = PenDown;
+    pMove->Page = pJob->Pages - 1;
+
+    pJob->MinX = fminf(pJob->MinX, X1);
+    pJob->MaxX = fmaxf(pJob->MaxX, X1);
+    pJob->MinY = fminf(pJob->MinY, Y1);
+    pJob->MaxY = fmaxf(pJob->MaxY, Y1);
+}
+
+static void PlaceSheets(const Job *pJob, int Columns, float Scale, Sheet *pSheet)
+{
+    pSheet->Columns = pJob->Pages < Columns ? pJob->Pages : Columns;
+    pSheet->Rows = (pJob->Pages + Columns - 1) / Columns;
+    pSheet->CellWidth = pJob->MaxX - pJob->MinX + 2.0f * MarginMm;
+    pSheet->CellHeight = pJob->MaxY - pJob->MinY + 2.0f * MarginMm;
+    pSheet->Scale = Scale;
+    pSheet->Width = (int)ceilf(pSheet->CellWidth * (float)pSheet->Columns * Scale) + 1;
+    pSheet->Height = (int)ceilf(pSheet->CellHeight * (float)pSheet->Rows * Scale) + 1;
+}
+
+// Top left corner of a sheet's frame, in millimetres from the top left of the picture
+static void SheetOrigin(const Sheet *pSheet, int Page, float *pX, float *pY)
+{
+    *pX = (float)(Page % pSheet->Columns) * pSheet->CellWidth;
+    *pY = (float)(Page / pSheet->Columns) * pSheet->CellHeight;
+}
+
+static void Rasterize(const Job *pJob, const Sheet *pSheet, int ShowTravel, unsigned char *pPixels)
+{
+    float Scale = pSheet->Scale;
+
+    memset(pPixels, Paper, (size_t)pSheet->Width * (size_t)pSheet->Height);
+
+    for (int Page = 0; Page < pJob->Pages; Page++)
+    {
+        float Left, Top;
+        SheetOrigin(pSheet, Page, &Left, &Top);
+        int X0 = (int)lroundf(Left * Scale), Y0 = (int)lroundf(Top * Scale);
+        int X1 = (int)lroundf((Left + pSheet->CellWidth) * Scale), Y1 = (int)lroundf((Top + pSheet->CellHeight) * Scale);
+        DrawLine(pPixels, pSheet->Width, pSheet->Height, X0, Y0, X1, Y0, Frame);
+        DrawLine(pPixels, pSheet->Width, pSheet->Height, X1, Y0, X1, Y1, Frame);
+        DrawLine(pPixels, pSheet->Width, pSheet->Height, X1, Y1, X0, Y1, Frame);
+        DrawLine(pPixels, pSheet->Width, pSheet->Height, X0, Y1, X0, Y0, Frame);
+    }
+
+    // Travel first so ink drawn over the same pixels wins
+    for (int Pass = ShowTravel ? 0 : 1; Pass < 2; Pass++)
+    {
+        for (long i = 0; i < pJob->Count; i++)
+        {
+            const Move *pMove = &pJob->pMoves[i];
+            if (pMove->PenDown != Pass)
+            {
+                continue;
+            }
+
+            float Left, Top;
+            SheetOrigin(pSheet, pMove->Page, &Left, &Top);
+            Left += MarginMm - pJob->MinX;
+            Top += MarginMm + pJob->MaxY; // Y rises up the sheet but down the picture
+
+            DrawLine(pPixels, pSheet->Width, pSheet->Height,
+                     (int)lroundf((Left + pMove->X0) * Scale), (int)lroundf((Top - pMove->Y0) * Scale),
+                     (int)lroundf((Left + pMove->X1) * Scale), (int)lroundf((Top - pMove->Y1) * Scale),
+                     Pass ? Ink : Travel);
+        }
+    }
+}
+
+// Bresenham's line, all in integers. Pixels outside the picture are skipped.
+static void DrawLine(unsigned char *pPixels, int Width, int Height, int X0, int Y0, int X1, int Y1, unsigned char Shade)
+{
+    int DeltaX = abs(X1 - X0), DeltaY = -abs(Y1 - Y0);
+    int StepX = X0 < X1 ? 1 : -1, StepY = Y0 < Y1 ? 1 : -1;
+    int Error = DeltaX + DeltaY;
+
+    while (1)
+    {
+        if (X0 >= 0 && X0 < Width && Y0 >= 0 && Y0 < Height)
+        {
+            unsigned char *pPixel = &pPixels[(size_t)Y0 * (size_t)Width + (size_t)X0];
+            if (Shade < *pPixel) // Darker marks are never covered by lighter ones
+            {
+                *pPixel = Shade;
+            }
+        }
+        if (X0 == X1 && Y0 == Y1)
+        {
+            break;
+        }
+        int Twice = 2 * Error;
+        if (Twice >= DeltaY)
+        {
+            Error += DeltaY;
+            X0 += StepX;
+        }
+        if (Twice <= DeltaX)
+        {
+            Error += DeltaX;
+            Y0 += StepY;
+        }
+    }
+}
+
+static int WritePpm(const char *FileName, const unsigned char *pPixels, int Width, int Height)
+{
+    FILE *pFile = fopen(FileName, "wb");
+    if (pFile == NULL)
+    {
+        fprintf(stderr, "Could not create %s\n", FileName);
+        return -1;
+    }
+
+    unsigned char *pRow = malloc((size_t)Width * 3);
+    if (pRow == NULL)
+    {
+        fclose(pFile);
+        return -1;
+    }
+
+    fprintf(pFile, "P6\n%d %d\n255\n", Width, Height);
+    for (int y = 0; y < Height; y++)
+    {
+        const unsigned char *pGrey = &pPixels[(size_t)y * (size_t)Width];
+        for (int x = 0; x < Width; x++)
+        {
+            pRow[3 * x] = pRow[3 * x + 1] = pRow[3 * x + 2] = pGrey[x];
+        }
+        fwrite(pRow, 3, (size_t)Width, pFile);
+    }
+    free(pRow);
+
+    if (fclose(pFile) != 0)
+    {
+        fprintf(stderr, "Could not finish writing %s\n", FileName);
+        return -1;
+    }
+    return 0;
+}
+
+// An 8-bit greyscale PNG. The picture is mostly long runs of paper, so a deflate of nothing but runs, coded with
+// the fixed Huffman tables, shrinks it well without needing zlib.
+static int WritePng(const char *FileName, const unsigned char *pPixels, int Width, int Height)
+{
+    size_t RowBytes = (size_t)Width + 1; // Each row starts with its filter type, 0 for none
+    size_t RawLength = RowBytes * (size_t)Height;
+    unsigned char *pRaw = malloc(RawLength);
+    unsigned char *pPacked = malloc(RawLength + RawLength / 8 + 64); // Worst case is every byte a 9-bit literal
+    FILE *pFile = fopen(FileName, "wb");
+
+    if (pRaw == NULL || pPacked == NULL || pFile == NULL)
+    {
+        fprintf(stderr, "Could not write %s\n", FileName);
+        free(pRaw);
+        free(pPacked);
+        if (pFile != NULL)
+        {
+            fclose(pFile);
+        }
+        return -1;
+    }
+
+    for (int y = 0; y < Height; y++)
+    {
+        pRaw[(size_t)y * RowBytes] = 0;
+        memcpy(&pRaw[(size_t)y * RowBytes + 1], &pPixels[(size_t)y * (size_t)Width], (size_t)Width);
+    }
+
+    uint32_t A = 1, B = 0; // Adler-32 of the uncompressed data, which ends the zlib stream
+    for (size_t i = 0; i < RawLength;)
+    {
+        size_t Block = RawLength - i < 5552 ? RawLength - i : 5552; // Longest stretch before the sums can overflow
+        for (size_t End = i + Block; i < End; i++)
+        {
+            A += pRaw[i];
+            B += A;
+        }
+        A %= 65521;
+        B %= 65521;
+    }
+
+    size_t Packed = 0;
+    pPacked[Packed++] = 0x78; // Deflate with a 32K window
+    pPacked[Packed++] = 0x01;
+    Packed += Deflate(pRaw, RawLength, &pPacked[Packed]);
+    PutBigEndian(&pPacked[Packed], (B << 16) | A);
+    Packed += 4;
+
+    unsigned char Header[13];
+    PutBigEndian(&Header[0], (uint32_t)Width);
+    PutBigEndian(&Header[4], (uint32_t)Height);
+    Header[8] = 8;  // Bits per sample
+    Header[9] = 0;  // Greyscale
+    Header[10] = 0; // Deflate
+    Header[11] = 0; // Adaptive filtering, with every row unfiltered
+    Header[12] = 0; // Not interlaced
+
+    static const unsigned char Signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    fwrite(Signature, 1, sizeof(Signature), pFile);
+    WriteChunk(pFile, "IHDR", Header, sizeof(Header));
+    WriteChunk(pFile, "IDAT", pPacked, Packed);
+    WriteChunk(pFile, "IEND", NULL, 0);
+
+    free(pRaw);
+    free(pPacked);
+    if (fclose(pFile) != 0)
+    {
+        fprintf(stderr, "Could not finish writing %s\n", FileName);
+        return -1;
+    }
+    return 0;
+}
+
+// One final block of fixed Huffman codes, where each byte either repeats the one before it as part of a run
+// (a match at distance 1) or goes out as a literal
+static size_t Deflate(const unsigned char *pData, size_t Length, unsigned char *pOut)
+{
+    BitWriter Writer = {pOut, 0, 0, 0};
+
+    PutBits(&Writer, 1, 1); // Last block
+    PutBits(&Writer, 1, 2); // Fixed codes
+
+    size_t i = 0;
+    while (i < Length)
+    {
+        PutLiteral(&Writer, pData[i]);
+        size_t Run = 0;
+        while (i + 1 + Run < Length && pData[i + 1 + Run] == pData[i] && Run < PngMaxRun)
+        {
+            Run++;
+        }
+        if (Run >= 3)
+        {
+            PutRun(&Writer, (int)Run);
+            i += 1 + Run;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    PutLiteral(&Writer, 256); // End of block
+    if (Writer.BitCount > 0)
+    {
+        Writer.pData[Writer.Length++] = (unsigned char)Writer.Bits;
+    }
+    return Writer.Length;
+}
+
+static void PutBits(BitWriter *pWriter, uint32_t Value, int Count)
+{
+    pWriter->Bits |= Value << pWriter->BitCount;
+    pWriter->BitCount += Count;
+    while (pWriter->BitCount >= 8)
+    {
+        pWriter->pData[pWriter->Length++] = (unsigned char)pWriter->Bits;
+        pWriter->Bits >>= 8;
+        pWriter->BitCount -= 8;
+    }
+}
+
+// Huffman codes are stored most significant bit first, unlike everything else in deflate
+static void PutCode(BitWriter *pWriter, uint32_t Code, int Count)
+{
+    uint32_t Reversed = 0;
+    for (int i = 0; i < Count; i++)
+    {
+        Reversed = (Reversed << 1) | ((Code >> i) & 1);
+    }
+    PutBits(pWriter, Reversed, Count);
+}
+
+static void PutLiteral(BitWriter *pWriter, int Literal)
+{
+    if (Literal < 144)
+    {
+        PutCode(pWriter, 0x30 + (uint32_t)Literal, 8);
+    }
+    else if (Literal < 256)
+    {
+        PutCode(pWriter, 0x190 + (uint32_t)(Literal - 144), 9);
+    }
+    else if (Literal < 280)
+    {
+        PutCode(pWriter, (uint32_t)(Literal - 256), 7);
+    }
+    else
+    {
+        PutCode(pWriter, 0xC0 + (uint32_t)(Literal - 280), 8);
+    }
+}
+
+static void PutRun(BitWriter *pWriter, int Length)
+{
+    static const int Base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int Extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+    int Code = 28;
+    while (Base[Code] > Length)
+    {
+        Code--;
+    }
+    PutLiteral(pWriter, 257 + Code);
+    PutBits(pWriter, (uint32_t)(Length - Base[Code]), Extra[Code]);
+    PutCode(pWriter, 0, 5); // Distance 1
+}
+
+static void WriteChunk(FILE *pFile, const char *Type, const unsigned char *pData, size_t Length)
+{
+    unsigned char Word[4];
+
+    PutBigEndian(Word, (uint32_t)Length);
+    fwrite(Word, 1, 4, pFile);
+    fwrite(Type, 1, 4, pFile);
+    if (Length > 0)
+    {
+        fwrite(pData, 1, Length, pFile);
+    }
+
+    uint32_t Check = Crc(0xFFFFFFFFu, (const unsigned char *)Type, 4);
+    Check = Crc(Check, pData, Length) ^ 0xFFFFFFFFu;
+    PutBigEndian(Word, Check);
+    fwrite(Word, 1, 4, pFile);
+}
+
+static uint32_t Crc(uint32_t Crc, const unsigned char *pData, size_t Length)
+{
+    if (CrcTable[1] == 0)
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            CrcTable[n] = c;
+        }
+    }
+
+    for (size_t i = 0; i < Length; i++)
+    {
+        Crc = CrcTable[(Crc ^ pData[i]) & 0xFF] ^ (Crc >> 8);
+    }
+    return Crc;
+}
+
+static void PutBigEndian(unsigned char *pOut, uint32_t Value)
+{
+    pOut[0] = (unsigned char)(Value >> 24);
+    pOut[1] = (unsigned char)(Value >> 16);
+    pOut[2] = (unsigned char)(Value >> 8);
+    pOut[3] = (unsigned char)Value;
+}
+
+// Millimetres throughout, one path per sheet for the ink and another for the travel
+static int WriteSvg(const char *FileName, const Job *pJob, const Sheet *pSheet, int ShowTravel)
+{
+    FILE *pFile = fopen(FileName, "w");
+    if (pFile == NULL)
+    {
+        fprintf(stderr, "Could not create %s\n", FileName);
+        return -1;
+    }
+
+    float Width = pSheet->CellWidth * (float)pSheet->Columns, Height = pSheet->CellHeight * (float)pSheet->Rows;
+    fprintf(pFile, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.2fmm\" height=\"%.2fmm\" viewBox=\"0 0 %.2f %.2f\">\n",
+            Width, Height, Width, Height);
+    fprintf(pFile, "<rect width=\"%.2f\" height=\"%.2f\" fill=\"white\"/>\n", Width, Height);
+
+    long First = 0;
+    for (int Page = 0; Page < pJob->Pages; Page++)
+    {
+        float Left, Top;
+        SheetOrigin(pSheet, Page, &Left, &Top);
+        fprintf(pFile, "<g transform=\"translate(%.2f %.2f)\">\n", Left, Top);
+        fprintf(pFile, "<rect width=\"%.2f\" height=\"%.2f\" fill=\"none\" stroke=\"#ddd\" stroke-width=\"0.2\"/>\n",
+                pSheet->CellWidth, pSheet->CellHeight);
+
+        long Last = First;
+        while (Last < pJob->Count && pJob->pMoves[Last].Page == Page)
+        {
+            Last++;
+        }
+
+        for (int Pass = ShowTravel ? 0 : 1; Pass < 2; Pass++)
+        {
+            float EndX = NAN, EndY = NAN;
+            fprintf(pFile, Pass ? "<path fill=\"none\" stroke=\"black\" stroke-width=\"%.2f\" stroke-linecap=\"round\" stroke-linejoin=\"round\" d=\""
+                                : "<path fill=\"none\" stroke=\"#aaa\" stroke-width=\"%.2f\" stroke-dasharray=\"1 1\" d=\"",
+                    Pass ? SvgPenWidthMm : SvgPenWidthMm / 2.0f);
+            for (long i = First; i < Last; i++)
+            {
+                const Move *pMove = &pJob->pMoves[i];
+                if (pMove->PenDown != Pass)
+                {
+                    continue;
+                }
+                float X0 = MarginMm + pMove->X0 - pJob->MinX, Y0 = MarginMm + pJob->MaxY - pMove->Y0;
+                float X1 = MarginMm + pMove->X1 - pJob->MinX, Y1 = MarginMm + pJob->MaxY - pMove->Y1;
+                if (X0 != EndX || Y0 != EndY) // Joined moves share one subpath
+                {
+                    fprintf(pFile, "M%.2f %.2f", X0, Y0);
+                }
+                fprintf(pFile, "L%.2f %.2f", X1, Y1);
+                EndX = X1;
+                EndY = Y1;
+            }
+            fprintf(pFile, "\"/>\n");
+        }
+
+        fprintf(pFile, "</g>\n");
+        First = Last;
+    }
+
+    fprintf(pFile, "</svg>\n");
+    if (fclose(pFile) != 0)
+    {
+        fprintf(stderr, "Could not finish writing %s\n", FileName);
+        return -1;
+    }
+    return 0;
+}
@@ -1,165 +1,230 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <conio.h>
-#include <windows.h>
+
+#include "arena.h"
+#include "daemon.h"
+#include "drawing.h"
+#include "font.h"
+#include "fontcache.h"
+#include "gcode.h"
+#include "gcodecache.h"
+#include "layout.h"
+#include "options.h"
+#include "platform.h"
+#include "profile.h"
 
 // MODE OPTIONS
 
+// Defaults for a run that does not set them from RobotWriter.conf or the command line (see --help)
+#ifndef TERMINAL_MODE
 #define TERMINAL_MODE 1 // Set to 1 for simulation mode (prints G-code to console), 0 for actual robot mode
+#endif
+#define LINE_BREAK_MODE GreedyLineBreaks // Set to OptimalLineBreaks to balance line lengths across each paragraph
+#define KERNING_MODE 0 // Set to 1 to tighten awkward character pairs such as "To" or "AV", 0 for plain advances
+#define ARC_MODE 0 // Set to 1 to write runs of strokes that follow a circle as single G2/G3 arcs
+#define PIPELINE_MODE 0 // Set to 1 to keep the robot's receive buffer full instead of waiting for each 'ok'
+#define GCODE_CACHE_MODE 1 // Set to 1 to keep finished jobs in GCodeCache and replay them when the same job comes again
 
 #if TERMINAL_MODE == 0
 
 #include "rs232.h"
 #include "serial.h"
-#define bdrate 115200 /* 115200 baud */
+#include "checkpoint.h"
 
-void SendCommands(char *buffer);
+#define DaemonPollMs 1000  // How often the daemon looks up from an empty queue
+#define KeepAwakeMs 30000  // Longest the robot is left without a command between jobs
+#define StreamSheetChangeMs 10000 // Time given to swap the sheet when the text is streamed from stdin
 
-#endif
+int OpenRobotPort(const char *Port);
+void SendCommands(char *buffer);
+void CommandAcknowledged(const char *Command, int Status);
+void StopJob(int Status);
+void RestorePosition(void);
 
-// GLOBAL CONSTANTS
+Checkpoint JobState;     // Progress of the current job, saved at pen lifts as the robot acknowledges lines
+long ResumeFromLine = 0; // Job lines already drawn before a resumed job stopped
+int CheckpointActive = 0;
 
-#define MaxAscii 128
-#define MaxWordLength 100
-#define LineLength 100
-#define LineSpacing 2.0f
+#endif
 
 // STRUCTS
 
-typedef struct // Struct to hold stroke data
-{
-    float X, Y;
-    int Pen;
-} Strokes;
-
-typedef struct // Struct to hold character data
+typedef struct // Struct to hold a job from the start of its layout until its last line has been sent
 {
-    int ascii;
-    int StrokeCount;
-    Strokes *pStrokes;
-} Character;
+    const char *InputFile;
+    float FontSize;
+    const Font *pFont;
+    FILE *pCachedJob; // Set when the job is replayed from GCodeCache rather than laid out
+    char Key[JobKeyLength + 1]; // Names the job in GCodeCache and in its checkpoint
+    int HasKey;
+    int Cacheable;
+    int Streaming; // Text is laid out and sent as it arrives on stdin
+    Layout DocumentLayout;
+    int IsDrawing; // The input is an SVG drawing rather than text, and has no font or layout
+    Drawing Picture;
+    float DrawingScale; // Fraction of its own size the drawing is drawn at, to fit the page
+} Job;
 
 // GLOBAL VARIABLES
 
-Character *FontArray = NULL; // Array to hold font data
-float XOffset = 0.0, YOffset = 0.0, ScaleFactor = 0.0;
+JobOptions Options;     // Settings for this run, from the config file and command line
+PageSettings PageSetup; // Page model used by the layout thread
+int SendingToRobot = 0; // Set when the G-code goes over the serial port rather than to the console or a file
+int StreamingInput = 0; // Set while the job's text comes from stdin, which then cannot answer prompts
 
 // FUNCTION DECLARATIONS
 
-int LoadFontData(void);
 float GetFontSize(void);
 float CalculateScaleFactor(float FontSize);
-float CalculateWordWidth(const char *Word);
-int ProcessWord(float FontSize);
-void GenerateGCode(const char *Word);
-void SetNewLine(float FontSize);
-void ResetPen(void);
-void FreeFontData(void);
+int PrepareJob(Job *pJob, const JobOptions *pOptions);
+int PrepareDrawing(Job *pJob, const JobOptions *pOptions);
+int RunJob(Job *pJob);
+int ProcessWord(Layout *pLayout);
+void ChangeSheet(int NextPage);
+
+void (*OnPageBreak)(int NextPage) = ChangeSheet; // Hook called between pages so the sheet can be swapped
+
+#if TERMINAL_MODE == 0
+int WakeRobot(const JobOptions *pOptions);
+int RunDaemon(void);
+#endif
 
 // FUNCTIONS
 
-int main(void)
+int main(int argc, char *argv[])
 {
     printf("RobotWriter Program - Callum O'Neill 20576144\n\n");
 
-    LoadFontData();
-
-    float FontSize = GetFontSize();               // Assigns FontSize from return value
-    ScaleFactor = CalculateScaleFactor(FontSize); // Calculates the scale factor based on the font size
-
+    DefaultJobOptions(&Options);
+    Options.Kerning = KERNING_MODE;
+    Options.Arcs = ARC_MODE;
+    Options.Pipeline = PIPELINE_MODE;
+    Options.Cache = GCODE_CACHE_MODE;
+    Options.Page.LineBreakMode = LINE_BREAK_MODE;
 #if TERMINAL_MODE == 0
-    // char mode[] = {'8', 'N', '1', 0};
-
-    char buffer[100];
+    strcpy(Options.OutputFile, RobotOutput);
+#endif
 
-    // If we cannot open the port then give up immediately
-    if (CanRS232PortBeOpened() == -1)
+    int Parsed = ParseArguments(&Options, argc, argv);
+    if (Parsed != 0)
     {
-        printf("\nUnable to open the COM port (specified in serial.h) ");
-        exit(0);
+        return Parsed > 0 ? 0 : 1;
     }
 
-    // Time to wake up the robot
-    printf("\nAbout to wake up the robot\n");
-
-    // We do this by sending a new-line
-    sprintf(buffer, "\n");
-    // printf ("Buffer to send: %s", buffer); // For diagnostic purposes only, normally comment out
-    PrintBuffer(&buffer[0]);
-    Sleep(100);
-
-    // This is a special case - we wait  until we see a dollar ($)
-    WaitForDollar();
-
-    printf("\nThe robot is now ready to draw\n");
+    if (Options.Submit) // The daemon does the drawing, this run only hands the job over
+    {
+        if (Options.FontSize == 0.0f && !IsDrawingFile(Options.InputFile)) // A drawing is fitted to the page instead
+        {
+            Options.FontSize = GetFontSize();
+        }
+        return SubmitJob(&Options) == 0 ? 0 : 1;
+    }
 
-    // These commands get the robot into 'ready to draw mode' and need to be sent before any writing commands
-    sprintf(buffer, "G1 X0 Y0 F1000\n");
-    SendCommands(buffer);
-    sprintf(buffer, "M3\n");
-    SendCommands(buffer);
-    sprintf(buffer, "S0\n");
-    SendCommands(buffer);
+    SendingToRobot = strcmp(Options.OutputFile, RobotOutput) == 0;
+#if TERMINAL_MODE == 1
+    if (SendingToRobot || Options.Resume || Options.Daemon)
+    {
+        printf("This build only writes G-code, use RobotWriter to drive the robot\n");
+        return 1;
+    }
+#else
+    if ((Options.Resume || Options.Daemon) && !SendingToRobot)
+    {
+        printf("Only jobs sent to the robot can be resumed or taken by the daemon\n");
+        return 1;
+    }
+    if (Options.Daemon)
+    {
+        return RunDaemon();
+    }
 
+    Checkpoint ResumePoint;
+    if (Options.Resume) // Carries on from the last checkpoint instead of starting afresh
+    {
+        if (LoadCheckpoint(&ResumePoint) != 0)
+        {
+            return 1;
+        }
+        // Lays the job out exactly as before so the line numbers still match
+        snprintf(Options.InputFile, sizeof(Options.InputFile), "%s", ResumePoint.InputFile);
+        snprintf(Options.FontFile, sizeof(Options.FontFile), "%s", ResumePoint.FontFile);
+        Options.FontSize = ResumePoint.FontSize;
+        ResumeFromLine = ResumePoint.LinesAcknowledged;
+        printf("Resuming %s from line %ld\n\n", Options.InputFile, ResumeFromLine);
+    }
 #endif
 
-    ProcessWord(FontSize); // Processes each word in the test data file
+    StartProfiling(); // Prints the stage timings at exit, or on SIGUSR1 where available
 
-    printf("\nG-code sent\n\n");
+    StartFontCache(DefaultFontBudget, Options.Kerning); // Fonts are kerned as they load, before any words are measured
 
-    FreeFontData(); // Frees the memory allocated for font data
+    if (!SendingToRobot && strcmp(Options.OutputFile, ConsoleOutput) != 0)
+    {
+        pGCodeFile = fopen(Options.OutputFile, "w");
+        if (pGCodeFile == NULL)
+        {
+            printf("Could not create %s\n", Options.OutputFile);
+            return 1;
+        }
+    }
 
-    printf("Font data memory freed\n\n");
+    Job CurrentJob; // Lays the pages out in the background while the robot wakes up
+    if (PrepareJob(&CurrentJob, &Options) != 0)
+    {
+        StopFontCache();
+        return 1;
+    }
 
 #if TERMINAL_MODE == 0
-    CloseRS232Port();
-    printf("Com port now closed\n");
-#endif
-
-    return 0;
-}
-
-int LoadFontData(void)
-{
-    FILE *pSingleStrokeFont = fopen("SingleStrokeFont.txt", "r"); // Creates a file pointer to the font data file
-    if (!pSingleStrokeFont || pSingleStrokeFont == NULL)          // Checks if the file pointer is NULL
+    // Line numbers only mean the same thing in the same layout, so the text, fonts and settings must all match
+    if (Options.Resume && (!CurrentJob.HasKey || strcmp(CurrentJob.Key, ResumePoint.JobKey) != 0))
     {
-        printf("Could not open SingleStrokeFont.txt\n");
-        return -1;
+        printf("The text, font or layout settings have changed since the checkpoint was saved, so it cannot be resumed.\n"
+               "Run the job again without --resume to start it afresh\n");
+        exit(1);
     }
+#endif
 
-    FontArray = calloc(MaxAscii, sizeof(Character)); // Allocates memory for the font array
-    if (FontArray == NULL)                           // Checks if memory allocation was successful
+#if TERMINAL_MODE == 0
+    if (SendingToRobot && WakeRobot(&Options) != 0)
     {
-        printf("Memory allocation failed for FontArray\n");
-        fclose(pSingleStrokeFont);
-        return -2;
+        exit(1);
     }
+#endif
 
-    int Marker, ascii, StrokeCount;
+    int Result = RunJob(&CurrentJob) == 0 ? 0 : 1;
 
-    while (fscanf(pSingleStrokeFont, "%d", &Marker) == 1) // Reads every number and makes it a marker
+    if (pGCodeFile != NULL)
     {
-        if (Marker == 999) // Checks for the end marker
+        if (fclose(pGCodeFile) != 0)
         {
-            fscanf(pSingleStrokeFont, "%d %d", &ascii, &StrokeCount);                  // Reads the ASCII value and stroke count
-            FontArray[ascii].ascii = ascii;                                            // Assigns the ASCII value to the character
-            FontArray[ascii].StrokeCount = StrokeCount;                                // Assigns the stroke count to the character
-            FontArray[ascii].pStrokes = malloc((size_t)StrokeCount * sizeof(Strokes)); // Allocates memory for the strokes
-
-            for (int i = 0; i < StrokeCount; i++) // Loops through each stroke
-            {
-                fscanf(pSingleStrokeFont, "%f %f %d", // Reads the stroke data
-                       &FontArray[ascii].pStrokes[i].X,
-                       &FontArray[ascii].pStrokes[i].Y,
-                       &FontArray[ascii].pStrokes[i].Pen);
-            }
+            printf("\nCould not finish writing %s\n", Options.OutputFile);
+            StopFontCache();
+            return 1;
         }
+        pGCodeFile = NULL;
+        printf("\nG-code written to %s\n\n", Options.OutputFile);
+    }
+    else
+    {
+        printf("\nG-code sent\n\n");
     }
 
-    fclose(pSingleStrokeFont);
-    return 0;
+    StopFontCache(); // Frees the memory allocated for font data
+    DrainArenaPool(); // And the blocks kept for another job
+
+    printf("Font data memory freed\n\n");
+
+#if TERMINAL_MODE == 0
+    if (SendingToRobot)
+    {
+        CloseRS232Port();
+        printf("Com port now closed\n");
+    }
+#endif
+
+    return Result;
 }
 
 float GetFontSize(void)
@@ -168,9 +233,13 @@ float GetFontSize(void)
     while (1) // Infinite loop to ensure valid font size input
     {
         printf("Enter a font size between 4 and 10:\n\n");
-        scanf("%f", &FontSize);
+        if (scanf("%f", &FontSize) == EOF) // Nobody to ask, as when run from a script without --size
+        {
+            printf("\nNo font size given, use --size\n");
+            exit(1);
+        }
 
-        if (FontSize >= 4 && FontSize <= 10)
+        if (FontSize >= MinFontSize && FontSize <= MaxFontSize)
         {
             printf("\nSelected font size: %f\n\n", FontSize);
             return FontSize;
@@ -188,198 +257,420 @@ float CalculateScaleFactor(float FontSize)
     return FontSize / 18.0f;
 }
 
-float CalculateWordWidth(const char *Word)
+int PrepareJob(Job *pJob, const JobOptions *pOptions)
 {
-    float WordWidth = 0.0;
+    memset(pJob, 0, sizeof(Job));
+    pJob->InputFile = pOptions->InputFile;
+    pJob->Streaming = strcmp(pOptions->InputFile, StandardInput) == 0;
+    StreamingInput = pJob->Streaming;
 
-    for (size_t i = 0; i < strlen(Word); i++) // Loops through each character in the word
+    if (pJob->Streaming && pOptions->FontSize == 0.0f)
     {
-        int ascii = (int)Word[i]; // Converts character to ASCII value
-        Character CurrentCharacter = FontArray[ascii];
-        if (CurrentCharacter.StrokeCount > 0)
-        {
-            float WordEnd = CurrentCharacter.pStrokes[CurrentCharacter.StrokeCount - 1].X; // Gets the X coordinate of the last stroke
-            WordWidth += WordEnd * ScaleFactor;
-        }
+        printf("Give the font size with --size when the text comes from stdin\n");
+        return -1;
     }
 
-    return WordWidth;
-}
+    if (!pJob->Streaming && IsDrawingFile(pJob->InputFile))
+    {
+        return PrepareDrawing(pJob, pOptions);
+    }
 
-int ProcessWord(float FontSize)
-{
-    FILE *pTestDataFile = fopen("TestData.txt", "rb"); // Creates a file pointer to the test data file
-    if (!pTestDataFile || pTestDataFile == NULL)       // Checks if the file pointer is NULL
+    pJob->pFont = AcquireFont(pOptions->FontFile);
+    if (pJob->pFont == NULL)
     {
-        printf("Could not open TestData.txt\n");
         return -1;
     }
 
-    char Word[MaxWordLength];
-    int WordIndex = 0;
-    int CurrentCharacter;
+    pJob->FontSize = pOptions->FontSize;
+    if (pJob->FontSize == 0.0f)
+    {
+        pJob->FontSize = GetFontSize(); // Only asks when neither the config file nor the command line gave one
+    }
+    ScaleFactor = CalculateScaleFactor(pJob->FontSize); // Calculates the scale factor based on the font size
+
+    PageSetup = pOptions->Page;
+    ArcTolerance = pOptions->Arcs ? DefaultArcTolerance : 0.0f;
+
+    pJob->HasKey = (pOptions->Cache || SendingToRobot) && !pJob->Streaming &&
+                   MakeJobKey(pJob->Key, pJob->InputFile, pJob->pFont, pJob->FontSize, &PageSetup, pOptions->Kerning, ArcTolerance) == 0;
+    pJob->Cacheable = pOptions->Cache && pJob->HasKey;
+    pJob->pCachedJob = pJob->Cacheable ? OpenCachedJob(pJob->Key) : NULL; // A repeat job skips layout altogether
 
-    while ((CurrentCharacter = fgetc(pTestDataFile)) != EOF)
+    int Started;
+    if (pJob->Streaming) // Holds a fixed number of words, so memory stays the same however long the stream runs
     {
-        if (CurrentCharacter == ' ' || CurrentCharacter == '\t' || CurrentCharacter == '\n' || CurrentCharacter == '\r')
-        {
-            if (WordIndex > 0)
-            {
-                Word[WordIndex] = '\0';
+        Started = StartLayoutLive(&pJob->DocumentLayout, stdin, pJob->pFont, pJob->FontSize, &PageSetup, pOptions->LatencyMs);
+    }
+    else
+    {
+        Started = pJob->pCachedJob != NULL ? 0 : StartLayout(&pJob->DocumentLayout, pJob->InputFile, pJob->pFont, pJob->FontSize, &PageSetup);
+    }
+    if (Started != 0)
+    {
+        ReleaseFont(pJob->pFont);
+        return -1;
+    }
 
-                if (XOffset + CalculateWordWidth(Word) > LineLength) // New line check
-                {
-                    SetNewLine(FontSize);
-                }
+    return 0;
+}
 
-                GenerateGCode(Word);
-                WordIndex = 0;
-            }
+int PrepareDrawing(Job *pJob, const JobOptions *pOptions)
+{
+    if (LoadDrawing(&pJob->Picture, pJob->InputFile) != 0)
+    {
+        return -1;
+    }
+    pJob->IsDrawing = 1;
 
-            if (CurrentCharacter == ' ') // Handle space
-            {
-                XOffset += FontSize;
-            }
+    PageSetup = pOptions->Page;
+    ArcTolerance = pOptions->Arcs ? DefaultArcTolerance : 0.0f;
+    pJob->DrawingScale = FitDrawing(&pJob->Picture, &PageSetup);
+    pJob->HasKey = SendingToRobot && MakeJobKey(pJob->Key, pJob->InputFile, NULL, 0.0f, &PageSetup, 0, ArcTolerance) == 0; // For its checkpoint
+    if (pJob->DrawingScale < 1.0f)
+    {
+        printf("Drawing scaled to %.0f%% to fit the page\n", 100.0f * pJob->DrawingScale);
+    }
+    return 0;
+}
 
-            if (CurrentCharacter == '\t') // Handle tab (typically 4 spaces; adjust as needed)
-            {
-                XOffset += 4 * FontSize;
-            }
+int RunJob(Job *pJob)
+{
+    int Complete = 1;
 
-            if (CurrentCharacter == '\n' || CurrentCharacter == '\r') // Handle new line
-            {
-                SetNewLine(FontSize);
-            }
+#if TERMINAL_MODE == 0
+    if (SendingToRobot && !pJob->Streaming) // A stream cannot be read again, so there is nothing to resume
+    {
+        StartCheckpoint(&JobState, pJob->InputFile, pJob->pFont != NULL ? pJob->pFont->FileName : Options.FontFile, pJob->FontSize,
+                        pJob->HasKey ? pJob->Key : NoJobKey); // Only the job's own lines are counted, the start-up commands are always sent
+        CheckpointActive = 1;
+    }
+#endif
 
-            continue; // Prevents whitespace being added to the next word
+    if (pJob->IsDrawing) // One sheet, drawn from its top left corner at the page margins
+    {
+        XOffset = ToFixed((double)PageSetup.LeftMargin * FixedPerMm - (double)pJob->Picture.MinX * pJob->DrawingScale);
+        YOffset = ToFixed((double)-PageSetup.TopMargin * FixedPerMm - (double)pJob->Picture.MaxY * pJob->DrawingScale);
+        GenerateStrokes(pJob->Picture.pStrokes, pJob->Picture.StrokeCount, pJob->DrawingScale);
+        ResetPen();
+    }
+    else if (pJob->pCachedJob != NULL)
+    {
+        printf("\nReplaying %s from %s\n\n", pJob->InputFile, GCodeCacheFolder);
+        ReplayCachedJob(pJob->pCachedJob, OnPageBreak);
+    }
+    else
+    {
+        if (pJob->Cacheable)
+        {
+            StartCachingJob(pJob->Key); // Keeps a copy of every line sent from here on
         }
+        Complete = ProcessWord(&pJob->DocumentLayout) == 0; // Processes each word in the test data file
+    }
 
-        if (WordIndex < MaxWordLength - 1) // Add character to the word if there's space
+#if TERMINAL_MODE == 0
+    if (SendingToRobot)
+    {
+        int Status = FlushCommands(); // Waits for the last queued lines before calling the job done
+        if (Status != ReplyOk)
+        {
+            StopJob(Status);
+        }
+        if (CheckpointActive)
         {
-            Word[WordIndex++] = (char)CurrentCharacter;
+            CheckpointActive = 0;
+            if (Complete) // An unfinished job keeps its checkpoint
+            {
+                ClearCheckpoint(&JobState);
+            }
         }
     }
+#endif
 
-    if (WordIndex > 0) // Process any remaining word after EOF
+    if (pJob->IsDrawing)
+    {
+        FreeDrawing(&pJob->Picture);
+    }
+    else if (pJob->pCachedJob == NULL)
     {
-        Word[WordIndex] = '\0';
+        FinishCachingJob(Complete, &pJob->DocumentLayout, DefaultGCodeCacheBudget); // Only a finished job is kept
+        FinishLayout(&pJob->DocumentLayout);
+    }
 
-        if (XOffset + CalculateWordWidth(Word) > LineLength)
+    printf("\n%s closed\n", pJob->InputFile);
+
+    if (pJob->pFont != NULL)
+    {
+        ReleaseFont(pJob->pFont); // Stays loaded in the font cache for the next job
+    }
+    return Complete ? 0 : -1;
+}
+
+int ProcessWord(Layout *pLayout)
+{
+    PlacedWord Placed;
+    int CurrentPage = 1;
+    int Waited;
+
+    for (int i = 0; (Waited = WaitForWord(pLayout, i, &Placed)) == 0; i++) // Words arrive already positioned by the layout thread
+    {
+        if (Placed.Page != CurrentPage) // Pauses for a fresh sheet at each page boundary
         {
-            SetNewLine(FontSize);
+            SuspendCaching(Placed.Page);
+            OnPageBreak(Placed.Page);
+            ResumeCaching();
+            CurrentPage = Placed.Page;
         }
 
-        GenerateGCode(Word);
+        XOffset = Placed.X;
+        YOffset = Placed.Y;
+        GenerateGCode(Placed.pFont, Placed.Word);
     }
 
     ResetPen(); // Ensures pen is reset at the end
 
-    fclose(pTestDataFile);
-
-    printf("\nTestData.txt closed\n");
+    if (Waited == -2)
+    {
+        printf("\nThe layout stopped short, so the job was not finished\n");
+        return -1;
+    }
     return 0;
 }
 
-void GenerateGCode(const char *Word)
+void ChangeSheet(int NextPage)
 {
-    for (size_t i = 0; i < strlen(Word); i++)
-    {
-        int ascii = (int)Word[i];
-        Character CurrentCharacter = FontArray[ascii];
+    ResetPen(); // Parks the pen at the origin, clear of the sheet
 
-        for (int j = 0; j < CurrentCharacter.StrokeCount; j++)
+    if (!SendingToRobot)
+    {
+        printf("\nPage %d\n\n", NextPage);
+        if (pGCodeFile != NULL) // GRBL skips ';' comments, and RobotPreview splits the sheets on them
         {
-            float X = XOffset + CurrentCharacter.pStrokes[j].X * ScaleFactor; // Calculates the X coordinate with the scale factor
-            float Y = YOffset + CurrentCharacter.pStrokes[j].Y * ScaleFactor; // Calculates the Y coordinate with the scale factor
-            int Pen = CurrentCharacter.pStrokes[j].Pen;
-
+            fprintf(pGCodeFile, "; Page %d\n", NextPage);
+        }
+        return;
+    }
 #if TERMINAL_MODE == 0
-            char WordBuffer[100];
-#endif
-            if (Pen == 1)
-            {
-#if TERMINAL_MODE == 1
-                {
-                    printf("S1000\n"); // Pen down command
-                    printf("G0 X%.2f Y%.2f\n", X, Y);
-                }
+    JobState.Page = NextPage;
+    if (JobState.LinesAcknowledged < ResumeFromLine) // Sheets finished before a resume are not asked for again
+    {
+        return;
+    }
+    int Status = FlushCommands(); // Lets the robot catch up before the sheet is swapped
+    if (Status != ReplyOk)
+    {
+        StopJob(Status);
+    }
+    if (StreamingInput) // Keys would come out of the text, so the operator gets a fixed time instead
+    {
+        printf("\nInsert sheet %d, continuing in %d seconds\n", NextPage, StreamSheetChangeMs / 1000);
+        Sleep(StreamSheetChangeMs);
+        return;
+    }
+    printf("\nInsert sheet %d and press any key to continue\n", NextPage);
+    getch(); // Resumes once the new sheet is in place
 #endif
+}
+
 #if TERMINAL_MODE == 0
-                {
-                    sprintf(WordBuffer, "S1000\n");
-                    SendCommands(WordBuffer);
-                    sprintf(WordBuffer, "G0 X%.2f Y%.2f\n", X, Y);
-                    SendCommands(WordBuffer);
-                }
-#endif
-            }
-            else
+int WakeRobot(const JobOptions *pOptions)
+{
+    char buffer[100];
+
+    // If we cannot open the port then give up immediately
+    BaudRate = pOptions->BaudRate == AutoBaudRate ? DefaultBaudRate : pOptions->BaudRate;
+    LowLatency = pOptions->LowLatency;
+    if (OpenRobotPort(pOptions->Port) == -1)
+    {
+        printf("\nUnable to open serial port %s at %d baud\n", pOptions->Port, BaudRate);
+        return -1;
+    }
+    if (pOptions->BaudRate == AutoBaudRate)
+    {
+        printf("\nLooking for the fastest baud rate the robot answers at\n");
+        if (ProbeBaudRate() == -1)
+        {
+            return -1;
+        }
+        printf("Using %d baud\n", BaudRate);
+    }
+
+    // Time to wake up the robot
+    printf("\nAbout to wake up the robot\n");
+
+    // We do this by sending a new-line
+    sprintf(buffer, "\n");
+    // printf ("Buffer to send: %s", buffer); // For diagnostic purposes only, normally comment out
+    PrintBuffer(&buffer[0]);
+    Sleep(100);
+
+    // This is a special case - we wait  until we see a dollar ($)
+    WaitForDollar();
+
+    printf("\nThe robot is now ready to draw\n");
+
+    EmitCommand = SendCommands; // Strokes go to the robot rather than the console
+
+    // These commands get the robot into 'ready to draw mode' and need to be sent before any writing commands
+    sprintf(buffer, "G1 X0 Y0 F%d\n", pOptions->FeedRate);
+    SendCommands(buffer);
+    sprintf(buffer, "M3\n");
+    SendCommands(buffer);
+    sprintf(buffer, "S0\n");
+    SendCommands(buffer);
+
+    SetReplyCallback(CommandAcknowledged);
+    FlushCommands();
+
+    return 0;
+}
+
+int RunDaemon(void)
+{
+    // Everything that costs time before the first stroke is done once: the port is opened, the robot woken and
+    // the job font loaded, then they are kept for every job that arrives
+    StartProfiling();
+    StartFontCache(DefaultFontBudget, Options.Kerning);
+
+    const Font *pWarmFont = AcquireFont(Options.FontFile);
+    if (pWarmFont == NULL || WakeRobot(&Options) != 0 || StartJobServer(&Options) != 0)
+    {
+        exit(1);
+    }
+
+    QueuedJob Next;
+    int IdleMs = 0, Waiting;
+    while ((Waiting = WaitForJob(&Next, DaemonPollMs)) >= 0)
+    {
+        if (Waiting == 1) // Nothing queued; a no-op every so often stops the robot going to sleep
+        {
+            IdleMs += DaemonPollMs;
+            if (IdleMs >= KeepAwakeMs)
             {
-#if TERMINAL_MODE == 1
-                {
-                    printf("S0\n");
-                    printf("G0 X%.2f Y%.2f\n", X, Y);
-                }
-#endif
-#if TERMINAL_MODE == 0
-                {
-                    sprintf(WordBuffer, "S0\n"); // Pen up command
-                    SendCommands(WordBuffer);
-                    sprintf(WordBuffer, "G0 X%.2f Y%.2f\n", X, Y);
-                    SendCommands(WordBuffer);
-                }
-#endif
+                char buffer[] = "G4 P0\n";
+                SendCommands(buffer);
+                FlushCommands();
+                IdleMs = 0;
             }
+            continue;
         }
 
-        if (CurrentCharacter.StrokeCount > 0)
+        printf("\nStarting job %d: %s\n", Next.Id, Next.Name);
+        Job CurrentJob;
+        if (PrepareJob(&CurrentJob, &Next.Options) == 0)
         {
-            XOffset += CurrentCharacter.pStrokes[CurrentCharacter.StrokeCount - 1].X * ScaleFactor; // Updates the XOffset to the end of the current character
+            RunJob(&CurrentJob);
         }
+        FinishQueuedJob(&Next);
+        IdleMs = 0;
     }
+
+    printf("\nStopping the daemon\n");
+    StopJobServer();
+    ReleaseFont(pWarmFont);
+    StopFontCache();
+    DrainArenaPool();
+    CloseRS232Port();
+    return 0;
 }
 
-void SetNewLine(float FontSize)
+int OpenRobotPort(const char *Port)
 {
-    XOffset = 0.0f;
-    YOffset -= (FontSize + LineSpacing); // Moves the YOffset down for the new line
+    if (strcmp(Port, AutoPort) == 0) // Every comports[] entry is tried until one answers
+    {
+        return FindRobotPort();
+    }
+
+    char *pEnd;
+    long PortNumber = strtol(Port, &pEnd, 10);
+    if (pEnd != Port && *pEnd == '\0') // A number picks an entry of comports[] in rs232.c
+    {
+        SerialPort = (int)PortNumber;
+        return CanRS232PortBeOpened();
+    }
+    return OpenSerialDevice(Port); // Anything else is the device itself
 }
 
-void ResetPen(void)
+void SendCommands(char *buffer)
 {
-#if TERMINAL_MODE == 1
+    if (CheckpointActive && JobState.LinesAcknowledged < ResumeFromLine) // Already drawn before the job stopped
     {
-        printf("S0\n");       // Pen up command
-        printf("G0 X0 Y0\n"); // Move to origin
+        TrackCommand(&JobState, buffer);
+        JobState.LinesAcknowledged++;
+        return;
     }
-#endif
-#if TERMINAL_MODE == 0
+
+    if (CheckpointActive && ResumeFromLine > 0) // First new line of a resumed job
     {
-        char WordBuffer[100];
-        sprintf(WordBuffer, "S0\n"); // Pen up command
-        SendCommands(WordBuffer);
-        sprintf(WordBuffer, "G0 X0 Y0\n"); // Move to origin
-        SendCommands(WordBuffer);
+        RestorePosition();
+    }
+
+    // printf ("Buffer to send: %s", buffer); // For diagnostic purposes only, normally comment out
+    int Status;
+    if (Options.Pipeline)
+    {
+        Status = QueueCommand(buffer); // Acknowledgements arrive later through CommandAcknowledged()
+    }
+    else
+    {
+        Status = SendCommand(buffer);
+        CommandAcknowledged(buffer, Status);
+        PROFILE_START(Sleep);
+        Sleep(100); // Can omit this when using the writing robot but has minimal effect
+        PROFILE_STOP(StageSleep, Sleep);
+    }
+    // getch(); // Omit this once basic testing with emulator has taken place
+
+    if (Status == ReplyTimeout || Status == ReplyAlarm)
+    {
+        StopJob(Status);
     }
-#endif
 }
 
-void FreeFontData(void)
+void CommandAcknowledged(const char *Command, int Status)
 {
-    for (int i = 0; i < MaxAscii; i++)
+    if (Status == ReplyError) // GRBL skips a rejected line, so the job carries on without it
+    {
+        printf("Robot rejected: %s", Command);
+    }
+
+    if (CheckpointActive && (Status == ReplyOk || Status == ReplyError))
     {
-        free(FontArray[i].pStrokes);
+        AcknowledgeCommand(&JobState, Command);
     }
-    free(FontArray);
 }
 
-#if TERMINAL_MODE == 0
-void SendCommands(char *buffer)
+void StopJob(int Status)
 {
-    // printf ("Buffer to send: %s", buffer); // For diagnostic purposes only, normally comment out
-    PrintBuffer(&buffer[0]);
-    WaitForReply();
-    Sleep(100); // Can omit this when using the writing robot but has minimal effect
-    // getch(); // Omit this once basic testing with emulator has taken place
+    printf("\n%s, stopping after %ld lines\n", Status == ReplyAlarm ? "Robot raised an alarm" : "Robot stopped replying",
+           JobState.LinesAcknowledged);
+    if (CheckpointActive)
+    {
+        SaveCheckpoint(&JobState); // Saves are spaced out while drawing, so the last lines acknowledged are caught here
+        printf("Run again with --resume to carry on from where it stopped\n");
+    }
+    FinishCachingJob(0, NULL, 0); // A job that did not finish is not kept
+
+    CloseRS232Port();
+    exit(1);
+}
+
+void RestorePosition(void)
+{
+    char buffer[100];
+
+    ResumeFromLine = 0;
+    CheckpointActive = 0; // These moves are not part of the job
+
+    // The start-up commands have already homed the robot, so lift the pen, travel to where the job stopped
+    // and put the pen back the way it was
+    sprintf(buffer, "S0\n");
+    SendCommands(buffer);
+    sprintf(buffer, "G0 X%.2f Y%.2f\n", JobState.X, JobState.Y);
+    SendCommands(buffer);
+    sprintf(buffer, "S%d\n", JobState.Pen);
+    SendCommands(buffer);
+    FlushCommands(); // Restore moves must be answered before job lines are counted again
+
+    CheckpointActive = 1;
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+// Word lists, paragraph buffers and drawings used to be grown with realloc and freed piece by piece. They now
+// come from an arena per job, so a job costs a handful of block allocations and is given back in one go. Emptied
+// blocks wait in a shared pool, up to ArenaPoolBudget, so a daemon or batch run stops calling malloc at all once
+// it has seen its largest job.
+
+// GLOBAL CONSTANTS
+
+#define ArenaAlignment 16 // Enough for any type the jobs keep
+
+// GLOBAL VARIABLES
+
+static pthread_mutex_t PoolLock = PTHREAD_MUTEX_INITIALIZER;
+static ArenaBlock *pPool = NULL;
+static size_t PoolBytes = 0;
+
+// FUNCTION DECLARATIONS
+
+static ArenaBlock *TakeBlock(size_t Size);
+static unsigned char *BlockData(ArenaBlock *pBlock);
+
+// FUNCTIONS
+
+void *ArenaAlloc(Arena *pArena, size_t Size)
+{
+    ArenaBlock *pBlock = pArena->pBlocks;
+    if (Size == 0)
+    {
+        Size = 1;
+    }
+
+    if (pBlock != NULL)
+    {
+        uintptr_t Start = (uintptr_t)(BlockData(pBlock) + pBlock->Used);
+        size_t Padding = (ArenaAlignment - Start % ArenaAlignment) % ArenaAlignment;
+        if (Size <= pBlock->Size - pBlock->Used && Padding <= pBlock->Size - pBlock->Used - Size)
+        {
+            void *pMemory = BlockData(pBlock) + pBlock->Used + Padding;
+            pBlock->Used += Padding + Size;
+            pArena->pLast = pMemory;
+            return pMemory;
+        }
+    }
+
+    if (Size > SIZE_MAX - ArenaAlignment)
+    {
+        return NULL;
+    }
+    pBlock = TakeBlock(Size + ArenaAlignment > ArenaBlockSize ? Size + ArenaAlignment : ArenaBlockSize);
+    if (pBlock == NULL)
+    {
+        return NULL;
+    }
+    pBlock->pNext = pArena->pBlocks;
+    pArena->pBlocks = pBlock;
+    pArena->Bytes += pBlock->Size;
+
+    uintptr_t Start = (uintptr_t)BlockData(pBlock);
+    size_t Padding = (ArenaAlignment - Start % ArenaAlignment) % ArenaAlignment;
+    pBlock->Used = Padding + Size;
+    pArena->pLast = BlockData(pBlock) + Padding;
+    return pArena->pLast;
+}
+
+void *ArenaGrow(Arena *pArena, void *pOld, size_t OldSize, size_t NewSize)
+{
+    if (pOld == NULL)
+    {
+        return ArenaAlloc(pArena, NewSize);
+    }
+
+    ArenaBlock *pBlock = pArena->pBlocks;
+    if (pOld == pArena->pLast && NewSize <= pBlock->Size - (size_t)((unsigned char *)pOld - BlockData(pBlock)))
+    {
+        pBlock->Used = (size_t)((unsigned char *)pOld - BlockData(pBlock)) + NewSize; // Still the latest, so it lengthens in place
+        return pOld;
+    }
+
+    void *pNew = ArenaAlloc(pArena, NewSize);
+    if (pNew != NULL)
+    {
+        memcpy(pNew, pOld, OldSize < NewSize ? OldSize : NewSize);
+    }
+    return pNew;
+}
+
+void FreeArena(Arena *pArena)
+{
+    ArenaBlock *pBlock = pArena->pBlocks;
+
+    pthread_mutex_lock(&PoolLock);
+    while (pBlock != NULL)
+    {
+        ArenaBlock *pNext = pBlock->pNext;
+        if (pBlock->Size == ArenaBlockSize && PoolBytes + pBlock->Size <= ArenaPoolBudget)
+        {
+            pBlock->pNext = pPool;
+            pPool = pBlock;
+            PoolBytes += pBlock->Size;
+        }
+        else // Outsized blocks are rarely asked for again at the same size
+        {
+            free(pBlock);
+        }
+        pBlock = pNext;
+    }
+    pthread_mutex_unlock(&PoolLock);
+
+    memset(pArena, 0, sizeof(Arena));
+}
+
+void DrainArenaPool(void)
+{
+    pthread_mutex_lock(&PoolLock);
+    while (pPool != NULL)
+    {
+        ArenaBlock *pNext = pPool->pNext;
+        free(pPool);
+        pPool = pNext;
+    }
+    PoolBytes = 0;
+    pthread_mutex_unlock(&PoolLock);
+}
+
+static ArenaBlock *TakeBlock(size_t Size)
+{
+    ArenaBlock *pBlock = NULL;
+
+    if (Size == ArenaBlockSize)
+    {
+        pthread_mutex_lock(&PoolLock);
+        pBlock = pPool;
+        if (pBlock != NULL)
+        {
+            pPool = pBlock->pNext;
+            PoolBytes -= pBlock->Size;
+        }
+        pthread_mutex_unlock(&PoolLock);
+    }
+
+    if (pBlock == NULL)
+    {
+        if (Size > SIZE_MAX - sizeof(ArenaBlock))
+        {
+            return NULL;
+        }
+        pBlock = malloc(sizeof(ArenaBlock) + Size);
+        if (pBlock == NULL)
+        {
+            return NULL;
+        }
+        pBlock->Size = Size;
+    }
+
+    pBlock->pNext = NULL;
+    pBlock->Used = 0;
+    return pBlock;
+}
+
+static unsigned char *BlockData(ArenaBlock *pBlock)
+{
+    return (unsigned char *)(pBlock + 1);
+}
@@ -0,0 +1,35 @@
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include <stddef.h>
+
+// GLOBAL CONSTANTS
+
+#define ArenaBlockSize (256u * 1024)       // Bytes taken at a time; larger requests get a block to themselves
+#define ArenaPoolBudget (16u * 1024 * 1024) // Bytes of emptied blocks kept for the next job rather than freed
+
+// STRUCTS
+
+typedef struct ArenaBlock // Struct to hold one piece of memory an arena hands out from
+{
+    struct ArenaBlock *pNext;
+    size_t Size; // Bytes after the header
+    size_t Used;
+} ArenaBlock;
+
+typedef struct // Struct to hold the memory of one job, handed out by moving a pointer along and given back all at once
+{
+    ArenaBlock *pBlocks; // The block being filled first; zero-filled is an empty arena
+    void *pLast;         // Latest allocation, which ArenaGrow can lengthen where it is
+    size_t Bytes;        // Held by the arena, for reports
+} Arena;
+
+// FUNCTION DECLARATIONS
+
+// An arena belongs to one thread at a time; only the pool of spare blocks behind them all is shared
+void *ArenaAlloc(Arena *pArena, size_t Size); // NULL when memory runs out
+void *ArenaGrow(Arena *pArena, void *pOld, size_t OldSize, size_t NewSize); // Like realloc, but the old space is only reclaimed by FreeArena
+void FreeArena(Arena *pArena); // Everything the arena handed out goes at once, and its blocks go back to the pool
+void DrainArenaPool(void);
+
+#endif // ARENA_H_INCLUDED
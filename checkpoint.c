@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkpoint.h"
+#include "platform.h"
+
+// FUNCTION DECLARATIONS
+
+static int ReadFileName(FILE *pFile, char *FileName);
+static int IsJobKey(const char *Text);
+
+// FUNCTIONS
+
+int StartCheckpoint(Checkpoint *pCheckpoint, const char *InputFile, const char *FontFile, float FontSize, const char *JobKey)
+{
+    memset(pCheckpoint, 0, sizeof(Checkpoint));
+    strncpy(pCheckpoint->InputFile, InputFile, MaxPathLength - 1);
+    strncpy(pCheckpoint->FontFile, FontFile, MaxPathLength - 1);
+    pCheckpoint->FontSize = FontSize;
+    snprintf(pCheckpoint->JobKey, sizeof(pCheckpoint->JobKey), "%s", IsJobKey(JobKey) ? JobKey : NoJobKey);
+    pCheckpoint->Page = 1;
+
+    // An existing checkpoint is left intact until the first line is acknowledged, so a resume that fails
+    // before reaching the robot can simply be run again
+    pCheckpoint->pFile = fopen(CheckpointFileName, "r+");
+    if (pCheckpoint->pFile == NULL)
+    {
+        pCheckpoint->pFile = fopen(CheckpointFileName, "w");
+    }
+    if (pCheckpoint->pFile == NULL)
+    {
+        printf("Could not create %s, the job will not be resumable\n", CheckpointFileName);
+        return -1;
+    }
+
+    return 0;
+}
+
+int LoadCheckpoint(Checkpoint *pCheckpoint)
+{
+    memset(pCheckpoint, 0, sizeof(Checkpoint));
+
+    FILE *pFile = fopen(CheckpointFileName, "r");
+    if (pFile == NULL)
+    {
+        printf("No checkpoint found in %s\n", CheckpointFileName);
+        return -1;
+    }
+
+    int Fields = 0;
+    if (ReadFileName(pFile, pCheckpoint->InputFile) == 0 && ReadFileName(pFile, pCheckpoint->FontFile) == 0)
+    {
+        Fields = fscanf(pFile, "%32s %f %ld %d %f %f %d",
+                        pCheckpoint->JobKey,
+                        &pCheckpoint->FontSize,
+                        &pCheckpoint->LinesAcknowledged,
+                        &pCheckpoint->Pen,
+                        &pCheckpoint->X,
+                        &pCheckpoint->Y,
+                        &pCheckpoint->Page);
+    }
+    fclose(pFile);
+
+    if (Fields != 7)
+    {
+        printf("Checkpoint in %s is damaged\n", CheckpointFileName);
+        return -2;
+    }
+
+    return 0;
+}
+
+void TrackCommand(Checkpoint *pCheckpoint, const char *Command)
+{
+    if (Command[0] == 'S') // Pen (spindle) value
+    {
+        pCheckpoint->Pen = atoi(&Command[1]);
+    }
+    else if (Command[0] == 'G') // Moves carry the new position
+    {
+        const char *pX = strchr(Command, 'X');
+        const char *pY = strchr(Command, 'Y');
+        if (pX != NULL)
+        {
+            pCheckpoint->X = (float)atof(pX + 1);
+        }
+        if (pY != NULL)
+        {
+            pCheckpoint->Y = (float)atof(pY + 1);
+        }
+    }
+}
+
+void AcknowledgeCommand(Checkpoint *pCheckpoint, const char *Command)
+{
+    TrackCommand(pCheckpoint, Command);
+    pCheckpoint->LinesAcknowledged++;
+
+    // A resume redraws whatever was acknowledged after the last save, which is harmless at a pen lift and at
+    // worst retraces a few moves of the stroke in progress
+    long long Since = MillisecondsNow() - pCheckpoint->LastSaved;
+    int PenLifted = Command[0] == 'S' && pCheckpoint->Pen == 0;
+    if ((PenLifted && Since >= CheckpointPenUpMs) || Since >= CheckpointLongestMs)
+    {
+        SaveCheckpoint(pCheckpoint);
+    }
+}
+
+int SaveCheckpoint(Checkpoint *pCheckpoint)
+{
+    if (pCheckpoint->pFile == NULL)
+    {
+        return -1;
+    }
+
+    // Every field has a fixed width so each rewrite covers the previous one exactly
+    pCheckpoint->LastSaved = MillisecondsNow();
+    rewind(pCheckpoint->pFile);
+    fprintf(pCheckpoint->pFile, "%-*s\n%-*s\n%-*s %10.3f %12ld %6d %12.3f %12.3f %6d\n",
+            MaxPathLength - 1, pCheckpoint->InputFile,
+            MaxPathLength - 1, pCheckpoint->FontFile,
+            JobKeyLength, pCheckpoint->JobKey,
+            pCheckpoint->FontSize,
+            pCheckpoint->LinesAcknowledged,
+            pCheckpoint->Pen,
+            pCheckpoint->X,
+            pCheckpoint->Y,
+            pCheckpoint->Page);
+
+    return fflush(pCheckpoint->pFile) == 0 ? 0 : -1;
+}
+
+void ClearCheckpoint(Checkpoint *pCheckpoint)
+{
+    if (pCheckpoint->pFile != NULL)
+    {
+        fclose(pCheckpoint->pFile);
+        pCheckpoint->pFile = NULL;
+    }
+    remove(CheckpointFileName); // A finished job leaves nothing to resume
+}
+
+static int ReadFileName(FILE *pFile, char *FileName) // Each name sits on a line of its own so it may contain spaces
+{
+    char Line[MaxPathLength + 2];
+    if (fgets(Line, sizeof(Line), pFile) == NULL)
+    {
+        return -1;
+    }
+
+    size_t Length = strcspn(Line, "\r\n");
+    while (Length > 0 && Line[Length - 1] == ' ') // Strips the padding added by SaveCheckpoint
+    {
+        Length--;
+    }
+    Line[Length] = '\0';
+    if (Length == 0 || Length >= MaxPathLength)
+    {
+        return -1;
+    }
+
+    strcpy(FileName, Line);
+    return 0;
+}
+
+static int IsJobKey(const char *Text) // JobKeyLength hex digits, as MakeJobKey() writes them
+{
+    if (Text == NULL || strlen(Text) != JobKeyLength)
+    {
+        return 0;
+    }
+    return strspn(Text, "0123456789abcdef") == JobKeyLength;
+}
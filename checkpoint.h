@@ -0,0 +1,42 @@
+#ifndef CHECKPOINT_H_INCLUDED
+#define CHECKPOINT_H_INCLUDED
+
+#include <stdio.h>
+
+#include "gcodecache.h"
+
+// GLOBAL CONSTANTS
+
+#define CheckpointFileName "RobotWriter.checkpoint"
+#define MaxPathLength 260
+#define CheckpointPenUpMs 500     // Saved when the pen lifts, at most this often, so writing stays off the send path
+#define CheckpointLongestMs 5000  // Saved at least this often while the pen stays down
+#define NoJobKey "none"           // Stands in for the key of a job that could not be given one
+
+// STRUCTS
+
+typedef struct // Struct to hold how far a job has got on the robot
+{
+    char InputFile[MaxPathLength];
+    char FontFile[MaxPathLength];
+    float FontSize;
+    char JobKey[JobKeyLength + 1]; // MakeJobKey() of the job, so a resume with other settings or text is refused
+    long LinesAcknowledged; // Job G-code lines the robot has replied 'ok' to
+    int Pen;                // Last S value acknowledged
+    float X, Y;             // Last position acknowledged
+    int Page;
+
+    FILE *pFile;         // Kept open while the job runs so each update is a single rewrite
+    long long LastSaved; // MillisecondsNow() when the record was last written
+} Checkpoint;
+
+// FUNCTION DECLARATIONS
+
+int StartCheckpoint(Checkpoint *pCheckpoint, const char *InputFile, const char *FontFile, float FontSize, const char *JobKey);
+int LoadCheckpoint(Checkpoint *pCheckpoint);
+void TrackCommand(Checkpoint *pCheckpoint, const char *Command);
+void AcknowledgeCommand(Checkpoint *pCheckpoint, const char *Command); // Counts the line and saves when one is due
+int SaveCheckpoint(Checkpoint *pCheckpoint);
+void ClearCheckpoint(Checkpoint *pCheckpoint);
+
+#endif // CHECKPOINT_H_INCLUDED
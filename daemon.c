@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "daemon.h"
+#include "drawing.h"
+#include "fontcache.h"
+#include "options.h"
+#include "platform.h"
+
+// Jobs reach the daemon over a Unix domain socket. A client sends the job's settings as "name = value" lines, the
+// same as in RobotWriter.conf, then a line holding just "text", then the text itself until it closes its side.
+// The daemon spools the text to a file, queues the job and answers with one line, either "queued <id>" or
+// "error <reason>". Settings that belong to the daemon, such as the port, are not taken from jobs.
+
+#if !defined(_WIN32)
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// GLOBAL VARIABLES
+
+static JobOptions DaemonOptions;
+static int ListenSocket = -1;
+static pthread_t ServerThreadId;
+static volatile sig_atomic_t Stopping = 0;
+
+static pthread_mutex_t QueueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t JobQueued = PTHREAD_COND_INITIALIZER;
+static QueuedJob Queue[MaxQueuedJobs];
+static int QueuedCount = 0;
+static int LastJobId = 0;
+
+// FUNCTION DECLARATIONS
+
+static int SocketAddress(const char *Path, struct sockaddr_un *pAddress);
+static void *ServerThread(void *pArgument);
+static void TakeSubmission(int Client);
+static int SpoolText(FILE *pClient, const char *FileName);
+static void ReplyToClient(int Client, const char *Reply);
+static void OnStopSignal(int Signal);
+
+// FUNCTIONS
+
+int StartJobServer(const JobOptions *pDaemonOptions)
+{
+    DaemonOptions = *pDaemonOptions;
+
+    struct sockaddr_un Address;
+    if (SocketAddress(DaemonOptions.SocketPath, &Address) != 0)
+    {
+        return -1;
+    }
+
+    if (MakeFolder(SpoolFolder) != 0)
+    {
+        printf("Could not create %s\n", SpoolFolder);
+        return -1;
+    }
+
+    // A socket file left by a daemon that did not shut down cleanly is taken over, but not one still answering
+    int Probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (Probe >= 0 && connect(Probe, (struct sockaddr *)&Address, sizeof(Address)) == 0)
+    {
+        printf("A daemon is already taking jobs on %s\n", DaemonOptions.SocketPath);
+        close(Probe);
+        return -1;
+    }
+    if (Probe >= 0)
+    {
+        close(Probe);
+    }
+    unlink(DaemonOptions.SocketPath);
+
+    ListenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (ListenSocket < 0 || bind(ListenSocket, (struct sockaddr *)&Address, sizeof(Address)) != 0 || listen(ListenSocket, 16) != 0)
+    {
+        printf("Could not listen on %s\n", DaemonOptions.SocketPath);
+        if (ListenSocket >= 0)
+        {
+            close(ListenSocket);
+        }
+        ListenSocket = -1;
+        return -1;
+    }
+
+    struct sigaction Action; // No SA_RESTART, so a blocked accept() returns and sees the flag
+    memset(&Action, 0, sizeof(Action));
+    Action.sa_handler = OnStopSignal;
+    sigemptyset(&Action.sa_mask);
+    sigaction(SIGINT, &Action, NULL);
+    sigaction(SIGTERM, &Action, NULL);
+    signal(SIGPIPE, SIG_IGN); // A client that hangs up early must not take the daemon with it
+
+    if (pthread_create(&ServerThreadId, NULL, ServerThread, NULL) != 0)
+    {
+        close(ListenSocket);
+        ListenSocket = -1;
+        unlink(DaemonOptions.SocketPath);
+        return -1;
+    }
+
+    printf("Taking jobs on %s\n", DaemonOptions.SocketPath);
+    return 0;
+}
+
+int WaitForJob(QueuedJob *pJob, int TimeoutMs)
+{
+    struct timespec Deadline;
+    clock_gettime(CLOCK_REALTIME, &Deadline);
+    Deadline.tv_sec += TimeoutMs / 1000;
+    Deadline.tv_nsec += (long)(TimeoutMs % 1000) * 1000000L;
+    if (Deadline.tv_nsec >= 1000000000L)
+    {
+        Deadline.tv_sec++;
+        Deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&QueueLock);
+    while (QueuedCount == 0 && !Stopping)
+    {
+        if (pthread_cond_timedwait(&JobQueued, &QueueLock, &Deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+
+    if (Stopping || QueuedCount == 0)
+    {
+        pthread_mutex_unlock(&QueueLock);
+        return Stopping ? -1 : 1;
+    }
+
+    int Best = 0; // Highest priority first, and the oldest of those
+    for (int i = 1; i < QueuedCount; i++)
+    {
+        if (Queue[i].Options.Priority > Queue[Best].Options.Priority ||
+            (Queue[i].Options.Priority == Queue[Best].Options.Priority && Queue[i].Id < Queue[Best].Id))
+        {
+            Best = i;
+        }
+    }
+    *pJob = Queue[Best];
+    Queue[Best] = Queue[--QueuedCount];
+
+    pthread_mutex_unlock(&QueueLock);
+    return 0;
+}
+
+void FinishQueuedJob(const QueuedJob *pJob)
+{
+    remove(pJob->Options.InputFile); // A job that stopped part way keeps its text for --resume
+}
+
+void StopJobServer(void)
+{
+    if (ListenSocket < 0)
+    {
+        return;
+    }
+
+    Stopping = 1;
+    shutdown(ListenSocket, SHUT_RDWR); // Wakes the accept() in the server thread
+    pthread_join(ServerThreadId, NULL);
+    close(ListenSocket);
+    ListenSocket = -1;
+    unlink(DaemonOptions.SocketPath);
+
+    pthread_mutex_lock(&QueueLock);
+    if (QueuedCount > 0)
+    {
+        printf("%d queued jobs were not drawn, their text is in %s\n", QueuedCount, SpoolFolder);
+    }
+    QueuedCount = 0;
+    pthread_mutex_unlock(&QueueLock);
+}
+
+int SubmitJob(const JobOptions *pOptions)
+{
+    FILE *pText = strcmp(pOptions->InputFile, StandardInput) == 0 ? stdin : fopen(pOptions->InputFile, "rb"); // Sent once it has ended
+    if (pText == NULL)
+    {
+        printf("Could not open %s\n", pOptions->InputFile);
+        return -1;
+    }
+
+    struct sockaddr_un Address;
+    if (SocketAddress(pOptions->SocketPath, &Address) != 0)
+    {
+        fclose(pText);
+        return -1;
+    }
+
+    int Server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (Server < 0 || connect(Server, (struct sockaddr *)&Address, sizeof(Address)) != 0)
+    {
+        printf("No daemon is taking jobs on %s\n", pOptions->SocketPath);
+        if (Server >= 0)
+        {
+            close(Server);
+        }
+        fclose(pText);
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN); // A refused job is reported from the reply instead
+    FILE *pServer = fdopen(dup(Server), "w");
+    if (pServer != NULL)
+    {
+        WriteJobSettings(pOptions, pServer);
+        fprintf(pServer, SubmitTextMarker "\n");
+
+        char Chunk[4096];
+        size_t Read;
+        while ((Read = fread(Chunk, 1, sizeof(Chunk), pText)) > 0)
+        {
+            if (fwrite(Chunk, 1, Read, pServer) != Read) // The daemon gave up on the job; its reply says why
+            {
+                break;
+            }
+        }
+        fclose(pServer);
+    }
+    fclose(pText);
+    shutdown(Server, SHUT_WR); // Marks the end of the text
+
+    char Reply[256];
+    ssize_t Length = 0, Received;
+    while (Length < (ssize_t)sizeof(Reply) - 1 && (Received = recv(Server, Reply + Length, sizeof(Reply) - 1 - (size_t)Length, 0)) > 0)
+    {
+        Length += Received;
+    }
+    close(Server);
+    Reply[Length] = '\0';
+    Reply[strcspn(Reply, "\r\n")] = '\0';
+
+    printf("%s\n", Length > 0 ? Reply : "error the daemon closed the connection");
+    return strncmp(Reply, "queued", 6) == 0 ? 0 : -1;
+}
+
+static int SocketAddress(const char *Path, struct sockaddr_un *pAddress)
+{
+    memset(pAddress, 0, sizeof(*pAddress));
+    pAddress->sun_family = AF_UNIX;
+    if (strlen(Path) >= sizeof(pAddress->sun_path))
+    {
+        printf("Socket path %s is too long\n", Path);
+        return -1;
+    }
+    memcpy(pAddress->sun_path, Path, strlen(Path) + 1);
+    return 0;
+}
+
+static void *ServerThread(void *pArgument)
+{
+    (void)pArgument;
+
+    while (!Stopping)
+    {
+        int Client = accept(ListenSocket, NULL, NULL);
+        if (Client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            break; // The socket has been shut down
+        }
+
+        TakeSubmission(Client);
+        close(Client);
+    }
+
+    return NULL;
+}
+
+static void TakeSubmission(int Client)
+{
+    struct timeval Timeout = {SubmitTimeoutMs / 1000, (SubmitTimeoutMs % 1000) * 1000}; // A stalled client cannot hold up the next one
+    setsockopt(Client, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+
+    int ReadSocket = dup(Client);
+    FILE *pClient = ReadSocket >= 0 ? fdopen(ReadSocket, "rb") : NULL;
+    if (pClient == NULL)
+    {
+        if (ReadSocket >= 0)
+        {
+            close(ReadSocket);
+        }
+        ReplyToClient(Client, "error the daemon is out of resources\n");
+        return;
+    }
+
+    JobOptions Submitted = DaemonOptions;
+    Submitted.FontSize = 0.0f;
+    if (ReadSettings(&Submitted, pClient, "submitted job", SubmitTextMarker) != 0)
+    {
+        fclose(pClient);
+        ReplyToClient(Client, "error the settings were not understood\n");
+        return;
+    }
+    int IsDrawing = IsDrawingFile(Submitted.InputFile); // Drawings are fitted to the page and need no size
+    if (Submitted.FontSize == 0.0f && !IsDrawing) // There is nobody at the daemon to ask
+    {
+        fclose(pClient);
+        ReplyToClient(Client, "error no font size given\n");
+        return;
+    }
+
+    QueuedJob Job;
+    Job.Options = DaemonOptions; // Only what belongs to a job is taken from the client
+    int Resolved = FontBesideFont(Submitted.FontFile, DaemonOptions.FontFile, Job.Options.FontFile); // Never a file of the client's choosing
+    if (Resolved != 0)
+    {
+        fclose(pClient);
+        ReplyToClient(Client, Resolved == FontNameHasFolder ? "error fonts are named without a folder, from the daemon's font folder\n"
+                                                            : "error the font name is too long\n");
+        return;
+    }
+    snprintf(Job.Name, sizeof(Job.Name), "%s", Submitted.InputFile);
+    Job.Options.FontSize = Submitted.FontSize;
+    Job.Options.Cache = Submitted.Cache;
+    Job.Options.Arcs = Submitted.Arcs;
+    Job.Options.Page = Submitted.Page;
+    Job.Options.Priority = Submitted.Priority;
+    // Fonts are kerned once as the daemon loads them and shared by every job, so the daemon's setting stands
+    int KerningOverruled = Submitted.Kerning != DaemonOptions.Kerning;
+
+    pthread_mutex_lock(&QueueLock);
+    Job.Id = ++LastJobId;
+    pthread_mutex_unlock(&QueueLock);
+
+    // The spooled copy keeps the drawing extension, since that is how PrepareJob tells a drawing from text
+    snprintf(Job.Options.InputFile, sizeof(Job.Options.InputFile), "%s/%d-%d%s", SpoolFolder, ProcessId(), Job.Id,
+             IsDrawing ? DrawingExtension : ".txt");
+    int Spooled = SpoolText(pClient, Job.Options.InputFile);
+    fclose(pClient);
+    if (Spooled != 0)
+    {
+        remove(Job.Options.InputFile);
+        ReplyToClient(Client, "error the text could not be received\n");
+        return;
+    }
+
+    pthread_mutex_lock(&QueueLock);
+    int Waiting = QueuedCount;
+    if (QueuedCount < MaxQueuedJobs)
+    {
+        Queue[QueuedCount++] = Job;
+        pthread_cond_signal(&JobQueued);
+    }
+    pthread_mutex_unlock(&QueueLock);
+
+    char Reply[128];
+    if (Waiting == MaxQueuedJobs)
+    {
+        remove(Job.Options.InputFile);
+        ReplyToClient(Client, "error the queue is full\n");
+        return;
+    }
+    printf("\nQueued job %d: %s, priority %d\n", Job.Id, Job.Name, Job.Options.Priority);
+    snprintf(Reply, sizeof(Reply), "queued %d, %d ahead%s\n", Job.Id, Waiting,
+             !KerningOverruled ? "" : DaemonOptions.Kerning ? ", with kerning on as the daemon was started" : ", with kerning off as the daemon was started");
+    ReplyToClient(Client, Reply);
+}
+
+static int SpoolText(FILE *pClient, const char *FileName)
+{
+    FILE *pSpool = fopen(FileName, "wb");
+    if (pSpool == NULL)
+    {
+        return -1;
+    }
+
+    char Chunk[4096];
+    size_t Read;
+    while ((Read = fread(Chunk, 1, sizeof(Chunk), pClient)) > 0)
+    {
+        fwrite(Chunk, 1, Read, pSpool);
+    }
+
+    int Failed = ferror(pClient) || ferror(pSpool); // A read error includes running out of SubmitTimeoutMs
+    Failed |= (fclose(pSpool) != 0);
+    return Failed ? -1 : 0;
+}
+
+static void ReplyToClient(int Client, const char *Reply)
+{
+    send(Client, Reply, strlen(Reply), 0);
+}
+
+static void OnStopSignal(int Signal)
+{
+    (void)Signal;
+    Stopping = 1;
+}
+
+#else
+
+// Windows builds draw one job per run; the daemon relies on Unix domain sockets
+
+int StartJobServer(const JobOptions *pDaemonOptions)
+{
+    (void)pDaemonOptions;
+    printf("The daemon is not available in this build\n");
+    return -1;
+}
+
+int WaitForJob(QueuedJob *pJob, int TimeoutMs)
+{
+    (void)pJob;
+    (void)TimeoutMs;
+    return -1;
+}
+
+void FinishQueuedJob(const QueuedJob *pJob)
+{
+    (void)pJob;
+}
+
+void StopJobServer(void)
+{
+}
+
+int SubmitJob(const JobOptions *pOptions)
+{
+    (void)pOptions;
+    printf("Submitting to a daemon is not available in this build\n");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef DAEMON_H_INCLUDED
+#define DAEMON_H_INCLUDED
+
+#include <stddef.h>
+
+#include "options.h"
+
+// GLOBAL CONSTANTS
+
+#define SpoolFolder "RobotWriterSpool" // Text or drawing of each queued job, removed once it has been drawn
+#define MaxQueuedJobs 64
+#define SubmitTextMarker "text"         // Ends the settings of a submission; the job's text follows
+#define SubmitTimeoutMs 5000            // Longest a client may take to send its job
+
+// STRUCTS
+
+typedef struct // Struct to hold a job waiting in the daemon's queue
+{
+    int Id;
+    char Name[MaxOptionLength]; // Input file as the client named it
+    JobOptions Options;         // InputFile is the spooled copy of the text or drawing
+} QueuedJob;
+
+// FUNCTION DECLARATIONS
+
+int StartJobServer(const JobOptions *pDaemonOptions);
+int WaitForJob(QueuedJob *pJob, int TimeoutMs); // 0 with a job, 1 if none came in time, -1 once the daemon is stopping
+void FinishQueuedJob(const QueuedJob *pJob);
+void StopJobServer(void);
+int SubmitJob(const JobOptions *pOptions);
+
+#endif // DAEMON_H_INCLUDED
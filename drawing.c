@@ -0,0 +1,981 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drawing.h"
+
+// Reads the shapes of an SVG file into the same pen-up/pen-down strokes a glyph is made of, so logos and
+// signatures go through the scaling and senders used for text. Paths (every command, with curves and arcs split
+// into straight runs no further than DrawingTolerance from the true shape), lines, polylines, polygons and
+// rectangles are drawn, moved by any transform on them or the groups around them. Fill, stroke width and styling
+// are ignored since the pen draws every outline once, and nothing inside <defs> or similar is drawn.
+
+// GLOBAL CONSTANTS
+
+#define MaxGroupDepth 64    // Nested groups whose transforms are followed; deeper ones keep their parent's
+#define MaxCurveDepth 16    // Halvings of one curve segment before it is drawn straight regardless
+#define MaxArcSteps 10000
+#define Pi 3.14159265f
+
+// STRUCTS
+
+typedef struct // Struct to hold an affine transform, mapping (x, y) to (A x + C y + E, B x + D y + F)
+{
+    float A, B, C, D, E, F;
+} Transform;
+
+typedef struct // Struct to hold a drawing while the SVG text is read
+{
+    Drawing *pDrawing;
+    Transform Groups[MaxGroupDepth]; // Transform in force inside each open group, the root at the bottom
+    int Depth;
+    int Overflow;      // Groups open beyond MaxGroupDepth
+    Transform Current; // Groups[Depth] combined with the element's own transform
+    float Tolerance;   // DrawingTolerance in the current element's units
+    int Failed;        // Set once memory or MaxDrawingStrokes runs out, after which points are ignored
+    int Malformed;     // Set once bad path data has cut a path short, so it is only reported once
+} DrawingReader;
+
+typedef struct // Struct to hold the pen while path data is read
+{
+    float X, Y;
+    float StartX, StartY;     // Start of the subpath, where Z returns
+    float ControlX, ControlY; // Last control point, reflected by S and T
+    char Previous;            // Last command in upper case
+} PathState;
+
+// FUNCTION DECLARATIONS
+
+static int ParseDrawing(Drawing *pDrawing, const char *Text);
+static const char *TagEnd(const char *pTag);
+static const char *FindAttribute(const char *pTag, const char *pEnd, const char *Name);
+static float ReadLength(const char *pValue, float Default);
+static void ReadRoot(DrawingReader *pReader, const char *pTag, const char *pEnd);
+static void BeginElement(DrawingReader *pReader, const char *pTag, const char *pEnd);
+static void ReadTransform(const char *pValue, Transform *pTransform);
+static void Combine(const Transform *pFirst, const Transform *pThen, Transform *pResult);
+static void ReadPath(DrawingReader *pReader, const char *pData);
+static void ReadPoints(DrawingReader *pReader, const char *pPoints, int Closed);
+static void ReadRect(DrawingReader *pReader, const char *pTag, const char *pEnd);
+static void ReadLine(DrawingReader *pReader, const char *pTag, const char *pEnd);
+static const char *SkipSeparators(const char *pText);
+static int ReadNumber(const char **ppText, float *pValue);
+static int ReadFlag(const char **ppText, int *pFlag);
+static void MoveTo(DrawingReader *pReader, float X, float Y);
+static void LineTo(DrawingReader *pReader, float X, float Y);
+static void AddPoint(DrawingReader *pReader, float X, float Y, int Pen);
+static int32_t ToStrokeUnits(float Value, float UnitSize);
+static void FlattenCubic(DrawingReader *pReader, const float *pPoints, int Depth);
+static void FlattenArc(DrawingReader *pReader, PathState *pState, const float *pArguments, int LargeArc, int Sweep);
+
+// FUNCTIONS
+
+int IsDrawingFile(const char *FileName)
+{
+    size_t Length = strlen(FileName), ExtensionLength = strlen(DrawingExtension);
+    if (Length <= ExtensionLength)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < ExtensionLength; i++)
+    {
+        if (tolower((unsigned char)FileName[Length - ExtensionLength + i]) != DrawingExtension[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int LoadDrawing(Drawing *pDrawing, const char *FileName)
+{
+    memset(pDrawing, 0, sizeof(Drawing));
+
+    FILE *pFile = fopen(FileName, "rb");
+    if (pFile == NULL)
+    {
+        printf("Could not open %s\n", FileName);
+        return -1;
+    }
+
+    long Size = fseek(pFile, 0, SEEK_END) == 0 ? ftell(pFile) : -1;
+    if (Size < 0 || Size > MaxDrawingBytes)
+    {
+        printf(Size < 0 ? "Could not read %s\n" : "%s is larger than a drawing may be\n", FileName);
+        fclose(pFile);
+        return -1;
+    }
+    rewind(pFile);
+
+    char *pText = ArenaAlloc(&pDrawing->Memory, (size_t)Size + 1);
+    if (pText == NULL)
+    {
+        printf("Memory allocation failed for %s\n", FileName);
+        fclose(pFile);
+        return -1;
+    }
+    size_t Length = fread(pText, 1, (size_t)Size, pFile);
+    int ReadFailed = ferror(pFile);
+    fclose(pFile);
+    if (ReadFailed)
+    {
+        printf("Could not read %s\n", FileName);
+        FreeDrawing(pDrawing);
+        return -1;
+    }
+    pText[Length] = 0;
+
+    return ParseDrawing(pDrawing, pText);
+}
+
+int ReadDrawing(Drawing *pDrawing, const char *Text, size_t Length)
+{
+    memset(pDrawing, 0, sizeof(Drawing));
+
+    char *pText = ArenaAlloc(&pDrawing->Memory, Length + 1); // The parser relies on a terminator, which text from memory may lack
+    if (pText == NULL)
+    {
+        printf("Memory allocation failed for the drawing\n");
+        return -1;
+    }
+    memcpy(pText, Text, Length);
+    pText[Length] = 0;
+
+    return ParseDrawing(pDrawing, pText);
+}
+
+float FitDrawing(const Drawing *pDrawing, const PageSettings *pSettings)
+{
+    float Width = (float)((double)pDrawing->MaxX - pDrawing->MinX) / FixedPerMm;
+    float Height = (float)((double)pDrawing->MaxY - pDrawing->MinY) / FixedPerMm;
+    float Shrink = 1.0f;
+
+    if (Width > pSettings->LineLength)
+    {
+        Shrink = pSettings->LineLength / Width;
+    }
+    float Room = pSettings->Height - pSettings->TopMargin - pSettings->BottomMargin;
+    if (Height * Shrink > Room && Room > 0.0f)
+    {
+        Shrink = Room / Height;
+    }
+    return Shrink;
+}
+
+void FreeDrawing(Drawing *pDrawing)
+{
+    FreeArena(&pDrawing->Memory);
+    memset(pDrawing, 0, sizeof(Drawing));
+}
+
+static int ParseDrawing(Drawing *pDrawing, const char *Text)
+{
+    DrawingReader Reader;
+    memset(&Reader, 0, sizeof(Reader));
+    Reader.pDrawing = pDrawing;
+    Reader.Groups[0] = (Transform){1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+    pDrawing->UnitSize = DefaultUnitSize;
+
+    int SeenRoot = 0;
+    int Skipped = 0; // Depth inside <defs> and other elements that are only referred to, never drawn
+    const char *pText = Text;
+
+    while ((pText = strchr(pText, '<')) != NULL && !Reader.Failed)
+    {
+        if (strncmp(pText, "<!--", 4) == 0)
+        {
+            const char *pClose = strstr(pText + 4, "-->");
+            if (pClose == NULL)
+            {
+                break;
+            }
+            pText = pClose + 3;
+            continue;
+        }
+
+        const char *pTag = pText + 1;
+        const char *pEnd = TagEnd(pTag);
+        if (*pEnd == 0)
+        {
+            break; // The file stops part way through a tag
+        }
+        pText = pEnd + 1;
+
+        int Closing = *pTag == '/';
+        const char *pName = pTag + Closing;
+        const char *pColon = pName;
+        while (isalnum((unsigned char)*pColon) || *pColon == '-' || *pColon == '_' || *pColon == '.')
+        {
+            pColon++;
+        }
+        if (*pColon == ':') // Namespace prefix, as in <svg:path>
+        {
+            pName = pColon + 1;
+        }
+        size_t NameLength = 0;
+        while (isalnum((unsigned char)pName[NameLength]) || pName[NameLength] == '-' || pName[NameLength] == '_')
+        {
+            NameLength++;
+        }
+        int SelfClosing = pEnd > pTag && pEnd[-1] == '/';
+
+        static const char *const HiddenElements[] = {"defs", "clipPath", "mask", "marker", "pattern", "symbol", "metadata"};
+        int Hidden = 0;
+        for (size_t i = 0; i < sizeof(HiddenElements) / sizeof(HiddenElements[0]); i++)
+        {
+            if (strlen(HiddenElements[i]) == NameLength && strncmp(pName, HiddenElements[i], NameLength) == 0)
+            {
+                Hidden = 1;
+            }
+        }
+        if (Hidden && !SelfClosing)
+        {
+            Skipped += Closing ? -1 : 1;
+            if (Skipped < 0)
+            {
+                Skipped = 0;
+            }
+            continue;
+        }
+        if (Skipped > 0 || *pTag == '?' || *pTag == '!')
+        {
+            continue;
+        }
+
+        if (NameLength == 1 && *pName == 'g')
+        {
+            if (Closing && Reader.Overflow > 0)
+            {
+                Reader.Overflow--;
+            }
+            else if (Closing)
+            {
+                Reader.Depth -= Reader.Depth > 0;
+            }
+            else if (!SelfClosing && Reader.Depth + 1 == MaxGroupDepth)
+            {
+                Reader.Overflow++;
+            }
+            else if (!SelfClosing)
+            {
+                BeginElement(&Reader, pTag, pEnd);
+                Reader.Groups[++Reader.Depth] = Reader.Current;
+            }
+            continue;
+        }
+        if (Closing)
+        {
+            continue;
+        }
+
+        if (NameLength == 3 && strncmp(pName, "svg", 3) == 0)
+        {
+            if (!SeenRoot) // Nested <svg> elements keep the outer one's units
+            {
+                ReadRoot(&Reader, pTag, pEnd);
+                SeenRoot = 1;
+            }
+        }
+        else if (NameLength == 4 && strncmp(pName, "path", 4) == 0)
+        {
+            const char *pData = FindAttribute(pTag, pEnd, "d");
+            if (pData != NULL)
+            {
+                BeginElement(&Reader, pTag, pEnd);
+                ReadPath(&Reader, pData);
+            }
+        }
+        else if ((NameLength == 8 && strncmp(pName, "polyline", 8) == 0) || (NameLength == 7 && strncmp(pName, "polygon", 7) == 0))
+        {
+            const char *pPoints = FindAttribute(pTag, pEnd, "points");
+            if (pPoints != NULL)
+            {
+                BeginElement(&Reader, pTag, pEnd);
+                ReadPoints(&Reader, pPoints, NameLength == 7);
+            }
+        }
+        else if (NameLength == 4 && strncmp(pName, "rect", 4) == 0)
+        {
+            BeginElement(&Reader, pTag, pEnd);
+            ReadRect(&Reader, pTag, pEnd);
+        }
+        else if (NameLength == 4 && strncmp(pName, "line", 4) == 0)
+        {
+            BeginElement(&Reader, pTag, pEnd);
+            ReadLine(&Reader, pTag, pEnd);
+        }
+    }
+
+    if (Reader.Failed)
+    {
+        printf("The drawing has more than %d points or ran out of memory\n", MaxDrawingStrokes);
+        FreeDrawing(pDrawing);
+        return -1;
+    }
+    if (pDrawing->StrokeCount > 0 && pDrawing->pStrokes[pDrawing->StrokeCount - 1].Pen == 0)
+    {
+        pDrawing->StrokeCount--; // A trailing move draws nothing
+    }
+    if (pDrawing->StrokeCount == 0)
+    {
+        printf("The drawing has no lines, paths or shapes to plot\n");
+        FreeDrawing(pDrawing);
+        return -1;
+    }
+
+    pDrawing->MinX = pDrawing->MaxX = pDrawing->pStrokes[0].X;
+    pDrawing->MinY = pDrawing->MaxY = pDrawing->pStrokes[0].Y;
+    for (int i = 1; i < pDrawing->StrokeCount; i++)
+    {
+        const Strokes *pStroke = &pDrawing->pStrokes[i];
+        pDrawing->MinX = pStroke->X < pDrawing->MinX ? pStroke->X : pDrawing->MinX;
+        pDrawing->MaxX = pStroke->X > pDrawing->MaxX ? pStroke->X : pDrawing->MaxX;
+        pDrawing->MinY = pStroke->Y < pDrawing->MinY ? pStroke->Y : pDrawing->MinY;
+        pDrawing->MaxY = pStroke->Y > pDrawing->MaxY ? pStroke->Y : pDrawing->MaxY;
+    }
+    return 0;
+}
+
+static const char *TagEnd(const char *pTag) // The closing '>', or the terminator if there is none
+{
+    char Quote = 0;
+    for (; *pTag != 0; pTag++)
+    {
+        if (Quote != 0)
+        {
+            Quote = (*pTag == Quote) ? 0 : Quote;
+        }
+        else if (*pTag == '"' || *pTag == '\'')
+        {
+            Quote = *pTag;
+        }
+        else if (*pTag == '>')
+        {
+            break;
+        }
+    }
+    return pTag;
+}
+
+// Start of the attribute's value, which runs up to its closing quote, or NULL when the tag has no such attribute
+static const char *FindAttribute(const char *pTag, const char *pEnd, const char *Name)
+{
+    size_t NameLength = strlen(Name);
+    const char *pText = pTag;
+
+    while (pText < pEnd && !isspace((unsigned char)*pText)) // Past the element name
+    {
+        pText++;
+    }
+    while (pText < pEnd)
+    {
+        while (pText < pEnd && (isspace((unsigned char)*pText) || *pText == '/'))
+        {
+            pText++;
+        }
+        const char *pName = pText;
+        while (pText < pEnd && *pText != '=' && !isspace((unsigned char)*pText))
+        {
+            pText++;
+        }
+        size_t Length = (size_t)(pText - pName);
+        while (pText < pEnd && isspace((unsigned char)*pText))
+        {
+            pText++;
+        }
+        if (pText >= pEnd || *pText != '=')
+        {
+            continue; // An attribute without a value
+        }
+        pText++;
+        while (pText < pEnd && isspace((unsigned char)*pText))
+        {
+            pText++;
+        }
+        if (pText >= pEnd || (*pText != '"' && *pText != '\''))
+        {
+            return NULL;
+        }
+        const char *pValue = pText + 1;
+        const char *pClose = memchr(pValue, *pText, (size_t)(pEnd - pValue));
+        if (pClose == NULL)
+        {
+            return NULL;
+        }
+        if (Length == NameLength && strncmp(pName, Name, NameLength) == 0)
+        {
+            return pValue;
+        }
+        pText = pClose + 1;
+    }
+    return NULL;
+}
+
+static float ReadLength(const char *pValue, float Default) // In millimetres
+{
+    static const struct
+    {
+        const char *Unit;
+        float Millimetres;
+    } Units[] = {{"mm", 1.0f}, {"cm", 10.0f}, {"in", 25.4f}, {"pt", 25.4f / 72.0f}, {"pc", 25.4f / 6.0f}, {"px", 25.4f / 96.0f}};
+
+    const char *pText = pValue;
+    float Length;
+    if (pValue == NULL || !ReadNumber(&pText, &Length) || !(Length > 0.0f))
+    {
+        return Default;
+    }
+    for (size_t i = 0; i < sizeof(Units) / sizeof(Units[0]); i++)
+    {
+        if (strncmp(pText, Units[i].Unit, 2) == 0)
+        {
+            return Length * Units[i].Millimetres;
+        }
+    }
+    return *pText == '%' ? Default : Length * DefaultUnitSize; // Plain numbers are pixels
+}
+
+static void ReadRoot(DrawingReader *pReader, const char *pTag, const char *pEnd)
+{
+    float Width = ReadLength(FindAttribute(pTag, pEnd, "width"), 0.0f);
+    const char *pViewBox = FindAttribute(pTag, pEnd, "viewBox");
+    float Box[4];
+
+    // Without a viewBox, or a width to stretch it to, the user unit stays a pixel
+    if (Width > 0.0f && pViewBox != NULL && ReadNumber(&pViewBox, &Box[0]) && ReadNumber(&pViewBox, &Box[1]) &&
+        ReadNumber(&pViewBox, &Box[2]) && ReadNumber(&pViewBox, &Box[3]) && Box[2] > 0.0f)
+    {
+        pReader->pDrawing->UnitSize = Width / Box[2];
+    }
+}
+
+// Sets the transform and flattening tolerance for the element's own points
+static void BeginElement(DrawingReader *pReader, const char *pTag, const char *pEnd)
+{
+    Transform Own = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+    const char *pValue = FindAttribute(pTag, pEnd, "transform");
+    if (pValue != NULL)
+    {
+        ReadTransform(pValue, &Own);
+    }
+    Combine(&Own, &pReader->Groups[pReader->Depth], &pReader->Current);
+
+    float Stretch = sqrtf(fabsf(pReader->Current.A * pReader->Current.D - pReader->Current.B * pReader->Current.C));
+    pReader->Tolerance = DrawingTolerance / pReader->pDrawing->UnitSize / (Stretch > 1e-6f ? Stretch : 1e-6f);
+}
+
+static void ReadTransform(const char *pValue, Transform *pTransform)
+{
+    const char *pText = pValue;
+
+    while (1)
+    {
+        pText = SkipSeparators(pText);
+        const char *pName = pText;
+        while (isalpha((unsigned char)*pText))
+        {
+            pText++;
+        }
+        size_t NameLength = (size_t)(pText - pName);
+        while (isspace((unsigned char)*pText))
+        {
+            pText++;
+        }
+        if (NameLength == 0 || *pText != '(')
+        {
+            return;
+        }
+        pText++;
+
+        float Arguments[6] = {0};
+        int Count = 0;
+        while (Count < 6 && ReadNumber(&pText, &Arguments[Count]))
+        {
+            Count++;
+        }
+        pText = SkipSeparators(pText);
+        if (*pText != ')')
+        {
+            return;
+        }
+        pText++;
+
+        Transform Step = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+        if (NameLength == 6 && strncmp(pName, "matrix", 6) == 0 && Count == 6)
+        {
+            Step = (Transform){Arguments[0], Arguments[1], Arguments[2], Arguments[3], Arguments[4], Arguments[5]};
+        }
+        else if (NameLength == 9 && strncmp(pName, "translate", 9) == 0 && Count >= 1)
+        {
+            Step.E = Arguments[0];
+            Step.F = Arguments[1];
+        }
+        else if (NameLength == 5 && strncmp(pName, "scale", 5) == 0 && Count >= 1)
+        {
+            Step.A = Arguments[0];
+            Step.D = Count > 1 ? Arguments[1] : Arguments[0];
+        }
+        else if (NameLength == 6 && strncmp(pName, "rotate", 6) == 0 && Count >= 1)
+        {
+            float Angle = Arguments[0] * Pi / 180.0f;
+            float Cos = cosf(Angle), Sin = sinf(Angle);
+            float CentreX = Arguments[1], CentreY = Arguments[2]; // Zero unless a centre was given
+            Step = (Transform){Cos, Sin, -Sin, Cos, CentreX - Cos * CentreX + Sin * CentreY, CentreY - Sin * CentreX - Cos * CentreY};
+        }
+        else if (NameLength == 5 && strncmp(pName, "skewX", 5) == 0 && Count >= 1)
+        {
+            Step.C = tanf(Arguments[0] * Pi / 180.0f);
+        }
+        else if (NameLength == 5 && strncmp(pName, "skewY", 5) == 0 && Count >= 1)
+        {
+            Step.B = tanf(Arguments[0] * Pi / 180.0f);
+        }
+
+        // The list is applied right to left, so each new step goes nearest the points
+        Transform Result;
+        Combine(&Step, pTransform, &Result);
+        *pTransform = Result;
+    }
+}
+
+static void Combine(const Transform *pFirst, const Transform *pThen, Transform *pResult) // pThen applied after pFirst
+{
+    Transform Result;
+    Result.A = pThen->A * pFirst->A + pThen->C * pFirst->B;
+    Result.B = pThen->B * pFirst->A + pThen->D * pFirst->B;
+    Result.C = pThen->A * pFirst->C + pThen->C * pFirst->D;
+    Result.D = pThen->B * pFirst->C + pThen->D * pFirst->D;
+    Result.E = pThen->A * pFirst->E + pThen->C * pFirst->F + pThen->E;
+    Result.F = pThen->B * pFirst->E + pThen->D * pFirst->F + pThen->F;
+    *pResult = Result;
+}
+
+static void ReadPath(DrawingReader *pReader, const char *pData)
+{
+    static const char Commands[] = "MLHVCSQTAZ";
+    static const int ArgumentCounts[] = {2, 2, 1, 1, 6, 4, 4, 2, 7, 0};
+
+    PathState State = {0};
+    const char *pText = pData;
+    char Command = 0;
+
+    while (!pReader->Failed)
+    {
+        pText = SkipSeparators(pText);
+        if (*pText == '"' || *pText == '\'' || *pText == 0)
+        {
+            return;
+        }
+
+        if (isalpha((unsigned char)*pText))
+        {
+            Command = *pText++;
+        }
+        else if (Command == 0 || toupper((unsigned char)Command) == 'Z')
+        {
+            break; // Numbers with no command to go with them
+        }
+        char Upper = (char)toupper((unsigned char)Command);
+        const char *pKnown = strchr(Commands, Upper);
+        if (pKnown == NULL)
+        {
+            break;
+        }
+        int Relative = Command != Upper;
+
+        float Arguments[7];
+        int Flags[2] = {0, 0};
+        int Count = ArgumentCounts[pKnown - Commands];
+        int Read = 1;
+        for (int i = 0; i < Count && Read; i++)
+        {
+            Read = (Upper == 'A' && (i == 3 || i == 4)) ? ReadFlag(&pText, &Flags[i - 3]) : ReadNumber(&pText, &Arguments[i]);
+        }
+        if (!Read)
+        {
+            break;
+        }
+
+        // Relative coordinates are made absolute before anything else sees them
+        float BaseX = Relative ? State.X : 0.0f, BaseY = Relative ? State.Y : 0.0f;
+        if (Upper == 'H')
+        {
+            Arguments[0] += BaseX;
+        }
+        else if (Upper == 'V')
+        {
+            Arguments[0] += BaseY;
+        }
+        else if (Upper == 'A')
+        {
+            Arguments[5] += BaseX;
+            Arguments[6] += BaseY;
+        }
+        else
+        {
+            for (int i = 0; i + 1 < Count; i += 2)
+            {
+                Arguments[i] += BaseX;
+                Arguments[i + 1] += BaseY;
+            }
+        }
+
+        float Curve[8] = {State.X, State.Y};
+        switch (Upper)
+        {
+        case 'M':
+            MoveTo(pReader, Arguments[0], Arguments[1]);
+            State.StartX = Arguments[0];
+            State.StartY = Arguments[1];
+            Command = Relative ? 'l' : 'L'; // Further pairs after a move are lines
+            break;
+        case 'L':
+        case 'H':
+        case 'V':
+            if (Upper == 'H')
+            {
+                Arguments[1] = State.Y;
+            }
+            else if (Upper == 'V')
+            {
+                Arguments[1] = Arguments[0];
+                Arguments[0] = State.X;
+            }
+            LineTo(pReader, Arguments[0], Arguments[1]);
+            break;
+        case 'C':
+        case 'S':
+        case 'Q':
+        case 'T':
+            if (Upper == 'S' || Upper == 'T') // The first control point mirrors the last one, if the previous command had one of the same kind
+            {
+                int Follows = (Upper == 'S') ? (State.Previous == 'C' || State.Previous == 'S') : (State.Previous == 'Q' || State.Previous == 'T');
+                float MirrorX = Follows ? 2.0f * State.X - State.ControlX : State.X;
+                float MirrorY = Follows ? 2.0f * State.Y - State.ControlY : State.Y;
+                memmove(&Arguments[2], &Arguments[0], (size_t)Count * sizeof(float));
+                Arguments[0] = MirrorX;
+                Arguments[1] = MirrorY;
+            }
+            if (Upper == 'C' || Upper == 'S')
+            {
+                memcpy(&Curve[2], Arguments, 6 * sizeof(float));
+                State.ControlX = Arguments[2];
+                State.ControlY = Arguments[3];
+            }
+            else // A quadratic is the cubic with its control points two thirds of the way to the single one
+            {
+                Curve[2] = State.X + 2.0f / 3.0f * (Arguments[0] - State.X);
+                Curve[3] = State.Y + 2.0f / 3.0f * (Arguments[1] - State.Y);
+                Curve[4] = Arguments[2] + 2.0f / 3.0f * (Arguments[0] - Arguments[2]);
+                Curve[5] = Arguments[3] + 2.0f / 3.0f * (Arguments[1] - Arguments[3]);
+                Curve[6] = Arguments[2];
+                Curve[7] = Arguments[3];
+                State.ControlX = Arguments[0];
+                State.ControlY = Arguments[1];
+            }
+            FlattenCubic(pReader, Curve, 0);
+            Arguments[0] = Curve[6];
+            Arguments[1] = Curve[7];
+            break;
+        case 'A':
+            FlattenArc(pReader, &State, Arguments, Flags[0], Flags[1]);
+            Arguments[0] = Arguments[5];
+            Arguments[1] = Arguments[6];
+            break;
+        case 'Z':
+            LineTo(pReader, State.StartX, State.StartY);
+            Arguments[0] = State.StartX;
+            Arguments[1] = State.StartY;
+            break;
+        }
+
+        State.X = Arguments[0];
+        State.Y = Arguments[1];
+        State.Previous = Upper;
+    }
+
+    if (!pReader->Failed && !pReader->Malformed)
+    {
+        printf("Malformed path data in the drawing, drawn up to the error\n");
+        pReader->Malformed = 1;
+    }
+}
+
+static void ReadPoints(DrawingReader *pReader, const char *pPoints, int Closed)
+{
+    float X, Y, FirstX = 0.0f, FirstY = 0.0f;
+    int Count = 0;
+
+    while (ReadNumber(&pPoints, &X) && ReadNumber(&pPoints, &Y))
+    {
+        if (Count++ == 0)
+        {
+            MoveTo(pReader, X, Y);
+            FirstX = X;
+            FirstY = Y;
+        }
+        else
+        {
+            LineTo(pReader, X, Y);
+        }
+    }
+    if (Closed && Count > 1)
+    {
+        LineTo(pReader, FirstX, FirstY);
+    }
+}
+
+static void ReadRect(DrawingReader *pReader, const char *pTag, const char *pEnd)
+{
+    static const char *const Names[] = {"x", "y", "width", "height"};
+    float Values[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    for (int i = 0; i < 4; i++)
+    {
+        const char *pValue = FindAttribute(pTag, pEnd, Names[i]);
+        if (pValue != NULL)
+        {
+            ReadNumber(&pValue, &Values[i]);
+        }
+    }
+    if (!(Values[2] > 0.0f) || !(Values[3] > 0.0f))
+    {
+        return; // Not drawn, as in a browser
+    }
+
+    MoveTo(pReader, Values[0], Values[1]);
+    LineTo(pReader, Values[0] + Values[2], Values[1]);
+    LineTo(pReader, Values[0] + Values[2], Values[1] + Values[3]);
+    LineTo(pReader, Values[0], Values[1] + Values[3]);
+    LineTo(pReader, Values[0], Values[1]);
+}
+
+static void ReadLine(DrawingReader *pReader, const char *pTag, const char *pEnd)
+{
+    static const char *const Names[] = {"x1", "y1", "x2", "y2"};
+    float Values[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    for (int i = 0; i < 4; i++)
+    {
+        const char *pValue = FindAttribute(pTag, pEnd, Names[i]);
+        if (pValue != NULL)
+        {
+            ReadNumber(&pValue, &Values[i]);
+        }
+    }
+    MoveTo(pReader, Values[0], Values[1]);
+    LineTo(pReader, Values[2], Values[3]);
+}
+
+static const char *SkipSeparators(const char *pText)
+{
+    while (isspace((unsigned char)*pText) || *pText == ',')
+    {
+        pText++;
+    }
+    return pText;
+}
+
+static int ReadNumber(const char **ppText, float *pValue)
+{
+    const char *pText = SkipSeparators(*ppText);
+    if (!isdigit((unsigned char)*pText) && *pText != '-' && *pText != '+' && *pText != '.') // Keeps strtof from reading "inf", "nan" or hex
+    {
+        return 0;
+    }
+
+    char *pAfter;
+    float Value = strtof(pText, &pAfter);
+    if (pAfter == pText || !isfinite(Value))
+    {
+        return 0;
+    }
+    *pValue = Value;
+    *ppText = pAfter;
+    return 1;
+}
+
+static int ReadFlag(const char **ppText, int *pFlag) // Arc flags are one digit and may run straight into what follows
+{
+    const char *pText = SkipSeparators(*ppText);
+    if (*pText != '0' && *pText != '1')
+    {
+        return 0;
+    }
+    *pFlag = *pText == '1';
+    *ppText = pText + 1;
+    return 1;
+}
+
+static void MoveTo(DrawingReader *pReader, float X, float Y)
+{
+    Drawing *pDrawing = pReader->pDrawing;
+    if (pDrawing->StrokeCount > 0 && pDrawing->pStrokes[pDrawing->StrokeCount - 1].Pen == 0)
+    {
+        pDrawing->StrokeCount--; // Only the last of several moves in a row needs to be made
+    }
+    AddPoint(pReader, X, Y, 0);
+}
+
+static void LineTo(DrawingReader *pReader, float X, float Y)
+{
+    AddPoint(pReader, X, Y, 1);
+}
+
+static void AddPoint(DrawingReader *pReader, float X, float Y, int Pen)
+{
+    Drawing *pDrawing = pReader->pDrawing;
+    if (pReader->Failed)
+    {
+        return;
+    }
+
+    if (pDrawing->StrokeCount == pDrawing->Capacity)
+    {
+        int Capacity = pDrawing->Capacity ? pDrawing->Capacity * 2 : 1024;
+        if (Capacity > MaxDrawingStrokes)
+        {
+            Capacity = MaxDrawingStrokes;
+        }
+        Strokes *pGrown = Capacity > pDrawing->Capacity ? ArenaGrow(&pDrawing->Memory, pDrawing->pStrokes, (size_t)pDrawing->Capacity * sizeof(Strokes),
+                                                                    (size_t)Capacity * sizeof(Strokes))
+                                                        : NULL;
+        if (pGrown == NULL)
+        {
+            pReader->Failed = 1;
+            return;
+        }
+        pDrawing->pStrokes = pGrown;
+        pDrawing->Capacity = Capacity;
+    }
+
+    const Transform *pTransform = &pReader->Current;
+    Strokes *pStroke = &pDrawing->pStrokes[pDrawing->StrokeCount++];
+    pStroke->X = ToStrokeUnits(pTransform->A * X + pTransform->C * Y + pTransform->E, pDrawing->UnitSize);
+    pStroke->Y = ToStrokeUnits(-(pTransform->B * X + pTransform->D * Y + pTransform->F), pDrawing->UnitSize); // SVG measures Y down the page, the font and robot up
+    pStroke->Pen = Pen;
+}
+
+static int32_t ToStrokeUnits(float Value, float UnitSize) // User units to whole fixed units, once, as the point is read
+{
+    double Units = (double)Value * UnitSize * FixedPerMm;
+    return (int32_t)lround(fmin(fmax(Units, -(double)MaxStrokeReach), (double)MaxStrokeReach)); // fmax also turns NaN into the limit
+}
+
+// Halves the curve until each piece lies within the tolerance of its chord, so gentle curves take few lines
+// and tight ones as many as they need
+static void FlattenCubic(DrawingReader *pReader, const float *pPoints, int Depth)
+{
+    float DeltaX = pPoints[6] - pPoints[0], DeltaY = pPoints[7] - pPoints[1];
+    float Chord = DeltaX * DeltaX + DeltaY * DeltaY;
+    float Tolerance = pReader->Tolerance;
+    int Flat;
+
+    if (Chord > Tolerance * Tolerance)
+    {
+        // Distances of the control points from the chord, each times the chord's length
+        float Distance1 = fabsf((pPoints[2] - pPoints[6]) * DeltaY - (pPoints[3] - pPoints[7]) * DeltaX);
+        float Distance2 = fabsf((pPoints[4] - pPoints[6]) * DeltaY - (pPoints[5] - pPoints[7]) * DeltaX);
+        Flat = (Distance1 + Distance2) * (Distance1 + Distance2) <= Tolerance * Tolerance * Chord;
+    }
+    else // Ends close together, as in a loop, so the control points are measured from the start instead
+    {
+        Flat = hypotf(pPoints[2] - pPoints[0], pPoints[3] - pPoints[1]) + hypotf(pPoints[4] - pPoints[0], pPoints[5] - pPoints[1]) <= Tolerance;
+    }
+
+    if (Flat || Depth >= MaxCurveDepth || pReader->Failed)
+    {
+        LineTo(pReader, pPoints[6], pPoints[7]);
+        return;
+    }
+
+    // de Casteljau split at the middle
+    float Left[8], Right[8];
+    float MidX = (pPoints[2] + pPoints[4]) / 2.0f, MidY = (pPoints[3] + pPoints[5]) / 2.0f;
+    Left[0] = pPoints[0];
+    Left[1] = pPoints[1];
+    Left[2] = (pPoints[0] + pPoints[2]) / 2.0f;
+    Left[3] = (pPoints[1] + pPoints[3]) / 2.0f;
+    Right[4] = (pPoints[4] + pPoints[6]) / 2.0f;
+    Right[5] = (pPoints[5] + pPoints[7]) / 2.0f;
+    Right[6] = pPoints[6];
+    Right[7] = pPoints[7];
+    Left[4] = (Left[2] + MidX) / 2.0f;
+    Left[5] = (Left[3] + MidY) / 2.0f;
+    Right[2] = (MidX + Right[4]) / 2.0f;
+    Right[3] = (MidY + Right[5]) / 2.0f;
+    Left[6] = Right[0] = (Left[4] + Right[2]) / 2.0f;
+    Left[7] = Right[1] = (Left[5] + Right[3]) / 2.0f;
+
+    FlattenCubic(pReader, Left, Depth + 1);
+    FlattenCubic(pReader, Right, Depth + 1);
+}
+
+// Endpoint arc to centre form, as in appendix F.6 of the SVG specification, then drawn in equal steps
+static void FlattenArc(DrawingReader *pReader, PathState *pState, const float *pArguments, int LargeArc, int Sweep)
+{
+    float RadiusX = fabsf(pArguments[0]), RadiusY = fabsf(pArguments[1]);
+    float EndX = pArguments[5], EndY = pArguments[6];
+
+    if (EndX == pState->X && EndY == pState->Y)
+    {
+        return;
+    }
+    if (RadiusX == 0.0f || RadiusY == 0.0f)
+    {
+        LineTo(pReader, EndX, EndY);
+        return;
+    }
+
+    float Rotation = pArguments[2] * Pi / 180.0f;
+    float Cos = cosf(Rotation), Sin = sinf(Rotation);
+    float HalfX = (pState->X - EndX) / 2.0f, HalfY = (pState->Y - EndY) / 2.0f;
+    float PrimeX = Cos * HalfX + Sin * HalfY, PrimeY = -Sin * HalfX + Cos * HalfY;
+
+    float Reach = PrimeX * PrimeX / (RadiusX * RadiusX) + PrimeY * PrimeY / (RadiusY * RadiusY);
+    if (Reach > 1.0f) // Radii too small to join the ends are scaled up until they just do
+    {
+        RadiusX *= sqrtf(Reach);
+        RadiusY *= sqrtf(Reach);
+    }
+
+    float SquareX = RadiusX * RadiusX, SquareY = RadiusY * RadiusY;
+    float Denominator = SquareX * PrimeY * PrimeY + SquareY * PrimeX * PrimeX;
+    float Factor = Denominator > 0.0f ? sqrtf(fmaxf(0.0f, (SquareX * SquareY - Denominator) / Denominator)) : 0.0f;
+    if (LargeArc == Sweep)
+    {
+        Factor = -Factor;
+    }
+    float CentrePrimeX = Factor * RadiusX * PrimeY / RadiusY, CentrePrimeY = -Factor * RadiusY * PrimeX / RadiusX;
+    float CentreX = Cos * CentrePrimeX - Sin * CentrePrimeY + (pState->X + EndX) / 2.0f;
+    float CentreY = Sin * CentrePrimeX + Cos * CentrePrimeY + (pState->Y + EndY) / 2.0f;
+
+    float Start = atan2f((PrimeY - CentrePrimeY) / RadiusY, (PrimeX - CentrePrimeX) / RadiusX);
+    float Span = atan2f((-PrimeY - CentrePrimeY) / RadiusY, (-PrimeX - CentrePrimeX) / RadiusX) - Start;
+    if (!Sweep && Span > 0.0f)
+    {
+        Span -= 2.0f * Pi;
+    }
+    else if (Sweep && Span < 0.0f)
+    {
+        Span += 2.0f * Pi;
+    }
+
+    float Radius = fmaxf(RadiusX, RadiusY);
+    int Steps = 1;
+    if (Radius > pReader->Tolerance)
+    {
+        Steps = (int)ceilf(fabsf(Span) / (2.0f * acosf(1.0f - pReader->Tolerance / Radius)));
+        Steps = Steps < 1 ? 1 : (Steps > MaxArcSteps ? MaxArcSteps : Steps);
+    }
+
+    for (int Step = 1; Step < Steps; Step++)
+    {
+        float Angle = Start + Span * (float)Step / (float)Steps;
+        float X = RadiusX * cosf(Angle), Y = RadiusY * sinf(Angle);
+        LineTo(pReader, CentreX + Cos * X - Sin * Y, CentreY + Sin * X + Cos * Y);
+    }
+    LineTo(pReader, EndX, EndY); // Exactly on the end, whatever the rounding
+}
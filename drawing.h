@@ -0,0 +1,39 @@
+#ifndef DRAWING_H_INCLUDED
+#define DRAWING_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "font.h"
+#include "layout.h"
+
+// GLOBAL CONSTANTS
+
+#define DrawingExtension ".svg"        // Input files ending in this are plotted as drawings rather than text
+#define MaxDrawingBytes (16L * 1024 * 1024)
+#define MaxDrawingStrokes 1000000
+#define DrawingTolerance 0.05f         // Furthest a flattened curve may stray from the true one (mm)
+#define DefaultUnitSize (25.4f / 96.0f) // Millimetres in one SVG user unit when the file does not say
+
+// STRUCTS
+
+typedef struct // Struct to hold a vector drawing, stroked like one large glyph
+{
+    Strokes *pStrokes; // In fixed units at the drawing's own size, with Y turned to point up as in the font
+    int StrokeCount;
+    int Capacity;
+    int32_t MinX, MinY, MaxX, MaxY; // Bounds of every point
+    float UnitSize;                 // Millimetres per user unit, from the root element's width and viewBox
+    Arena Memory;                 // The strokes and the file's text, given back by FreeDrawing
+} Drawing;
+
+// FUNCTION DECLARATIONS
+
+int IsDrawingFile(const char *FileName);
+int LoadDrawing(Drawing *pDrawing, const char *FileName);
+int ReadDrawing(Drawing *pDrawing, const char *Text, size_t Length);
+float FitDrawing(const Drawing *pDrawing, const PageSettings *pSettings); // Fraction of its own size that fits the page, at most 1
+void FreeDrawing(Drawing *pDrawing);
+
+#endif // DRAWING_H_INCLUDED
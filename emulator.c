@@ -0,0 +1,155 @@
+#define _XOPEN_SOURCE 600 // posix_openpt and friends
+#define _DEFAULT_SOURCE   // cfmakeraw
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "emulator.h"
+
+// GLOBAL CONSTANTS
+
+#define Banner "\r\nGrbl 1.1h ['$' for help]\r\n"
+#define ParserState "[GC:G0 G54 G17 G21 G90 G94 M5 M9 T0 F0 S0]\r\n"
+
+// FUNCTION DECLARATIONS
+
+static void *EmulatorThread(void *pArgument);
+static int Reply(Emulator *pEmulator, const char *Text);
+
+// FUNCTIONS
+
+int OpenEmulator(Emulator *pEmulator)
+{
+    memset(pEmulator, 0, sizeof(Emulator));
+    pEmulator->SlaveFd = -1;
+
+    pEmulator->MasterFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pEmulator->MasterFd < 0 || grantpt(pEmulator->MasterFd) != 0 || unlockpt(pEmulator->MasterFd) != 0)
+    {
+        perror("Could not create a pseudo terminal");
+        return -1;
+    }
+
+    strncpy(pEmulator->SlaveName, ptsname(pEmulator->MasterFd), sizeof(pEmulator->SlaveName) - 1);
+
+    pEmulator->SlaveFd = open(pEmulator->SlaveName, O_RDWR | O_NOCTTY);
+    if (pEmulator->SlaveFd < 0)
+    {
+        perror("Could not open the pseudo terminal");
+        close(pEmulator->MasterFd);
+        return -1;
+    }
+
+    struct termios Settings; // Raw mode so nothing is echoed or translated before the client sets the port up
+    tcgetattr(pEmulator->SlaveFd, &Settings);
+    cfmakeraw(&Settings);
+    tcsetattr(pEmulator->SlaveFd, TCSANOW, &Settings);
+
+    return 0;
+}
+
+int RunEmulator(Emulator *pEmulator)
+{
+    char Line[256];
+    int LineLength = 0;
+    unsigned char Buffer[4096];
+
+    while (!pEmulator->Stop)
+    {
+        struct pollfd Wait = {pEmulator->MasterFd, POLLIN, 0};
+        if (poll(&Wait, 1, 50) <= 0) // Wakes regularly to notice Stop
+        {
+            continue;
+        }
+
+        ssize_t n = read(pEmulator->MasterFd, Buffer, sizeof(Buffer));
+        if (n <= 0)
+        {
+            continue;
+        }
+
+        for (ssize_t i = 0; i < n; i++)
+        {
+            if (Buffer[i] == '\r')
+            {
+                continue;
+            }
+            if (Buffer[i] != '\n')
+            {
+                if (LineLength < (int)sizeof(Line) - 1)
+                {
+                    Line[LineLength++] = (char)Buffer[i];
+                }
+                continue;
+            }
+
+            Line[LineLength] = 0;
+            if (LineLength == 0) // A bare new line is how the robot writer wakes the controller
+            {
+                Reply(pEmulator, Banner);
+                continue;
+            }
+            LineLength = 0;
+            pEmulator->LinesReceived++;
+
+            if (pEmulator->ReplyDelayUs > 0)
+            {
+                usleep((useconds_t)pEmulator->ReplyDelayUs);
+            }
+
+            if (pEmulator->DropEvery > 0 && pEmulator->LinesReceived % pEmulator->DropEvery == 0)
+            {
+                continue;
+            }
+            if (strcmp(Line, "$G") == 0)
+            {
+                Reply(pEmulator, ParserState);
+                Reply(pEmulator, "ok\r\n");
+            }
+            else if (pEmulator->ErrorEvery > 0 && pEmulator->LinesReceived % pEmulator->ErrorEvery == 0)
+            {
+                Reply(pEmulator, "error:2\r\n");
+            }
+            else
+            {
+                Reply(pEmulator, "ok\r\n");
+            }
+        }
+    }
+
+    return 0;
+}
+
+int StartEmulator(Emulator *pEmulator)
+{
+    return pthread_create(&pEmulator->Thread, NULL, EmulatorThread, pEmulator) == 0 ? 0 : -1;
+}
+
+void StopEmulator(Emulator *pEmulator)
+{
+    pEmulator->Stop = 1;
+    pthread_join(pEmulator->Thread, NULL);
+}
+
+void CloseEmulator(Emulator *pEmulator)
+{
+    close(pEmulator->SlaveFd);
+    close(pEmulator->MasterFd);
+}
+
+static void *EmulatorThread(void *pArgument)
+{
+    RunEmulator((Emulator *)pArgument);
+    return NULL;
+}
+
+static int Reply(Emulator *pEmulator, const char *Text)
+{
+    size_t Length = strlen(Text);
+    return write(pEmulator->MasterFd, Text, Length) == (ssize_t)Length ? 0 : -1;
+}
@@ -0,0 +1,29 @@
+#ifndef EMULATOR_H_INCLUDED
+#define EMULATOR_H_INCLUDED
+
+#include <pthread.h>
+
+// STRUCTS
+
+typedef struct // Struct to hold a GRBL controller emulated on a pseudo terminal
+{
+    int MasterFd;
+    int SlaveFd;        // Held open so the terminal survives the client closing it
+    char SlaveName[64]; // Device the robot writer should open
+    int ReplyDelayUs;   // Simulated time for the controller to accept each line
+    int ErrorEvery;     // Rejects every Nth line with error:2, 0 to accept everything
+    int DropEvery;      // Swallows every Nth line without a reply, as if it were lost on the way, 0 for none
+    long LinesReceived;
+    volatile int Stop;
+    pthread_t Thread;
+} Emulator;
+
+// FUNCTION DECLARATIONS
+
+int OpenEmulator(Emulator *pEmulator);
+int RunEmulator(Emulator *pEmulator);
+int StartEmulator(Emulator *pEmulator);
+void StopEmulator(Emulator *pEmulator);
+void CloseEmulator(Emulator *pEmulator);
+
+#endif // EMULATOR_H_INCLUDED
@@ -0,0 +1,620 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "font.h"
+#include "profile.h"
+#include "transform.h"
+
+// GLOBAL VARIABLES
+
+float ScaleFactor = 0.0;
+
+// GLOBAL CONSTANTS
+
+#define NoInk -1.0e9f // Marks an empty band or a pair with no bands in common
+#define ExtraGlyphStartSize 64u // Slots in the glyph table above ASCII when the first such glyph is read
+#define KerningSuffix "Kerning.txt" // SingleStrokeFont.txt is tuned by SingleStrokeFontKerning.txt
+#define MaxStrokeCoordinate ((int32_t)(MaxFontCoordinate * StrokePerFontUnit)) // MaxFontCoordinate in stroke units
+
+// STRUCTS
+
+typedef struct // Struct to hold the horizontal extent of a glyph's ink in each band
+{
+    float Left[KerningBandCount];
+    float Right[KerningBandCount];
+    float Advance;
+} InkProfile;
+
+// FUNCTION DECLARATIONS
+
+static int ParseTextFont(Font *pFont, FILE *pSingleStrokeFont);
+static int ParseBinaryFont(Font *pFont, FILE *pFontFile);
+static Character *AddGlyph(Font *pFont, int CodePoint, int StrokeCount);
+static int CheckStroke(const Strokes *pStroke);
+static int ToStrokeUnits(float Value, int32_t *pUnits);
+static void MeasureInkProfile(const Character *pCharacter, InkProfile *pProfile);
+static float ClosestApproach(const InkProfile *pLeft, const InkProfile *pRight);
+static void ReadKerningOverrides(Font *pFont);
+static Character *ExtraGlyphSlot(const Font *pFont, unsigned int CodePoint);
+static int GrowExtraGlyphs(Font *pFont);
+
+// FUNCTIONS
+
+int LoadFont(Font *pFont, const char *FileName)
+{
+    FILE *pFontFile = fopen(FileName, "rb"); // Creates a file pointer to the font data file
+    if (pFontFile == NULL)                   // Checks if the file pointer is NULL
+    {
+        printf("Could not open %s\n", FileName);
+        return -1;
+    }
+
+    int Result = ReadFont(pFont, pFontFile);
+    snprintf(pFont->FileName, sizeof(pFont->FileName), "%s", FileName); // Also locates the kerning overrides
+    fclose(pFontFile);
+
+    if (Result != 0)
+    {
+        FreeFont(pFont);
+    }
+    return Result;
+}
+
+int ReadFont(Font *pFont, FILE *pFontFile)
+{
+    memset(pFont, 0, sizeof(Font));
+
+    pFont->pGlyphs = calloc(MaxAscii, sizeof(Character)); // Allocates memory for the font array
+    pFont->pKerning = calloc(MaxAscii, sizeof(*pFont->pKerning)); // All pairs start unkerned
+    if (pFont->pGlyphs == NULL || pFont->pKerning == NULL)   // Checks if memory allocation was successful
+    {
+        printf("Memory allocation failed for the font\n");
+        return -2;
+    }
+    pFont->Bytes = sizeof(Font) + MaxAscii * sizeof(Character) + MaxAscii * sizeof(*pFont->pKerning);
+
+    char Magic[sizeof(BinaryFontMagic)];
+    if (fread(Magic, 1, sizeof(Magic), pFontFile) == sizeof(Magic) && memcmp(Magic, BinaryFontMagic, sizeof(Magic)) == 0)
+    {
+        return ParseBinaryFont(pFont, pFontFile);
+    }
+
+    rewind(pFontFile); // Anything without the magic number is taken to be the text format
+    return ParseTextFont(pFont, pFontFile);
+}
+
+static int ParseTextFont(Font *pFont, FILE *pSingleStrokeFont)
+{
+    int Marker, ascii, StrokeCount;
+
+    while (fscanf(pSingleStrokeFont, "%d", &Marker) == 1) // Reads every number and makes it a marker
+    {
+        if (Marker != 999) // Checks for the end marker
+        {
+            continue;
+        }
+
+        if (fscanf(pSingleStrokeFont, "%d %d", &ascii, &StrokeCount) != 2 || StrokeCount < 0 || StrokeCount > MaxStrokeCount)
+        {
+            printf("Malformed glyph header in the font data\n");
+            return -3;
+        }
+
+        Character *pCharacter = AddGlyph(pFont, ascii, StrokeCount);
+        if (pCharacter == NULL)
+        {
+            return -2;
+        }
+
+        for (int i = 0; i < StrokeCount; i++) // Loops through each stroke
+        {
+            Strokes *pStroke = &pCharacter->pStrokes[i];
+            float X, Y;
+            if (fscanf(pSingleStrokeFont, "%f %f %d", &X, &Y, &pStroke->Pen) != 3) // Reads the stroke data
+            {
+                break;
+            }
+            if (ToStrokeUnits(X, &pStroke->X) != 0 || ToStrokeUnits(Y, &pStroke->Y) != 0)
+            {
+                printf("Stroke out of range in glyph %d\n", ascii);
+                break;
+            }
+            pCharacter->StrokeCount++;
+        }
+
+        if (pCharacter->ascii < 0) // Invalid code points are read and dropped so the rest of the file still lines up
+        {
+            free(pCharacter->pStrokes);
+            free(pCharacter);
+        }
+    }
+
+    return 0;
+}
+
+static int ParseBinaryFont(Font *pFont, FILE *pFontFile)
+{
+    // After the magic number: glyph count, then for each glyph its code point, stroke count and strokes exactly as
+    // Strokes lays them out in memory. Written by SaveBinaryFont on the same kind of machine that reads it.
+    int32_t GlyphCount;
+    if (fread(&GlyphCount, sizeof(GlyphCount), 1, pFontFile) != 1 || GlyphCount < 0)
+    {
+        printf("Malformed binary font header\n");
+        return -3;
+    }
+
+    for (int32_t Glyph = 0; Glyph < GlyphCount; Glyph++)
+    {
+        int32_t Header[2];
+        if (fread(Header, sizeof(Header), 1, pFontFile) != 1 || Header[1] < 0 || Header[1] > MaxStrokeCount)
+        {
+            printf("Malformed glyph header in the binary font\n");
+            return -3;
+        }
+
+        Character *pCharacter = AddGlyph(pFont, Header[0], Header[1]);
+        if (pCharacter == NULL)
+        {
+            return -2;
+        }
+
+        size_t Read = fread(pCharacter->pStrokes, sizeof(Strokes), (size_t)Header[1], pFontFile);
+        while (pCharacter->StrokeCount < (int)Read && CheckStroke(&pCharacter->pStrokes[pCharacter->StrokeCount]) == 0)
+        {
+            pCharacter->StrokeCount++;
+        }
+
+        if (pCharacter->ascii < 0) // Invalid code points are read and dropped, as in the text format
+        {
+            free(pCharacter->pStrokes);
+            free(pCharacter);
+        }
+        if (Read != (size_t)Header[1])
+        {
+            printf("Binary font ends part way through glyph %d\n", (int)Header[0]);
+            break; // Keeps what was read, as the text parser does
+        }
+    }
+
+    return 0;
+}
+
+int SaveBinaryFont(const Font *pFont, const char *FileName)
+{
+    FILE *pFontFile = fopen(FileName, "wb");
+    if (pFontFile == NULL)
+    {
+        printf("Could not create %s\n", FileName);
+        return -1;
+    }
+
+    int32_t GlyphCount = 0;
+    for (int ascii = 0; ascii < MaxAscii; ascii++)
+    {
+        GlyphCount += (pFont->pGlyphs[ascii].pStrokes != NULL);
+    }
+    GlyphCount += pFont->ExtraGlyphCount;
+
+    fwrite(BinaryFontMagic, 1, sizeof(BinaryFontMagic), pFontFile);
+    fwrite(&GlyphCount, sizeof(GlyphCount), 1, pFontFile);
+
+    unsigned int ExtraSlots = pFont->pExtraGlyphs ? pFont->ExtraGlyphMask + 1 : 0;
+    for (unsigned int i = 0; i < MaxAscii + ExtraSlots; i++)
+    {
+        const Character *pCharacter = (i < MaxAscii) ? &pFont->pGlyphs[i] : &pFont->pExtraGlyphs[i - MaxAscii];
+        if (pCharacter->pStrokes == NULL) // Never defined, or a free slot
+        {
+            continue;
+        }
+
+        int32_t Header[2] = {pCharacter->ascii, pCharacter->StrokeCount};
+        fwrite(Header, sizeof(Header), 1, pFontFile);
+        fwrite(pCharacter->pStrokes, sizeof(Strokes), (size_t)pCharacter->StrokeCount, pFontFile);
+    }
+
+    int Result = ferror(pFontFile) ? -2 : 0;
+    if (fclose(pFontFile) != 0 || Result != 0)
+    {
+        printf("Could not write %s\n", FileName);
+        return -2;
+    }
+    return 0;
+}
+
+static Character *AddGlyph(Font *pFont, int CodePoint, int StrokeCount)
+{
+    // ASCII goes in the dense array and everything above it in the hash table. Invalid code points get a scratch
+    // glyph, marked with a negative code point, that the caller reads into and frees.
+    Character *pCharacter;
+    if (CodePoint >= 0 && CodePoint < MaxAscii)
+    {
+        pCharacter = &pFont->pGlyphs[CodePoint];
+    }
+    else if (CodePoint >= MaxAscii && CodePoint <= MaxCodePoint)
+    {
+        if ((unsigned int)(pFont->ExtraGlyphCount + 1) * 2 > pFont->ExtraGlyphMask + 1 && GrowExtraGlyphs(pFont) != 0) // Kept at most half full
+        {
+            printf("Memory allocation failed for glyph %d\n", CodePoint);
+            return NULL;
+        }
+        pCharacter = ExtraGlyphSlot(pFont, (unsigned int)CodePoint);
+        pFont->ExtraGlyphCount += (pCharacter->ascii == 0);
+    }
+    else
+    {
+        pCharacter = calloc(1, sizeof(Character));
+        if (pCharacter == NULL)
+        {
+            return NULL;
+        }
+        CodePoint = -1;
+    }
+
+    if (pCharacter->pStrokes != NULL) // A repeated glyph replaces the earlier one
+    {
+        pFont->Bytes -= (size_t)pCharacter->StrokeCount * sizeof(Strokes);
+        free(pCharacter->pStrokes);
+    }
+    pCharacter->ascii = CodePoint;   // Assigns the code point to the character
+    pCharacter->StrokeCount = 0;     // Counts up as strokes are read
+    pCharacter->pStrokes = malloc((size_t)(StrokeCount > 0 ? StrokeCount : 1) * sizeof(Strokes)); // Allocates memory for the strokes
+    if (pCharacter->pStrokes == NULL)
+    {
+        printf("Memory allocation failed for glyph %d\n", CodePoint);
+        if (CodePoint < 0)
+        {
+            free(pCharacter);
+        }
+        return NULL;
+    }
+
+    pFont->Bytes += (size_t)StrokeCount * sizeof(Strokes);
+    return pCharacter;
+}
+
+static int CheckStroke(const Strokes *pStroke)
+{
+    return (pStroke->X >= -MaxStrokeCoordinate && pStroke->X <= MaxStrokeCoordinate && pStroke->Y >= -MaxStrokeCoordinate &&
+            pStroke->Y <= MaxStrokeCoordinate)
+               ? 0
+               : -1;
+}
+
+static int ToStrokeUnits(float Value, int32_t *pUnits) // Rounded to the nearest stroke unit, once, as the glyph is read
+{
+    if (!(fabsf(Value) <= MaxFontCoordinate)) // Also rejects NaN
+    {
+        return -1;
+    }
+    *pUnits = (int32_t)lroundf(Value * StrokePerFontUnit);
+    return 0;
+}
+
+int BuildKerning(Font *pFont)
+{
+    InkProfile *pProfiles = malloc(MaxAscii * sizeof(InkProfile)); // Per call, so fonts can be kerned on several threads
+    if (pProfiles == NULL)
+    {
+        printf("Memory allocation failed for kerning\n");
+        return -2;
+    }
+
+    for (int ascii = 0; ascii < MaxAscii; ascii++) // Measures the ink of every glyph once
+    {
+        MeasureInkProfile(&pFont->pGlyphs[ascii], &pProfiles[ascii]);
+    }
+
+    // Every pair is pulled in until its closest approach matches that of the reference pair. SingleStrokeFont.txt
+    // gives every glyph the same advance, so this also closes up narrow letters as well as fixing "To" or "AV".
+    // Pairs are never pushed apart.
+    float TargetGap = ClosestApproach(&pProfiles[KerningReference], &pProfiles[KerningReference]);
+    if (TargetGap == NoInk)
+    {
+        printf("No reference glyph for kerning, pairs left unkerned\n");
+        free(pProfiles);
+        return -1;
+    }
+
+    for (int LeftGlyph = 0; LeftGlyph < MaxAscii; LeftGlyph++)
+    {
+        for (int RightGlyph = 0; RightGlyph < MaxAscii; RightGlyph++)
+        {
+            float Gap = ClosestApproach(&pProfiles[LeftGlyph], &pProfiles[RightGlyph]);
+            if (Gap == NoInk || Gap <= TargetGap) // Pairs that share no bands or are already tight are left alone
+            {
+                continue;
+            }
+
+            float Adjustment = TargetGap - Gap;
+            ToStrokeUnits((Adjustment < -KerningMaxTighten) ? -KerningMaxTighten : Adjustment, &pFont->pKerning[LeftGlyph][RightGlyph]);
+        }
+    }
+
+    free(pProfiles);
+    ReadKerningOverrides(pFont);
+    return 0;
+}
+
+static void ReadKerningOverrides(Font *pFont)
+{
+    // Optional hand-tuned pairs override the measured ones. They sit beside the font with the extension replaced.
+    char FileName[MaxFontPath + sizeof(KerningSuffix)];
+    snprintf(FileName, sizeof(FileName), "%s", pFont->FileName);
+    char *pExtension = strrchr(FileName, '.');
+    char *pFolder = strrchr(FileName, '/');
+    if (FileName[0] == '\0')
+    {
+        return; // Read from a stream, so there is nowhere to look
+    }
+    if (pExtension != NULL && (pFolder == NULL || pExtension > pFolder))
+    {
+        *pExtension = '\0';
+    }
+    strcat(FileName, KerningSuffix);
+
+    FILE *pKerningFile = fopen(FileName, "r");
+    if (pKerningFile != NULL)
+    {
+        int LeftGlyph, RightGlyph;
+        float Adjustment;
+
+        while (fscanf(pKerningFile, "%d %d %f", &LeftGlyph, &RightGlyph, &Adjustment) == 3)
+        {
+            if (LeftGlyph >= 0 && LeftGlyph < MaxAscii && RightGlyph >= 0 && RightGlyph < MaxAscii)
+            {
+                ToStrokeUnits(Adjustment, &pFont->pKerning[LeftGlyph][RightGlyph]); // Left as it was if out of range
+            }
+        }
+        fclose(pKerningFile);
+    }
+}
+
+static void MeasureInkProfile(const Character *pCharacter, InkProfile *pProfile) // In font units
+{
+    pProfile->Advance = (pCharacter->StrokeCount > 0) ? (float)pCharacter->pStrokes[pCharacter->StrokeCount - 1].X / StrokePerFontUnit : 0.0f;
+
+    for (int Band = 0; Band < KerningBandCount; Band++)
+    {
+        pProfile->Left[Band] = -NoInk; // An empty band has its left edge beyond its right edge
+        pProfile->Right[Band] = NoInk;
+    }
+
+    for (int i = 1; i < pCharacter->StrokeCount; i++)
+    {
+        if (pCharacter->pStrokes[i].Pen != 1) // Only pen-down segments leave ink
+        {
+            continue;
+        }
+
+        Strokes Start = pCharacter->pStrokes[i - 1];
+        Strokes End = pCharacter->pStrokes[i];
+        int Steps = 8; // Samples each segment finely enough for the band height
+
+        for (int Step = 0; Step <= Steps; Step++)
+        {
+            float X = (Start.X + (float)(End.X - Start.X) * Step / Steps) / StrokePerFontUnit;
+            float Y = (Start.Y + (float)(End.Y - Start.Y) * Step / Steps) / StrokePerFontUnit;
+            int Band = (int)((Y - KerningMinY) / KerningBandHeight);
+
+            if (Band < 0 || Band >= KerningBandCount)
+            {
+                continue;
+            }
+            if (X < pProfile->Left[Band])
+            {
+                pProfile->Left[Band] = X;
+            }
+            if (X > pProfile->Right[Band])
+            {
+                pProfile->Right[Band] = X;
+            }
+
+        }
+    }
+}
+
+static float ClosestApproach(const InkProfile *pLeft, const InkProfile *pRight)
+{
+    float Gap = NoInk;
+
+    for (int Band = 0; Band < KerningBandCount; Band++)
+    {
+        if (pLeft->Right[Band] == NoInk)
+        {
+            continue;
+        }
+
+        for (int Near = Band - 1; Near <= Band + 1; Near++) // Neighbouring bands are compared too so diagonals cannot touch
+        {
+            if (Near < 0 || Near >= KerningBandCount || pRight->Left[Near] == -NoInk)
+            {
+                continue;
+            }
+
+            float BandGap = pLeft->Advance + pRight->Left[Near] - pLeft->Right[Band];
+            if (Gap == NoInk || BandGap < Gap)
+            {
+                Gap = BandGap;
+            }
+        }
+    }
+
+    return Gap;
+}
+
+// Adds up the same rounded advances GenerateGCode moves the cursor by, so the layout and the written line agree
+// to the last fixed unit
+Fixed CalculateWordWidth(const Font *pFont, const char *Word)
+{
+    PROFILE_START(Measure);
+    StrokeScale Scale = MakeStrokeScale((double)ScaleFactor * FixedPerMm / StrokePerFontUnit);
+    Fixed WordWidth = 0;
+
+    size_t Index = 0;
+    const Character *pCurrent = FindGlyph(pFont, DecodeUtf8(Word, &Index));
+
+    while (pCurrent != NULL) // Loops through each character in the word
+    {
+        const Character *pNext = FindGlyph(pFont, DecodeUtf8(Word, &Index));
+        if (pCurrent->StrokeCount > 0)
+        {
+            int32_t EndX, EndY; // Where the last stroke lands, placed just as the emitter places it
+            PlaceStrokes(&pCurrent->pStrokes[pCurrent->StrokeCount - 1], 1, &Scale, &EndX, &EndY);
+            WordWidth += EndX;
+        }
+        if (pNext != NULL)
+        {
+            WordWidth += PlaceCoordinate(PairKerning(pFont, pCurrent, pNext), &Scale); // Pulls the next character in for tight pairs
+        }
+        pCurrent = pNext;
+    }
+
+    PROFILE_STOP(StageMeasure, Measure);
+    return WordWidth;
+}
+
+unsigned int DecodeUtf8(const char *Text, size_t *pIndex)
+{
+    const unsigned char *pByte = (const unsigned char *)Text + *pIndex;
+
+    if (pByte[0] < 0x80) // ASCII, including the terminator, which is not stepped over
+    {
+        *pIndex += (pByte[0] != 0);
+        return pByte[0];
+    }
+
+    // Lead byte gives the length and the smallest code point that length may carry, which rules out overlong forms
+    int Length;
+    unsigned int CodePoint, Smallest;
+    if ((pByte[0] & 0xE0) == 0xC0)
+    {
+        Length = 2, CodePoint = pByte[0] & 0x1Fu, Smallest = 0x80;
+    }
+    else if ((pByte[0] & 0xF0) == 0xE0)
+    {
+        Length = 3, CodePoint = pByte[0] & 0x0Fu, Smallest = 0x800;
+    }
+    else if ((pByte[0] & 0xF8) == 0xF0)
+    {
+        Length = 4, CodePoint = pByte[0] & 0x07u, Smallest = 0x10000;
+    }
+    else
+    {
+        *pIndex += 1; // Stray continuation byte or one that never starts a sequence
+        return ReplacementCharacter;
+    }
+
+    for (int i = 1; i < Length; i++)
+    {
+        if ((pByte[i] & 0xC0) != 0x80) // Also stops at the terminator of a truncated sequence
+        {
+            *pIndex += (size_t)i;
+            return ReplacementCharacter;
+        }
+        CodePoint = (CodePoint << 6) | (pByte[i] & 0x3Fu);
+    }
+
+    *pIndex += (size_t)Length;
+    if (CodePoint < Smallest || CodePoint > MaxCodePoint || (CodePoint >= 0xD800 && CodePoint <= 0xDFFF))
+    {
+        return ReplacementCharacter;
+    }
+    return CodePoint;
+}
+
+const Character *FindGlyph(const Font *pFont, unsigned int CodePoint)
+{
+    if (CodePoint < MaxAscii) // Dense fast path for plain text
+    {
+        return (CodePoint == 0) ? NULL : &pFont->pGlyphs[CodePoint];
+    }
+
+    if (pFont->pExtraGlyphs != NULL)
+    {
+        const Character *pCharacter = ExtraGlyphSlot(pFont, CodePoint);
+        if (pCharacter->ascii != 0)
+        {
+            return pCharacter;
+        }
+    }
+    return &pFont->pGlyphs[MissingGlyph]; // Characters the font cannot draw are shown rather than silently dropped
+}
+
+int32_t PairKerning(const Font *pFont, const Character *pLeft, const Character *pRight)
+{
+    // The measured table only covers ASCII pairs; anything involving a glyph from the hash table is left unkerned
+    ptrdiff_t Left = pLeft - pFont->pGlyphs, Right = pRight - pFont->pGlyphs;
+    if (Left < 0 || Left >= MaxAscii || Right < 0 || Right >= MaxAscii)
+    {
+        return 0;
+    }
+    return pFont->pKerning[Left][Right];
+}
+
+static Character *ExtraGlyphSlot(const Font *pFont, unsigned int CodePoint) // Slot holding CodePoint, or the empty slot where it belongs
+{
+    // Fibonacci hashing: the top bits of the product depend on every bit of the code point, so runs spread out
+    unsigned int Slot = (uint32_t)(CodePoint * 2654435761u) >> pFont->ExtraGlyphShift;
+
+    while (pFont->pExtraGlyphs[Slot].ascii != 0 && (unsigned int)pFont->pExtraGlyphs[Slot].ascii != CodePoint)
+    {
+        Slot = (Slot + 1) & pFont->ExtraGlyphMask; // Linear probing keeps a lookup within one or two cache lines
+    }
+    return &pFont->pExtraGlyphs[Slot];
+}
+
+static int GrowExtraGlyphs(Font *pFont)
+{
+    Character *pOld = pFont->pExtraGlyphs;
+    unsigned int OldSize = pOld ? pFont->ExtraGlyphMask + 1 : 0;
+    unsigned int NewSize = pOld ? OldSize * 2 : ExtraGlyphStartSize;
+
+    pFont->pExtraGlyphs = calloc(NewSize, sizeof(Character)); // Code point 0 marks an empty slot, it never lives here
+    if (pFont->pExtraGlyphs == NULL)
+    {
+        pFont->pExtraGlyphs = pOld;
+        return -1;
+    }
+    pFont->ExtraGlyphMask = NewSize - 1;
+    pFont->ExtraGlyphShift = 32;
+    for (unsigned int Size = NewSize; Size > 1; Size >>= 1)
+    {
+        pFont->ExtraGlyphShift--;
+    }
+    pFont->Bytes += (size_t)(NewSize - OldSize) * sizeof(Character);
+
+    for (unsigned int i = 0; i < OldSize; i++)
+    {
+        if (pOld[i].ascii != 0)
+        {
+            *ExtraGlyphSlot(pFont, (unsigned int)pOld[i].ascii) = pOld[i];
+        }
+    }
+    free(pOld);
+    return 0;
+}
+
+void FreeFont(Font *pFont)
+{
+    for (int i = 0; pFont->pGlyphs != NULL && i < MaxAscii; i++)
+    {
+        free(pFont->pGlyphs[i].pStrokes);
+    }
+    for (unsigned int i = 0; pFont->pExtraGlyphs != NULL && i <= pFont->ExtraGlyphMask; i++)
+    {
+        free(pFont->pExtraGlyphs[i].pStrokes);
+    }
+    free(pFont->pGlyphs);
+    free(pFont->pExtraGlyphs);
+    free(pFont->pKerning);
+    memset(pFont, 0, sizeof(Font)); // Lets the font be loaded again
+}
+
+Fixed ToFixed(double Value) // Held inside MaxFixedReach so a stray cursor cannot overflow
+{
+    return (Fixed)llround(fmin(fmax(Value, -MaxFixedReach), MaxFixedReach)); // fmax also turns NaN into the limit
+}
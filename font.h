@@ -0,0 +1,81 @@
+#ifndef FONT_H_INCLUDED
+#define FONT_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// GLOBAL CONSTANTS
+
+#define DefaultFontFile "SingleStrokeFont.txt"
+#define MaxFontPath 260
+#define BinaryFontMagic "RWFONT2" // First bytes of a font saved by SaveBinaryFont, including the terminator
+
+#define MaxAscii 128              // Glyphs below this live in a dense array, the rest in a hash table
+#define MaxCodePoint 0x10FFFF
+#define ReplacementCharacter 0xFFFD // Decoded in place of malformed UTF-8
+#define MissingGlyph '?'            // Drawn for characters the font has no glyph for
+#define MaxStrokeCount 10000         // Largest glyph accepted from a font file
+#define MaxFontCoordinate 10000.0f   // Largest stroke coordinate accepted from a font file (font units)
+#define StrokeFractionBits 8         // Binary places kept below a font unit when a glyph is read
+#define StrokePerFontUnit (1 << StrokeFractionBits)
+#define MaxStrokeReach 1073741824    // Furthest any stroke, glyph or drawing, may lie from its origin (stroke units)
+
+#define KerningBandHeight 3.0f  // Height of the horizontal slices used to compare glyph outlines (font units)
+#define KerningMinY -36.0f      // Lowest Y used by any glyph in the font
+#define KerningBandCount 32     // Bands covering KerningMinY upwards
+#define KerningReference 'n'    // Pair whose natural gap every other pair is tightened towards
+#define KerningMaxTighten 9.0f  // Largest amount any pair may be pulled together (font units)
+
+#define FixedFractionBits 8 // Binary places kept below the hundredth of a millimetre written out
+#define FixedPerHundredth (1 << FixedFractionBits)
+#define FixedPerMm (100 * FixedPerHundredth)
+#define MaxFixedReach 1e15 // Furthest a position may be taken (fixed units), leaving headroom to add a stroke
+
+// STRUCTS
+
+typedef int64_t Fixed; // Position on the page in 1/FixedPerMm millimetres, from the layout cursor to the line written
+
+typedef struct // Struct to hold stroke data, turned into whole stroke units once when the glyph or drawing is read
+{
+    int32_t X, Y; // 1/StrokePerFontUnit font units in a glyph, fixed units at the drawing's own size in a drawing
+    int Pen;
+} Strokes;
+
+typedef struct // Struct to hold character data
+{
+    int ascii; // Unicode code point
+    int StrokeCount;
+    Strokes *pStrokes;
+} Character;
+
+typedef struct // Struct to hold a loaded font, read-only once loaded so any number of jobs can share it
+{
+    char FileName[MaxFontPath];
+    Character *pGlyphs;            // Dense array for ASCII
+    Character *pExtraGlyphs;       // Open-addressed table of the glyphs above ASCII, code point 0 marks a free slot
+    unsigned int ExtraGlyphMask;   // Table size minus one
+    unsigned int ExtraGlyphShift;  // 32 less the table size's bits, so the hash keeps its best mixed top bits
+    int ExtraGlyphCount;
+    int32_t (*pKerning)[MaxAscii]; // Advance adjustment for each (left, right) pair in stroke units
+    size_t Bytes;                  // Memory held by the font
+} Font;
+
+// GLOBAL VARIABLES
+
+extern float ScaleFactor; // Font units to millimetres
+
+// FUNCTION DECLARATIONS
+
+int LoadFont(Font *pFont, const char *FileName);
+int ReadFont(Font *pFont, FILE *pFontFile);
+int SaveBinaryFont(const Font *pFont, const char *FileName);
+int BuildKerning(Font *pFont);
+Fixed CalculateWordWidth(const Font *pFont, const char *Word); // Exactly how far GenerateGCode moves the cursor
+unsigned int DecodeUtf8(const char *Text, size_t *pIndex);
+const Character *FindGlyph(const Font *pFont, unsigned int CodePoint);
+int32_t PairKerning(const Font *pFont, const Character *pLeft, const Character *pRight);
+void FreeFont(Font *pFont);
+Fixed ToFixed(double Value); // Nearest fixed value, held inside MaxFixedReach
+
+#endif // FONT_H_INCLUDED
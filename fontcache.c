@@ -0,0 +1,219 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "font.h"
+#include "fontcache.h"
+#include "profile.h"
+
+// Fonts are loaded the first time a job asks for them and then shared read-only by every job that uses the same
+// file. Each one is reference counted; once nothing is using it, it stays loaded until the fonts held come to more
+// than the budget, when the least recently used are freed first.
+
+// STRUCTS
+
+typedef struct CachedFont // Struct to hold one loaded font, kept in most recently used order
+{
+    Font Loaded; // First member, so a Font handed out can be turned back into its entry
+    int References;
+    struct CachedFont *pNewer;
+    struct CachedFont *pOlder;
+} CachedFont;
+
+// GLOBAL VARIABLES
+
+static pthread_mutex_t CacheLock = PTHREAD_MUTEX_INITIALIZER;
+static CachedFont *pNewest = NULL;
+static CachedFont *pOldest = NULL;
+static size_t CachedBytes = 0;
+static size_t Budget = DefaultFontBudget;
+static int KerningEnabled = 0;
+static long Hits = 0, Misses = 0, Evictions = 0;
+
+// FUNCTION DECLARATIONS
+
+static void Unlink(CachedFont *pEntry);
+static void LinkNewest(CachedFont *pEntry);
+static void EvictUnused(void);
+
+// FUNCTIONS
+
+void StartFontCache(size_t BudgetBytes, int Kerning)
+{
+    pthread_mutex_lock(&CacheLock);
+    Budget = BudgetBytes;
+    KerningEnabled = Kerning;
+    pthread_mutex_unlock(&CacheLock);
+}
+
+const Font *AcquireFont(const char *FileName)
+{
+    pthread_mutex_lock(&CacheLock);
+
+    CachedFont *pEntry = pNewest;
+    while (pEntry != NULL && strcmp(pEntry->Loaded.FileName, FileName) != 0)
+    {
+        pEntry = pEntry->pOlder;
+    }
+
+    if (pEntry != NULL)
+    {
+        Hits++;
+        Unlink(pEntry);
+    }
+    else
+    {
+        // Loaded under the lock, so two jobs asking for the same new font only read it once
+        Misses++;
+        pEntry = calloc(1, sizeof(CachedFont));
+
+        PROFILE_START(FontLoad);
+        int Result = (pEntry != NULL) ? LoadFont(&pEntry->Loaded, FileName) : -2;
+        PROFILE_STOP(StageFontLoad, FontLoad);
+
+        if (Result != 0)
+        {
+            free(pEntry);
+            pthread_mutex_unlock(&CacheLock);
+            return NULL;
+        }
+
+        if (KerningEnabled)
+        {
+            PROFILE_START(Kerning);
+            BuildKerning(&pEntry->Loaded); // Must be ready before any words are measured in this font
+            PROFILE_STOP(StageKerning, Kerning);
+        }
+        CachedBytes += pEntry->Loaded.Bytes;
+    }
+
+    pEntry->References++;
+    LinkNewest(pEntry);
+    EvictUnused(); // The new font is in use, so only older unused ones can go
+
+    pthread_mutex_unlock(&CacheLock);
+    return &pEntry->Loaded;
+}
+
+void ReleaseFont(const Font *pFont)
+{
+    if (pFont == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&CacheLock);
+    CachedFont *pEntry = (CachedFont *)pFont;
+    pEntry->References--;
+    EvictUnused();
+    pthread_mutex_unlock(&CacheLock);
+}
+
+void PrintFontCache(void)
+{
+    pthread_mutex_lock(&CacheLock);
+    int Count = 0;
+    for (CachedFont *pEntry = pNewest; pEntry != NULL; pEntry = pEntry->pOlder)
+    {
+        Count++;
+    }
+    fprintf(stderr, "Font cache: %d fonts, %zu of %zu bytes, %ld hits, %ld loads, %ld evicted\n",
+            Count, CachedBytes, Budget, Hits, Misses, Evictions);
+    pthread_mutex_unlock(&CacheLock);
+}
+
+void StopFontCache(void) // Frees every font, whether or not a job still holds it
+{
+    pthread_mutex_lock(&CacheLock);
+    while (pOldest != NULL)
+    {
+        CachedFont *pEntry = pOldest;
+        Unlink(pEntry);
+        FreeFont(&pEntry->Loaded);
+        free(pEntry);
+    }
+    CachedBytes = 0;
+    pthread_mutex_unlock(&CacheLock);
+}
+
+// Jobs can come from anyone who can reach the daemon, so a font a job names is only looked for in the folder of a
+// font the robot writer was set up with. Fills in FileName and returns 0, or FontNameHasFolder or FontNameTooLong.
+int FontBesideFont(const char *Name, const char *pBeside, char FileName[MaxFontPath])
+{
+    if (Name[0] == '\0' || strpbrk(Name, "/\\:") != NULL || strcmp(Name, ".") == 0 || strcmp(Name, "..") == 0)
+    {
+        return FontNameHasFolder;
+    }
+
+    const char *pSlash = strrchr(pBeside, '/');
+#if defined(_WIN32)
+    const char *pBackslash = strrchr(pBeside, '\\');
+    if (pBackslash != NULL && (pSlash == NULL || pBackslash > pSlash))
+    {
+        pSlash = pBackslash;
+    }
+#endif
+    int FolderLength = pSlash != NULL ? (int)(pSlash - pBeside) + 1 : 0;
+    if (snprintf(FileName, MaxFontPath, "%.*s%s", FolderLength, pBeside, Name) >= MaxFontPath)
+    {
+        return FontNameTooLong;
+    }
+
+    return 0;
+}
+
+static void Unlink(CachedFont *pEntry)
+{
+    if (pEntry->pNewer != NULL)
+    {
+        pEntry->pNewer->pOlder = pEntry->pOlder;
+    }
+    else
+    {
+        pNewest = pEntry->pOlder;
+    }
+
+    if (pEntry->pOlder != NULL)
+    {
+        pEntry->pOlder->pNewer = pEntry->pNewer;
+    }
+    else
+    {
+        pOldest = pEntry->pNewer;
+    }
+
+    pEntry->pNewer = pEntry->pOlder = NULL;
+}
+
+static void LinkNewest(CachedFont *pEntry)
+{
+    pEntry->pOlder = pNewest;
+    if (pNewest != NULL)
+    {
+        pNewest->pNewer = pEntry;
+    }
+    pNewest = pEntry;
+    if (pOldest == NULL)
+    {
+        pOldest = pEntry;
+    }
+}
+
+static void EvictUnused(void) // Called with the lock held
+{
+    CachedFont *pEntry = pOldest;
+    while (CachedBytes > Budget && pEntry != NULL)
+    {
+        CachedFont *pNewer = pEntry->pNewer;
+        if (pEntry->References == 0) // Fonts still in use stay, even over budget
+        {
+            Unlink(pEntry);
+            CachedBytes -= pEntry->Loaded.Bytes;
+            FreeFont(&pEntry->Loaded);
+            free(pEntry);
+            Evictions++;
+        }
+        pEntry = pNewer;
+    }
+}
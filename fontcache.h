@@ -0,0 +1,23 @@
+#ifndef FONTCACHE_H_INCLUDED
+#define FONTCACHE_H_INCLUDED
+
+#include <stddef.h>
+
+#include "font.h"
+
+// GLOBAL CONSTANTS
+
+#define DefaultFontBudget (16u * 1024 * 1024) // Bytes of unused fonts kept loaded before the oldest are dropped
+#define FontNameHasFolder -1                  // From FontBesideFont: only a bare file name is accepted
+#define FontNameTooLong -2
+
+// FUNCTION DECLARATIONS
+
+void StartFontCache(size_t BudgetBytes, int Kerning);
+const Font *AcquireFont(const char *FileName);
+void ReleaseFont(const Font *pFont);
+void PrintFontCache(void);
+void StopFontCache(void);
+int FontBesideFont(const char *Name, const char *pBeside, char FileName[MaxFontPath]);
+
+#endif // FONTCACHE_H_INCLUDED
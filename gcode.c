@@ -0,0 +1,338 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "font.h"
+#include "gcode.h"
+#include "profile.h"
+#include "transform.h"
+
+// GLOBAL CONSTANTS
+
+#define MinArcSegments 3    // Fewer strokes than this are always left as straight moves
+#define MaxArcSegments 256  // Longest run tried as one arc, which bounds the fitting work
+#define MaxArcRadius 1000.0 // Flatter runs are as good as straight, and their centres lose precision
+#define MaxArcSweep 5.5     // Radians; well short of a full turn, where the two ends would meet
+#define PlacementWindow 2048 // Strokes placed at a time; longer runs, mostly drawings, move along in overlapping windows
+
+// STRUCTS
+
+typedef struct // Struct to hold where a run of strokes lands on the page
+{
+    const Strokes *pStrokes;
+    int StrokeCount;
+    StrokeScale Scale;      // Fixed units per stroke unit, worked out once for the run
+    Fixed OriginX, OriginY; // Where the strokes' (0, 0) lands
+    int First, Count;       // Strokes placed so far, which always reach MaxArcSegments past the one being written
+    int32_t PlacedX[PlacementWindow], PlacedY[PlacementWindow]; // From the origin, as PlaceStrokes leaves them
+} Placement;
+
+typedef struct // Struct to hold an arc that can stand in for a run of strokes
+{
+    int Last; // Stroke the arc ends on
+    int Clockwise;
+    double CentreX, CentreY; // Millimetres from the first stroke
+} ArcFit;
+
+// GLOBAL VARIABLES
+
+Fixed XOffset = 0, YOffset = 0;
+float ArcTolerance = 0.0f;
+void (*EmitCommand)(char *Command) = PrintCommand;
+FILE *pGCodeFile = NULL;
+
+// Lines that never change are kept ready rather than formatted each time
+static char PenDownCommand[] = "S1000\n";
+static char PenUpCommand[] = "S0\n";
+static char OriginCommand[] = "G0 X0 Y0\n";
+
+// FUNCTION DECLARATIONS
+
+static void EmitStrokes(Placement *pPlacement);
+static void PlaceWindow(Placement *pPlacement, int First);
+static int FitArc(const Placement *pPlacement, int First, ArcFit *pArc);
+static int ArcThrough(const Placement *pPlacement, int First, int Last, ArcFit *pArc);
+static Fixed PlaceX(const Placement *pPlacement, int Index);
+static Fixed PlaceY(const Placement *pPlacement, int Index);
+static int64_t RoundTo(Fixed Value, int64_t Step);
+static char *WriteDecimal(char *pOut, int64_t Value, int Places);
+static char *WriteText(char *pOut, const char *Text);
+
+// FUNCTIONS
+
+void GenerateGCode(const Font *pFont, const char *Word)
+{
+    PROFILE_START(Emit);
+    PROFILE_COUNT(CounterWords, 1);
+
+    // The glyphs were read into whole stroke units and the scale is made a multiplier and shift once, so from the
+    // font to the written line every position stays a whole number and advances add up exactly however long the line
+    Placement Glyph; // Filled in field by field, since clearing the windows for every word would cost more than placing them
+    Glyph.Scale = MakeStrokeScale((double)ScaleFactor * FixedPerMm / StrokePerFontUnit);
+    Glyph.OriginX = XOffset;
+    Glyph.OriginY = YOffset;
+
+    size_t Index = 0;
+    const Character *pCurrent = FindGlyph(pFont, DecodeUtf8(Word, &Index));
+
+    while (pCurrent != NULL)
+    {
+        const Character *pNext = FindGlyph(pFont, DecodeUtf8(Word, &Index)); // Needed for the kerning after this character
+
+        Glyph.pStrokes = pCurrent->pStrokes;
+        Glyph.StrokeCount = pCurrent->StrokeCount;
+        EmitStrokes(&Glyph);
+
+        if (pCurrent->StrokeCount > 0)
+        {
+            Glyph.OriginX = PlaceX(&Glyph, pCurrent->StrokeCount - 1); // Moves on to the end of the current character
+        }
+        if (pNext != NULL)
+        {
+            Glyph.OriginX += PlaceCoordinate(PairKerning(pFont, pCurrent, pNext), &Glyph.Scale); // As CalculateWordWidth measured it
+        }
+        pCurrent = pNext;
+    }
+
+    XOffset = Glyph.OriginX;
+
+    PROFILE_STOP(StageEmit, Emit);
+}
+
+void GenerateStrokes(const Strokes *pStrokes, int StrokeCount, float Scale) // Placed at XOffset, YOffset, Scale fixed units to a stroke unit
+{
+    Placement Picture;
+    Picture.pStrokes = pStrokes;
+    Picture.StrokeCount = StrokeCount;
+    Picture.Scale = MakeStrokeScale(Scale);
+    Picture.OriginX = XOffset;
+    Picture.OriginY = YOffset;
+    EmitStrokes(&Picture);
+}
+
+static void EmitStrokes(Placement *pPlacement)
+{
+    char WordBuffer[100];
+    pPlacement->First = pPlacement->Count = 0;
+
+    for (int j = 0; j < pPlacement->StrokeCount; j++)
+    {
+        if (j + MaxArcSegments > pPlacement->First + pPlacement->Count && pPlacement->First + pPlacement->Count < pPlacement->StrokeCount)
+        {
+            PlaceWindow(pPlacement, j > 0 ? j - 1 : 0); // From the stroke an arc would start at
+        }
+
+        int Pen = pPlacement->pStrokes[j].Pen;
+        char *pOut;
+
+        ArcFit Arc;
+        if (Pen == 1 && ArcTolerance > 0.0f && j > 0 && FitArc(pPlacement, j - 1, &Arc))
+        {
+            // The ends as the robot will have them, after rounding to the two places written, taken from the start
+            int64_t StartX = RoundTo(PlaceX(pPlacement, j - 1), FixedPerHundredth);
+            int64_t StartY = RoundTo(PlaceY(pPlacement, j - 1), FixedPerHundredth);
+            int64_t EndX = RoundTo(PlaceX(pPlacement, Arc.Last), FixedPerHundredth);
+            int64_t EndY = RoundTo(PlaceY(pPlacement, Arc.Last), FixedPerHundredth);
+            double ChordX = (EndX - StartX) / 100.0, ChordY = (EndY - StartY) / 100.0;
+            double FittedX = Arc.CentreX + (PlaceX(pPlacement, j - 1) - StartX * FixedPerHundredth) / (double)FixedPerMm;
+            double FittedY = Arc.CentreY + (PlaceY(pPlacement, j - 1) - StartY * FixedPerHundredth) / (double)FixedPerMm;
+
+            // GRBL rejects an arc whose ends are at different distances from the centre, so the centre is moved
+            // onto the line halfway between them
+            double MidX = ChordX / 2.0, MidY = ChordY / 2.0;
+            double NormalX = -ChordY, NormalY = ChordX;
+            double Along = ((FittedX - MidX) * NormalX + (FittedY - MidY) * NormalY) / (NormalX * NormalX + NormalY * NormalY);
+
+            EmitCommand(PenDownCommand);
+            pOut = WriteText(WordBuffer, Arc.Clockwise ? "G2 X" : "G3 X");
+            pOut = WriteDecimal(pOut, EndX, 2);
+            pOut = WriteText(pOut, " Y");
+            pOut = WriteDecimal(pOut, EndY, 2);
+            pOut = WriteText(pOut, " I");
+            pOut = WriteDecimal(pOut, llround((MidX + Along * NormalX) * 1000.0), 3);
+            pOut = WriteText(pOut, " J");
+            pOut = WriteDecimal(pOut, llround((MidY + Along * NormalY) * 1000.0), 3);
+            WriteText(pOut, "\n");
+            EmitCommand(WordBuffer);
+            j = Arc.Last;
+            continue;
+        }
+
+        EmitCommand(Pen == 1 ? PenDownCommand : PenUpCommand);
+        pOut = WriteText(WordBuffer, "G0 X");
+        pOut = WriteDecimal(pOut, RoundTo(PlaceX(pPlacement, j), FixedPerHundredth), 2);
+        pOut = WriteText(pOut, " Y");
+        pOut = WriteDecimal(pOut, RoundTo(PlaceY(pPlacement, j), FixedPerHundredth), 2);
+        WriteText(pOut, "\n");
+        EmitCommand(WordBuffer);
+    }
+}
+
+static void PlaceWindow(Placement *pPlacement, int First) // Scales the strokes from First on in one batch
+{
+    int Remaining = pPlacement->StrokeCount - First;
+    pPlacement->First = First;
+    pPlacement->Count = Remaining < PlacementWindow ? Remaining : PlacementWindow;
+    PlaceStrokes(pPlacement->pStrokes + First, pPlacement->Count, &pPlacement->Scale, pPlacement->PlacedX, pPlacement->PlacedY);
+}
+
+// Longest run of pen-down strokes after First that one arc can replace, trying ever longer runs until one fails
+static int FitArc(const Placement *pPlacement, int First, ArcFit *pArc)
+{
+    int RunEnd = First;
+    while (RunEnd + 1 < pPlacement->StrokeCount && pPlacement->pStrokes[RunEnd + 1].Pen == 1 && RunEnd - First < MaxArcSegments)
+    {
+        RunEnd++;
+    }
+
+    int Found = 0;
+    for (int Last = First + MinArcSegments; Last <= RunEnd; Last++)
+    {
+        ArcFit Candidate;
+        if (!ArcThrough(pPlacement, First, Last, &Candidate))
+        {
+            break;
+        }
+        *pArc = Candidate;
+        Found = 1;
+    }
+
+    return Found;
+}
+
+// Takes the circle through the first, middle and last points, then checks that it turns the same way throughout
+// and strays no further than ArcTolerance from any of the straight strokes it replaces
+static int ArcThrough(const Placement *pPlacement, int First, int Last, ArcFit *pArc)
+{
+    int Middle = (First + Last) / 2;
+    Fixed StartX = PlaceX(pPlacement, First), StartY = PlaceY(pPlacement, First);
+
+    // Worked in millimetres from the start point, where the differences are exact
+    double MiddleX = (PlaceX(pPlacement, Middle) - StartX) / (double)FixedPerMm;
+    double MiddleY = (PlaceY(pPlacement, Middle) - StartY) / (double)FixedPerMm;
+    double EndX = (PlaceX(pPlacement, Last) - StartX) / (double)FixedPerMm;
+    double EndY = (PlaceY(pPlacement, Last) - StartY) / (double)FixedPerMm;
+    double Determinant = 2.0 * (MiddleX * EndY - MiddleY * EndX);
+    if (fabs(Determinant) < 1e-9)
+    {
+        return 0; // In a straight line
+    }
+
+    double MiddleSquare = MiddleX * MiddleX + MiddleY * MiddleY, EndSquare = EndX * EndX + EndY * EndY;
+    double CentreX = (EndY * MiddleSquare - MiddleY * EndSquare) / Determinant;
+    double CentreY = (MiddleX * EndSquare - EndX * MiddleSquare) / Determinant;
+    double Radius = hypot(CentreX, CentreY);
+    if (Radius > MaxArcRadius || Radius < ArcTolerance)
+    {
+        return 0;
+    }
+
+    int Clockwise = Determinant < 0.0;
+    double Sweep = 0.0;
+    double PreviousX = -CentreX, PreviousY = -CentreY; // Points from here on are taken from the centre
+    double PreviousError = 0.0;
+
+    for (int k = First + 1; k <= Last; k++)
+    {
+        double PointX = (PlaceX(pPlacement, k) - StartX) / (double)FixedPerMm - CentreX;
+        double PointY = (PlaceY(pPlacement, k) - StartY) / (double)FixedPerMm - CentreY;
+        double Error = fabs(hypot(PointX, PointY) - Radius);
+
+        double Turn = atan2(PreviousX * PointY - PreviousY * PointX, PreviousX * PointX + PreviousY * PointY);
+        if ((Clockwise ? -Turn : Turn) <= 0.0)
+        {
+            return 0; // Doubles back
+        }
+        // How far the arc bulges past the stroke, plus however far the stroke's ends are off the circle
+        double HalfChord = hypot(PointX - PreviousX, PointY - PreviousY) / 2.0;
+        double Bulge = Radius - sqrt(fmax(0.0, Radius * Radius - HalfChord * HalfChord));
+        if (Bulge + fmax(Error, PreviousError) > ArcTolerance)
+        {
+            return 0;
+        }
+
+        Sweep += fabs(Turn);
+        PreviousX = PointX;
+        PreviousY = PointY;
+        PreviousError = Error;
+    }
+    if (Sweep > MaxArcSweep)
+    {
+        return 0;
+    }
+
+    pArc->Last = Last;
+    pArc->Clockwise = Clockwise;
+    pArc->CentreX = CentreX;
+    pArc->CentreY = CentreY;
+    return 1;
+}
+
+static Fixed PlaceX(const Placement *pPlacement, int Index)
+{
+    return pPlacement->OriginX + pPlacement->PlacedX[Index - pPlacement->First];
+}
+
+static Fixed PlaceY(const Placement *pPlacement, int Index)
+{
+    return pPlacement->OriginY + pPlacement->PlacedY[Index - pPlacement->First];
+}
+
+static int64_t RoundTo(Fixed Value, int64_t Step) // Whole steps, halves rounded away from zero
+{
+    return Value < 0 ? -((-Value + Step / 2) / Step) : (Value + Step / 2) / Step;
+}
+
+// Writes Value / 10^Places with exactly that many decimal places, the same text as printf's %.Nf would give,
+// and returns the end of it
+static char *WriteDecimal(char *pOut, int64_t Value, int Places)
+{
+    char Digits[24];
+    int Count = 0;
+    uint64_t Magnitude = Value < 0 ? (uint64_t)0 - (uint64_t)Value : (uint64_t)Value;
+
+    do
+    {
+        Digits[Count++] = (char)('0' + Magnitude % 10);
+        Magnitude /= 10;
+    } while (Magnitude > 0 || Count <= Places);
+
+    if (Value < 0)
+    {
+        *pOut++ = '-';
+    }
+    while (Count > 0)
+    {
+        if (Count == Places)
+        {
+            *pOut++ = '.';
+        }
+        *pOut++ = Digits[--Count];
+    }
+    return pOut;
+}
+
+static char *WriteText(char *pOut, const char *Text) // Copies Text with its terminator and returns where it ends
+{
+    while ((*pOut = *Text++) != '\0')
+    {
+        pOut++;
+    }
+    return pOut;
+}
+
+void ResetPen(void)
+{
+    EmitCommand(PenUpCommand);
+    EmitCommand(OriginCommand); // Move to origin
+}
+
+void PrintCommand(char *Command) // Simulation output, the G-code goes to the console or a file
+{
+    fputs(Command, pGCodeFile != NULL ? pGCodeFile : stdout);
+}
+
+void DiscardCommand(char *Command) // Null output for timing the generator on its own
+{
+    (void)Command;
+}
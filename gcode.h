@@ -0,0 +1,28 @@
+#ifndef GCODE_H_INCLUDED
+#define GCODE_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "font.h"
+
+// GLOBAL CONSTANTS
+
+#define DefaultArcTolerance 0.1f // Furthest an arc may stray from the strokes it replaces (mm), well inside a pen line
+
+// GLOBAL VARIABLES
+
+extern Fixed XOffset, YOffset;              // Origin of the next character
+extern float ArcTolerance;                  // 0 writes every stroke as a G0 line, otherwise runs on a circle become G2/G3
+extern void (*EmitCommand)(char *Command); // Where each finished G-code line is sent
+extern FILE *pGCodeFile;                    // Where PrintCommand writes, the console when NULL
+
+// FUNCTION DECLARATIONS
+
+void GenerateGCode(const Font *pFont, const char *Word);
+void GenerateStrokes(const Strokes *pStrokes, int StrokeCount, float Scale);
+void ResetPen(void);
+void PrintCommand(char *Command);
+void DiscardCommand(char *Command);
+
+#endif // GCODE_H_INCLUDED
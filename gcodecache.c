@@ -0,0 +1,344 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "font.h"
+#include "gcode.h"
+#include "gcodecache.h"
+#include "layout.h"
+#include "platform.h"
+
+// Finished jobs are kept as G-code files named by a hash of everything that decides their content: the input
+// text, the font file, the font size, the page settings and whether kerning was on. A job that hashes the same
+// is streamed straight from its file and never laid out. Fonts picked up from markup in the text are only known
+// once the job has been laid out, so they are listed with their own hashes at the top of the file and checked
+// before it is used.
+//
+// File layout:
+//   ; RobotWriter G-code cache <version> <font count>
+//   ; font <hash> <file>      once for each font switched to by markup
+//   G-code lines, with "; page N" where the job moves on to sheet N
+
+// GLOBAL CONSTANTS
+
+#define CacheHeader "; RobotWriter G-code cache"
+#define FontDependency "; font "
+#define MaxCacheLine 256
+#define HashChunk 65536
+
+// STRUCTS
+
+typedef struct // Struct to hold two independent 64-bit hashes, together making the key
+{
+    uint64_t A, B;
+} JobHash;
+
+// GLOBAL VARIABLES
+
+static FILE *pRecording = NULL; // G-code of the job being cached, written as it is emitted
+static char RecordingKey[JobKeyLength + 1];
+static char RecordingName[2 * MaxFileNameLength];
+static void (*ForwardCommand)(char *Command) = NULL; // Where the G-code goes while it is being recorded
+
+// FUNCTION DECLARATIONS
+
+static void StartHash(JobHash *pHash);
+static void AddToHash(JobHash *pHash, const void *pData, size_t Length);
+static int HashFile(JobHash *pHash, const char *FileName);
+static void FormatHash(const JobHash *pHash, char *Text, int Digits);
+static void RecordCommand(char *Command);
+static int WriteEntry(const Layout *pLayout);
+static void TrimCache(long long BudgetBytes);
+static int OldestFirst(const void *pLeft, const void *pRight);
+
+// FUNCTIONS
+
+int MakeJobKey(char *Key, const char *InputFile, const Font *pFont, float FontSize, const PageSettings *pSettings, int Kerning, float ArcTolerance)
+{
+    JobHash Hash;
+    StartHash(&Hash);
+
+    char Options[256]; // Written out as text so struct padding can never change the key
+    int Length = snprintf(Options, sizeof(Options), "v%d size %.4f kern %d arcs %.3f page %.3f %.3f %.3f %.3f line %.3f breaks %d\n",
+                          GCodeCacheVersion, FontSize, Kerning, ArcTolerance, pSettings->Height, pSettings->TopMargin,
+                          pSettings->BottomMargin, pSettings->LeftMargin, pSettings->LineLength, pSettings->LineBreakMode);
+    AddToHash(&Hash, Options, (size_t)Length);
+
+    if (HashFile(&Hash, InputFile) != 0 || (pFont != NULL && HashFile(&Hash, pFont->FileName) != 0)) // No font for a drawing
+    {
+        return -1; // Nothing to cache against; the layout reports the missing file
+    }
+
+    FormatHash(&Hash, Key, JobKeyLength);
+    return 0;
+}
+
+FILE *OpenCachedJob(const char *Key)
+{
+    char FileName[2 * MaxFileNameLength];
+    snprintf(FileName, sizeof(FileName), "%s/%s%s", GCodeCacheFolder, Key, GCodeCacheSuffix);
+
+    FILE *pCachedJob = fopen(FileName, "r");
+    if (pCachedJob == NULL)
+    {
+        return NULL;
+    }
+
+    char Line[MaxCacheLine];
+    int Version = 0, FontCount = -1;
+    if (fgets(Line, sizeof(Line), pCachedJob) == NULL || sscanf(Line, CacheHeader " %d %d", &Version, &FontCount) != 2 ||
+        Version != GCodeCacheVersion)
+    {
+        fclose(pCachedJob);
+        return NULL;
+    }
+
+    for (int i = 0; i < FontCount; i++) // A font changed since the job was stored means the G-code is stale
+    {
+        char Stored[JobKeyLength + 1], Current[JobKeyLength + 1], FontFile[MaxCacheLine];
+        JobHash Hash;
+        StartHash(&Hash);
+
+        if (fgets(Line, sizeof(Line), pCachedJob) == NULL || sscanf(Line, FontDependency "%32s %255[^\n]", Stored, FontFile) != 2 ||
+            HashFile(&Hash, FontFile) != 0)
+        {
+            fclose(pCachedJob);
+            return NULL;
+        }
+
+        FormatHash(&Hash, Current, JobKeyLength);
+        if (strcmp(Stored, Current) != 0)
+        {
+            fclose(pCachedJob);
+            remove(FileName);
+            return NULL;
+        }
+    }
+
+    TouchFile(FileName); // Recently used jobs are the last to be evicted
+    return pCachedJob;
+}
+
+int ReplayCachedJob(FILE *pCachedJob, void (*OnPage)(int NextPage))
+{
+    char Line[MaxCacheLine];
+
+    while (fgets(Line, sizeof(Line), pCachedJob) != NULL)
+    {
+        if (strncmp(Line, PageMarker, strlen(PageMarker)) == 0)
+        {
+            OnPage(atoi(Line + strlen(PageMarker)));
+        }
+        else if (Line[0] != ';') // Header lines have already been checked
+        {
+            EmitCommand(Line);
+        }
+    }
+
+    int Result = ferror(pCachedJob) ? -1 : 0;
+    fclose(pCachedJob);
+    return Result;
+}
+
+int StartCachingJob(const char *Key)
+{
+    if (MakeFolder(GCodeCacheFolder) != 0)
+    {
+        printf("Could not create %s, the job will not be cached\n", GCodeCacheFolder);
+        return -1;
+    }
+
+    snprintf(RecordingName, sizeof(RecordingName), "%s/%s.%d.tmp", GCodeCacheFolder, Key, ProcessId());
+    pRecording = fopen(RecordingName, "w+");
+    if (pRecording == NULL)
+    {
+        printf("Could not create %s, the job will not be cached\n", RecordingName);
+        return -1;
+    }
+
+    snprintf(RecordingKey, sizeof(RecordingKey), "%s", Key);
+    ForwardCommand = EmitCommand; // Every line still goes where it was going, with a copy kept
+    EmitCommand = RecordCommand;
+    return 0;
+}
+
+void SuspendCaching(int NextPage) // What the sheet change sends is not part of the job, so it is not stored
+{
+    if (pRecording != NULL)
+    {
+        fprintf(pRecording, PageMarker "%d\n", NextPage);
+        EmitCommand = ForwardCommand;
+    }
+}
+
+void ResumeCaching(void)
+{
+    if (pRecording != NULL)
+    {
+        EmitCommand = RecordCommand;
+    }
+}
+
+void FinishCachingJob(int Keep, const Layout *pLayout, long long BudgetBytes)
+{
+    if (pRecording == NULL)
+    {
+        return;
+    }
+
+    EmitCommand = ForwardCommand;
+    if (Keep && WriteEntry(pLayout) != 0)
+    {
+        printf("Could not store the job in %s\n", GCodeCacheFolder);
+    }
+
+    fclose(pRecording);
+    pRecording = NULL;
+    remove(RecordingName);
+
+    if (Keep)
+    {
+        TrimCache(BudgetBytes);
+    }
+}
+
+static void StartHash(JobHash *pHash)
+{
+    pHash->A = 0xcbf29ce484222325ULL; // FNV-1a offset basis
+    pHash->B = 0x9e3779b97f4a7c15ULL;
+}
+
+static void AddToHash(JobHash *pHash, const void *pData, size_t Length)
+{
+    const unsigned char *pByte = pData;
+    uint64_t A = pHash->A, B = pHash->B;
+
+    for (size_t i = 0; i < Length; i++)
+    {
+        A = (A ^ pByte[i]) * 0x100000001b3ULL; // FNV-1a
+        B = (B ^ pByte[i]) * 0xff51afd7ed558ccdULL;
+        B ^= B >> 29; // Folds the high bits back in so the two halves do not move together
+    }
+
+    pHash->A = A;
+    pHash->B = B;
+}
+
+static int HashFile(JobHash *pHash, const char *FileName)
+{
+    FILE *pFile = fopen(FileName, "rb");
+    if (pFile == NULL)
+    {
+        return -1;
+    }
+
+    unsigned char *pChunk = malloc(HashChunk);
+    if (pChunk == NULL)
+    {
+        fclose(pFile);
+        return -1;
+    }
+
+    size_t Read;
+    long long Total = 0;
+    while ((Read = fread(pChunk, 1, HashChunk, pFile)) > 0)
+    {
+        AddToHash(pHash, pChunk, Read);
+        Total += (long long)Read;
+    }
+    AddToHash(pHash, &Total, sizeof(Total)); // Ends each file so one cannot run into the next
+
+    free(pChunk);
+    fclose(pFile);
+    return 0;
+}
+
+static void FormatHash(const JobHash *pHash, char *Text, int Digits)
+{
+    snprintf(Text, (size_t)Digits + 1, "%016llx%016llx", (unsigned long long)pHash->A, (unsigned long long)pHash->B);
+}
+
+static void RecordCommand(char *Command)
+{
+    fputs(Command, pRecording);
+    ForwardCommand(Command);
+}
+
+static int WriteEntry(const Layout *pLayout)
+{
+    // The header needs the fonts the markup used, so the recorded G-code is copied in behind it once the job is done
+    char FinalName[2 * MaxFileNameLength], EntryName[2 * MaxFileNameLength + 8];
+    snprintf(FinalName, sizeof(FinalName), "%s/%s%s", GCodeCacheFolder, RecordingKey, GCodeCacheSuffix);
+    snprintf(EntryName, sizeof(EntryName), "%s.entry", RecordingName);
+
+    FILE *pEntry = fopen(EntryName, "w");
+    if (pEntry == NULL)
+    {
+        return -1;
+    }
+
+    int FontCount = pLayout ? pLayout->MarkupFontCount : 0;
+    fprintf(pEntry, CacheHeader " %d %d\n", GCodeCacheVersion, FontCount);
+    for (int i = 0; i < FontCount; i++)
+    {
+        char Digest[JobKeyLength + 1];
+        JobHash Hash;
+        StartHash(&Hash);
+        HashFile(&Hash, pLayout->pMarkupFonts[i]->FileName);
+        FormatHash(&Hash, Digest, JobKeyLength);
+        fprintf(pEntry, FontDependency "%s %s\n", Digest, pLayout->pMarkupFonts[i]->FileName);
+    }
+
+    char Chunk[4096];
+    size_t Read;
+    rewind(pRecording);
+    while ((Read = fread(Chunk, 1, sizeof(Chunk), pRecording)) > 0)
+    {
+        fwrite(Chunk, 1, Read, pEntry);
+    }
+
+    int Failed = ferror(pRecording) || ferror(pEntry);
+    Failed |= (fclose(pEntry) != 0);
+    if (Failed || MoveIntoPlace(EntryName, FinalName) != 0) // Readers only ever see a complete entry
+    {
+        remove(EntryName);
+        return -1;
+    }
+    return 0;
+}
+
+static void TrimCache(long long BudgetBytes)
+{
+    FileInfo *pFiles;
+    int Count = ListFiles(GCodeCacheFolder, GCodeCacheSuffix, &pFiles);
+    if (Count <= 0)
+    {
+        return;
+    }
+
+    long long Total = 0;
+    for (int i = 0; i < Count; i++)
+    {
+        Total += pFiles[i].Bytes;
+    }
+
+    qsort(pFiles, (size_t)Count, sizeof(FileInfo), OldestFirst);
+    for (int i = 0; i < Count && Total > BudgetBytes; i++)
+    {
+        char FileName[2 * MaxFileNameLength];
+        snprintf(FileName, sizeof(FileName), "%s/%s", GCodeCacheFolder, pFiles[i].Name);
+        if (remove(FileName) == 0)
+        {
+            Total -= pFiles[i].Bytes;
+        }
+    }
+
+    free(pFiles);
+}
+
+static int OldestFirst(const void *pLeft, const void *pRight)
+{
+    long long Left = ((const FileInfo *)pLeft)->Modified, Right = ((const FileInfo *)pRight)->Modified;
+    return (Left > Right) - (Left < Right);
+}
@@ -0,0 +1,28 @@
+#ifndef GCODECACHE_H_INCLUDED
+#define GCODECACHE_H_INCLUDED
+
+#include <stdio.h>
+
+#include "font.h"
+#include "layout.h"
+
+// GLOBAL CONSTANTS
+
+#define GCodeCacheFolder "GCodeCache"
+#define GCodeCacheSuffix ".gcode"
+#define DefaultGCodeCacheBudget (64LL * 1024 * 1024) // Bytes of stored jobs kept before the least recently used go
+#define GCodeCacheVersion 4 // Part of every key; bump it whenever the same input would produce different G-code
+#define JobKeyLength 32     // Hex digits in a key
+#define PageMarker "; page " // Stored where the job moves to a new sheet
+
+// FUNCTION DECLARATIONS
+
+int MakeJobKey(char *Key, const char *InputFile, const Font *pFont, float FontSize, const PageSettings *pSettings, int Kerning, float ArcTolerance);
+FILE *OpenCachedJob(const char *Key);
+int ReplayCachedJob(FILE *pCachedJob, void (*OnPage)(int NextPage));
+int StartCachingJob(const char *Key);
+void SuspendCaching(int NextPage);
+void ResumeCaching(void);
+void FinishCachingJob(int Keep, const Layout *pLayout, long long BudgetBytes);
+
+#endif // GCODECACHE_H_INCLUDED
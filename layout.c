@@ -0,0 +1,608 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "font.h"
+#include "fontcache.h"
+#include "layout.h"
+#include "platform.h"
+#include "profile.h"
+
+// GLOBAL CONSTANTS
+
+#define InputStalled -2 // From ReadInput when a live stream has gone quiet past its latency deadline
+
+// STRUCTS
+
+typedef struct // Struct to hold the position of the next word, in fixed units so that advances add up exactly
+{
+    Fixed X, Y;
+    int Page;
+} Cursor;
+
+typedef struct // Struct to hold a word waiting for its paragraph to be broken into lines
+{
+    char Word[MaxWordLength];
+    const Font *pFont;
+    Fixed Width;
+    Fixed Gap; // Whitespace before the word, dropped if the word starts a wrapped line
+} Token;
+
+typedef struct // Struct to hold the words of the current paragraph and the line breaker's working arrays
+{
+    Token *pTokens;
+    char *pBreaks; // pBreaks[i] is set if word i starts a new line
+    int *pLines;
+    double *pCost;
+    int *pNext;
+    int Count;
+    int Capacity;
+    Arena *pMemory; // Where the buffers grow; old copies go when the job does
+} Paragraph;
+
+// FUNCTION DECLARATIONS
+
+static int StartLayoutThread(Layout *pLayout, FILE *pInput, const Font *pFont, float FontSize, const PageSettings *pSettings,
+                             int Streaming, int LatencyMs);
+static void *LayoutThread(void *pArgument);
+static int ReadInput(Layout *pLayout, int Pending, long long PendingSince);
+static int TakeWord(Layout *pLayout, Paragraph *pParagraph, const char *Word, Fixed Gap);
+static int AddToken(Paragraph *pParagraph, const char *Word, const Font *pFont, Fixed Gap);
+static void SwitchFont(Layout *pLayout, const char *Markup);
+static void PlaceParagraph(Layout *pLayout, Cursor *pCursor, Paragraph *pParagraph, int KeepLastLine);
+static void BreakLinesGreedy(Paragraph *pParagraph, Fixed LineLength, Fixed StartX);
+static void BreakLinesOptimal(Paragraph *pParagraph, Fixed LineLength, Fixed StartX);
+static void PlaceWord(Layout *pLayout, Cursor *pCursor, const Token *pToken);
+static void SetNewLine(Layout *pLayout, Cursor *pCursor);
+static int WholeCharacters(const char *Word, int Length);
+
+// FUNCTIONS
+
+void DefaultPageSettings(PageSettings *pSettings)
+{
+    pSettings->Height = DefaultPageHeight;
+    pSettings->TopMargin = DefaultTopMargin;
+    pSettings->BottomMargin = DefaultBottomMargin;
+    pSettings->LeftMargin = DefaultLeftMargin;
+    pSettings->LineLength = DefaultLineLength;
+    pSettings->LineBreakMode = GreedyLineBreaks;
+}
+
+int StartLayout(Layout *pLayout, const char *FileName, const Font *pFont, float FontSize, const PageSettings *pSettings)
+{
+    FILE *pInput = fopen(FileName, "rb"); // Opened here so a missing file is reported straight away
+    if (pInput == NULL)
+    {
+        printf("Could not open %s\n", FileName);
+        return -1;
+    }
+
+    return StartLayoutStream(pLayout, pInput, pFont, FontSize, pSettings);
+}
+
+int StartLayoutStream(Layout *pLayout, FILE *pInput, const Font *pFont, float FontSize, const PageSettings *pSettings)
+{
+    return StartLayoutThread(pLayout, pInput, pFont, FontSize, pSettings, 0, 0);
+}
+
+int StartLayoutLive(Layout *pLayout, FILE *pInput, const Font *pFont, float FontSize, const PageSettings *pSettings, int LatencyMs)
+{
+    // Live text turns up a little at a time, so nothing may sit in a read-ahead buffer while the layout waits
+    setvbuf(pInput, NULL, _IONBF, 0);
+    return StartLayoutThread(pLayout, pInput, pFont, FontSize, pSettings, 1, LatencyMs);
+}
+
+int WaitForWord(Layout *pLayout, int Index, PlacedWord *pWord)
+{
+    int Result = -1;
+
+    pthread_mutex_lock(&pLayout->Lock);
+    while (Index >= pLayout->WordCount && !pLayout->Finished) // Only blocks if the sender has caught up with the layout
+    {
+        pthread_cond_wait(&pLayout->WordsAdded, &pLayout->Lock);
+    }
+
+    if (Index < pLayout->WordCount)
+    {
+        *pWord = pLayout->pWords[pLayout->Streaming ? Index % pLayout->Capacity : Index];
+        Result = 0;
+    }
+    if (pLayout->Streaming && Index >= pLayout->WordsTaken) // Words are taken in order, so all before this one are done with
+    {
+        pLayout->WordsTaken = Index + 1;
+        pthread_cond_signal(&pLayout->WordsFreed);
+    }
+
+    if (Result != 0 && pLayout->Failed)
+    {
+        Result = -2;
+    }
+    pthread_mutex_unlock(&pLayout->Lock);
+
+    return Result; // -1 once every word has been handed out, -2 if the layout stopped short of the end
+}
+
+void FinishLayout(Layout *pLayout)
+{
+    pthread_join(pLayout->Thread, NULL);
+    pthread_cond_destroy(&pLayout->WordsAdded);
+    pthread_cond_destroy(&pLayout->WordsFreed);
+    pthread_mutex_destroy(&pLayout->Lock);
+
+    fclose(pLayout->pInput);
+    FreeArena(&pLayout->Memory); // The words and every paragraph buffer
+    pLayout->pWords = NULL;
+
+    for (int i = 0; i < pLayout->MarkupFontCount; i++) // Placed words may point at these, so they go last
+    {
+        ReleaseFont(pLayout->pMarkupFonts[i]);
+    }
+    pLayout->MarkupFontCount = 0;
+}
+
+static int StartLayoutThread(Layout *pLayout, FILE *pInput, const Font *pFont, float FontSize, const PageSettings *pSettings,
+                             int Streaming, int LatencyMs)
+{
+    memset(pLayout, 0, sizeof(Layout));
+
+    pLayout->pInput = pInput; // Closed by FinishLayout
+    pLayout->pJobFont = pFont;
+    pLayout->pFont = pFont;
+    pLayout->FontSize = FontSize;
+    pLayout->Settings = *pSettings;
+    pLayout->PageCount = 1;
+    pLayout->Streaming = Streaming;
+    pLayout->LatencyMs = LatencyMs;
+
+    if (Streaming) // The ring is all the word storage a stream ever gets
+    {
+        pLayout->pWords = ArenaAlloc(&pLayout->Memory, StreamWindow * sizeof(PlacedWord));
+        if (pLayout->pWords == NULL)
+        {
+            printf("Memory allocation failed for the page layout\n");
+            fclose(pInput);
+            return -1;
+        }
+        pLayout->Capacity = StreamWindow;
+    }
+
+    pthread_mutex_init(&pLayout->Lock, NULL);
+    pthread_cond_init(&pLayout->WordsAdded, NULL);
+    pthread_cond_init(&pLayout->WordsFreed, NULL);
+
+    if (pthread_create(&pLayout->Thread, NULL, LayoutThread, pLayout) != 0)
+    {
+        printf("Could not start the layout thread\n");
+        fclose(pLayout->pInput);
+        FreeArena(&pLayout->Memory);
+        pthread_cond_destroy(&pLayout->WordsFreed);
+        pthread_cond_destroy(&pLayout->WordsAdded);
+        pthread_mutex_destroy(&pLayout->Lock);
+        return -2;
+    }
+
+    return 0;
+}
+
+static void *LayoutThread(void *pArgument)
+{
+    PROFILE_START(Layout);
+    Layout *pLayout = (Layout *)pArgument;
+    Fixed Space = ToFixed((double)pLayout->FontSize * FixedPerMm);
+
+    Cursor Position = {ToFixed((double)pLayout->Settings.LeftMargin * FixedPerMm), -ToFixed((double)pLayout->Settings.TopMargin * FixedPerMm), 1};
+    Paragraph Tokens = {0};
+    Tokens.pMemory = &pLayout->Memory;
+
+    char Word[MaxWordLength];
+    int WordIndex = 0;
+    Fixed Gap = 0; // Whitespace seen since the last word
+    int AtStart = 1;  // A UTF-8 byte order mark may still come first
+    int CurrentCharacter;
+    long long PendingSince = 0; // When the oldest text not yet placed arrived, for the latency deadline
+
+    while (!pLayout->Failed && (CurrentCharacter = ReadInput(pLayout, WordIndex > 0 || Tokens.Count > 0, PendingSince)) != EOF)
+    {
+        if (CurrentCharacter == InputStalled) // Draws what has come so far; the rest of the line carries on after it
+        {
+            WordIndex = WholeCharacters(Word, WordIndex);
+            if (WordIndex > 0)
+            {
+                Word[WordIndex] = '\0';
+                int Taken = TakeWord(pLayout, &Tokens, Word, Gap);
+                if (Taken < 0)
+                {
+                    break;
+                }
+                Gap = Taken ? Gap : 0;
+                WordIndex = 0;
+            }
+            PlaceParagraph(pLayout, &Position, &Tokens, 0);
+            continue;
+        }
+        if (WordIndex == 0 && Tokens.Count == 0)
+        {
+            PendingSince = MillisecondsNow();
+        }
+
+        if (CurrentCharacter == ' ' || CurrentCharacter == '\t' || CurrentCharacter == '\n' || CurrentCharacter == '\r')
+        {
+            AtStart = 0;
+            WordIndex = WholeCharacters(Word, WordIndex); // A cut-off word must not end halfway through a character
+            if (WordIndex > 0)
+            {
+                Word[WordIndex] = '\0';
+                int Taken = TakeWord(pLayout, &Tokens, Word, Gap);
+                if (Taken < 0)
+                {
+                    break;
+                }
+                Gap = Taken ? Gap : 0;
+                WordIndex = 0;
+            }
+            if (pLayout->Streaming && Tokens.Count >= StreamParagraphWords) // A stream may never end its paragraph
+            {
+                PlaceParagraph(pLayout, &Position, &Tokens, 1);
+            }
+
+            if (CurrentCharacter == ' ') // Handle space
+            {
+                Gap += Space;
+            }
+
+            if (CurrentCharacter == '\t') // Handle tab (typically 4 spaces; adjust as needed)
+            {
+                Gap += 4 * Space;
+            }
+
+            if (CurrentCharacter == '\n' || CurrentCharacter == '\r') // Handle new line
+            {
+                PlaceParagraph(pLayout, &Position, &Tokens, 0);
+                SetNewLine(pLayout, &Position);
+                Gap = 0;
+            }
+
+            continue; // Prevents whitespace being added to the next word
+        }
+
+        // Whitespace bytes never occur inside a multi-byte UTF-8 sequence, so words are split on bytes and decoded later
+        if (WordIndex < MaxWordLength - 1) // Add character to the word if there's space
+        {
+            Word[WordIndex++] = (char)CurrentCharacter;
+        }
+
+        if (AtStart && WordIndex == 3)
+        {
+            WordIndex = (memcmp(Word, "\xEF\xBB\xBF", 3) == 0) ? 0 : WordIndex; // Drops the byte order mark
+            AtStart = 0;
+        }
+    }
+
+    WordIndex = WholeCharacters(Word, WordIndex);
+    if (!pLayout->Failed && WordIndex > 0) // Process any remaining word after EOF
+    {
+        Word[WordIndex] = '\0';
+        TakeWord(pLayout, &Tokens, Word, Gap);
+    }
+    if (!pLayout->Failed)
+    {
+        PlaceParagraph(pLayout, &Position, &Tokens, 0); // The buffers stay in the arena until FinishLayout
+    }
+
+    pthread_mutex_lock(&pLayout->Lock);
+    pLayout->Finished = 1;
+    pthread_cond_broadcast(&pLayout->WordsAdded);
+    pthread_mutex_unlock(&pLayout->Lock);
+
+    PROFILE_STOP(StageLayout, Layout);
+    return NULL;
+}
+
+static int ReadInput(Layout *pLayout, int Pending, long long PendingSince)
+{
+    if (pLayout->LatencyMs > 0 && Pending) // Only waits with a deadline while there is text the robot has not been given
+    {
+        long long Remaining = pLayout->LatencyMs - (MillisecondsNow() - PendingSince);
+        if (Remaining <= 0 || WaitForInput(pLayout->pInput, (int)Remaining) == 0)
+        {
+            return InputStalled;
+        }
+    }
+    return fgetc(pLayout->pInput);
+}
+
+// Returns 1 if Word was markup, or -1 if there was no memory to hold it, which stops the layout
+static int TakeWord(Layout *pLayout, Paragraph *pParagraph, const char *Word, Fixed Gap)
+{
+    if (strncmp(Word, FontMarkup, strlen(FontMarkup)) == 0 || strcmp(Word, FontMarkupReset) == 0)
+    {
+        SwitchFont(pLayout, Word); // Markup takes no space, so the gap before it carries on to the next word
+        return 1;
+    }
+
+    if (AddToken(pParagraph, Word, pLayout->pFont, Gap) != 0)
+    {
+        pLayout->Failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static void SwitchFont(Layout *pLayout, const char *Markup)
+{
+    if (strcmp(Markup, FontMarkupReset) == 0)
+    {
+        pLayout->pFont = pLayout->pJobFont;
+        return;
+    }
+
+    char Name[MaxWordLength];
+    snprintf(Name, sizeof(Name), "%s", Markup + strlen(FontMarkup));
+    char *pEnd = strrchr(Name, '}');
+    if (pEnd == NULL || pEnd[1] != '\0')
+    {
+        printf("Ignoring malformed font markup %s\n", Markup);
+        return;
+    }
+    *pEnd = '\0';
+
+    char FileName[MaxFontPath];
+    int Resolved = FontBesideFont(Name, pLayout->pJobFont->FileName, FileName); // Markup only names a file beside the job's font
+    if (Resolved != 0)
+    {
+        printf(Resolved == FontNameHasFolder ? "Ignoring font markup %s, fonts are named without a folder\n"
+                                             : "Ignoring font markup %s, the path is too long\n",
+               Markup);
+        return;
+    }
+
+    for (int i = 0; i < pLayout->MarkupFontCount; i++) // Already held by this document
+    {
+        if (strcmp(pLayout->pMarkupFonts[i]->FileName, FileName) == 0)
+        {
+            pLayout->pFont = pLayout->pMarkupFonts[i];
+            return;
+        }
+    }
+
+    if (pLayout->MarkupFontCount == MaxLayoutFonts)
+    {
+        printf("Too many fonts in one document, ignoring %s\n", FileName);
+        return;
+    }
+
+    const Font *pFont = AcquireFont(FileName);
+    if (pFont == NULL) // Reported by the loader; the words stay in the current font
+    {
+        return;
+    }
+    pLayout->pMarkupFonts[pLayout->MarkupFontCount++] = pFont;
+    pLayout->pFont = pFont;
+}
+
+static int AddToken(Paragraph *pParagraph, const char *Word, const Font *pFont, Fixed Gap)
+{
+    if (pParagraph->Count == pParagraph->Capacity) // Buffers are kept between paragraphs and only ever grow
+    {
+        int NewCapacity = pParagraph->Capacity ? pParagraph->Capacity * 2 : 64;
+        size_t Old = (size_t)pParagraph->Capacity, New = (size_t)NewCapacity;
+        Arena *pMemory = pParagraph->pMemory;
+        Token *pTokens = ArenaGrow(pMemory, pParagraph->pTokens, Old * sizeof(Token), New * sizeof(Token));
+        char *pBreaks = ArenaGrow(pMemory, pParagraph->pBreaks, Old + 1, New + 1);
+        int *pLines = ArenaGrow(pMemory, pParagraph->pLines, (Old + 1) * sizeof(int), (New + 1) * sizeof(int));
+        double *pCost = ArenaGrow(pMemory, pParagraph->pCost, (Old + 1) * sizeof(double), (New + 1) * sizeof(double));
+        int *pNext = ArenaGrow(pMemory, pParagraph->pNext, (Old + 1) * sizeof(int), (New + 1) * sizeof(int));
+
+        if (pTokens) pParagraph->pTokens = pTokens;
+        if (pBreaks) pParagraph->pBreaks = pBreaks;
+        if (pLines) pParagraph->pLines = pLines;
+        if (pCost) pParagraph->pCost = pCost;
+        if (pNext) pParagraph->pNext = pNext;
+
+        if (!pTokens || !pBreaks || !pLines || !pCost || !pNext)
+        {
+            printf("Memory allocation failed for the paragraph buffer\n");
+            return -1;
+        }
+        pParagraph->Capacity = NewCapacity;
+    }
+
+    Token *pToken = &pParagraph->pTokens[pParagraph->Count++];
+    strcpy(pToken->Word, Word);
+    pToken->pFont = pFont;
+    pToken->Width = CalculateWordWidth(pFont, Word);
+    pToken->Gap = Gap;
+    return 0;
+}
+
+static void PlaceParagraph(Layout *pLayout, Cursor *pCursor, Paragraph *pParagraph, int KeepLastLine)
+{
+    if (pParagraph->Count == 0)
+    {
+        return;
+    }
+
+    // Words already placed on the line leave less room for the first one; this only happens when streaming
+    Fixed StartX = pCursor->X - ToFixed((double)pLayout->Settings.LeftMargin * FixedPerMm);
+    Fixed LineLength = ToFixed((double)pLayout->Settings.LineLength * FixedPerMm);
+
+    PROFILE_START(LineBreak);
+    if (pLayout->Settings.LineBreakMode == OptimalLineBreaks)
+    {
+        BreakLinesOptimal(pParagraph, LineLength, StartX);
+    }
+    else
+    {
+        BreakLinesGreedy(pParagraph, LineLength, StartX);
+    }
+    PROFILE_STOP(StageLineBreak, LineBreak);
+
+    int Count = pParagraph->Count;
+    if (KeepLastLine) // The last line may still take more words, so it waits in the paragraph
+    {
+        while (Count > 0 && !pParagraph->pBreaks[Count - 1])
+        {
+            Count--;
+        }
+        Count = (Count > 0) ? Count - 1 : pParagraph->Count; // All on one line, so it is placed as it stands
+    }
+
+    for (int i = 0; i < Count && !pLayout->Failed; i++)
+    {
+        Token *pToken = &pParagraph->pTokens[i];
+
+        if (pParagraph->pBreaks[i]) // The gap before a wrapped word is dropped
+        {
+            SetNewLine(pLayout, pCursor);
+        }
+        else
+        {
+            pCursor->X += pToken->Gap;
+        }
+
+        PlaceWord(pLayout, pCursor, pToken);
+        pCursor->X += pToken->Width;
+    }
+
+    pParagraph->Count -= Count;
+    memmove(pParagraph->pTokens, pParagraph->pTokens + Count, (size_t)pParagraph->Count * sizeof(Token));
+}
+
+static void BreakLinesGreedy(Paragraph *pParagraph, Fixed LineLength, Fixed StartX)
+{
+    Fixed X = StartX;
+
+    for (int i = 0; i < pParagraph->Count; i++)
+    {
+        Token *pToken = &pParagraph->pTokens[i];
+
+        X += pToken->Gap;
+        pParagraph->pBreaks[i] = (X > 0 && X + pToken->Width > LineLength); // Words too long for any line are left to overhang
+        if (pParagraph->pBreaks[i])
+        {
+            X = 0;
+        }
+        X += pToken->Width;
+    }
+}
+
+static void BreakLinesOptimal(Paragraph *pParagraph, Fixed LineLength, Fixed StartX)
+{
+    int Count = pParagraph->Count;
+    Token *pTokens = pParagraph->pTokens;
+    int *pLines = pParagraph->pLines;
+    double *pCost = pParagraph->pCost;
+    int *pNext = pParagraph->pNext;
+
+    // Works backwards from the end of the paragraph. pLines[i] and pCost[i] hold the best way of setting
+    // words i..Count-1: fewest lines first, then the least total squared slack. Only breaks that fit on a
+    // line are tried, so the inner loop is bounded by the number of words per line.
+    pLines[Count] = 0;
+    pCost[Count] = 0.0;
+
+    // A first word that no longer fits after the words already on the line starts a fresh one instead
+    int BreakFirst = StartX > 0 && StartX + pTokens[0].Gap + pTokens[0].Width > LineLength;
+    Fixed FirstIndent = BreakFirst ? 0 : StartX + pTokens[0].Gap;
+
+    for (int i = Count - 1; i >= 0; i--)
+    {
+        Fixed Width = (i == 0 ? FirstIndent : 0) - pTokens[i].Gap; // Leading indent only counts on the first line
+        pLines[i] = -1;
+
+        for (int j = i + 1; j <= Count; j++)
+        {
+            Width += pTokens[j - 1].Gap + pTokens[j - 1].Width;
+            if (Width > LineLength && j > i + 1) // A word on its own is always allowed to overhang
+            {
+                break;
+            }
+
+            double Slack = (double)(LineLength - Width) / FixedPerMm; // Millimetres keep the costs a sensible size
+            double Badness = (j == Count || Slack < 0.0) ? 0.0 : Slack * Slack; // The last line may be as short as it likes
+            int Lines = 1 + pLines[j];
+            double Cost = Badness + pCost[j];
+
+            if (pLines[i] < 0 || Lines < pLines[i] || (Lines == pLines[i] && Cost < pCost[i]))
+            {
+                pLines[i] = Lines;
+                pCost[i] = Cost;
+                pNext[i] = j;
+            }
+        }
+    }
+
+    memset(pParagraph->pBreaks, 0, (size_t)Count);
+    pParagraph->pBreaks[0] = (char)BreakFirst;
+    for (int i = pNext[0]; i < Count; i = pNext[i])
+    {
+        pParagraph->pBreaks[i] = 1;
+    }
+}
+
+static void PlaceWord(Layout *pLayout, Cursor *pCursor, const Token *pToken)
+{
+    pthread_mutex_lock(&pLayout->Lock);
+    // A full ring waits for the robot to catch up, and while it waits no more input is read, which holds up the writer
+    while (pLayout->Streaming && pLayout->WordCount - pLayout->WordsTaken >= pLayout->Capacity)
+    {
+        pthread_cond_wait(&pLayout->WordsFreed, &pLayout->Lock);
+    }
+    if (pLayout->WordCount == pLayout->Capacity && !pLayout->Streaming) // Grows the word list geometrically
+    {
+        int NewCapacity = pLayout->Capacity ? pLayout->Capacity * 2 : 256;
+        PlacedWord *pNewWords = ArenaGrow(&pLayout->Memory, pLayout->pWords, (size_t)pLayout->Capacity * sizeof(PlacedWord),
+                                          (size_t)NewCapacity * sizeof(PlacedWord));
+        if (pNewWords == NULL) // Stops the layout rather than dropping the word
+        {
+            pLayout->Failed = 1;
+            pthread_mutex_unlock(&pLayout->Lock);
+            printf("Memory allocation failed for the page layout\n");
+            return;
+        }
+        pLayout->pWords = pNewWords;
+        pLayout->Capacity = NewCapacity;
+    }
+
+    PlacedWord *pPlaced = &pLayout->pWords[pLayout->Streaming ? pLayout->WordCount % pLayout->Capacity : pLayout->WordCount];
+    pLayout->WordCount++;
+    strcpy(pPlaced->Word, pToken->Word);
+    pPlaced->pFont = pToken->pFont;
+    pPlaced->X = pCursor->X;
+    pPlaced->Y = pCursor->Y;
+    pPlaced->Page = pCursor->Page;
+    pLayout->PageCount = pCursor->Page;
+
+    pthread_cond_broadcast(&pLayout->WordsAdded);
+    pthread_mutex_unlock(&pLayout->Lock);
+}
+
+static void SetNewLine(Layout *pLayout, Cursor *pCursor)
+{
+    const PageSettings *pSettings = &pLayout->Settings;
+
+    pCursor->X = ToFixed((double)pSettings->LeftMargin * FixedPerMm);
+    pCursor->Y -= ToFixed(((double)pLayout->FontSize + LineSpacing) * FixedPerMm); // Moves the cursor down for the new line
+
+    if (-pCursor->Y > ToFixed(((double)pSettings->Height - pSettings->BottomMargin) * FixedPerMm)) // Page break once the baseline falls into the bottom margin
+    {
+        pCursor->Page++;
+        pCursor->Y = -ToFixed((double)pSettings->TopMargin * FixedPerMm);
+    }
+}
+
+static int WholeCharacters(const char *Word, int Length) // Length of Word once a trailing partial character is dropped
+{
+    int Start = Length;
+    while (Start > 0 && ((unsigned char)Word[Start - 1] & 0xC0) == 0x80) // Steps back over continuation bytes
+    {
+        Start--;
+    }
+    if (Start == 0 || (unsigned char)Word[Start - 1] < 0xC0)
+    {
+        return Length; // Plain ASCII or malformed, which the decoder already handles
+    }
+
+    unsigned char Lead = (unsigned char)Word[Start - 1];
+    int Needed = (Lead >= 0xF0) ? 4 : (Lead >= 0xE0) ? 3 : 2;
+    return (Length - (Start - 1) >= Needed) ? Length : Start - 1;
+}
@@ -0,0 +1,89 @@
+#ifndef LAYOUT_H_INCLUDED
+#define LAYOUT_H_INCLUDED
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "font.h"
+
+// GLOBAL CONSTANTS
+
+#define MaxWordLength 100
+#define LineSpacing 2.0f
+
+#define DefaultPageHeight 200.0f // Usable height of one sheet below the origin (mm)
+#define DefaultTopMargin 0.0f
+#define DefaultBottomMargin 0.0f
+#define DefaultLeftMargin 0.0f
+#define DefaultLineLength 100.0f
+
+#define FontMarkup "{font="  // A word such as {font=Script.txt} switches to a font beside the job's font for the words after it
+#define FontMarkupReset "{font}" // Goes back to the job's font
+#define MaxLayoutFonts 16         // Fonts one document may switch between
+
+#define StreamWindow 256         // Placed words held for the sender when streaming; the layout waits beyond this
+#define StreamParagraphWords 256 // Words of one paragraph held when streaming before its finished lines are placed
+#define DefaultLatencyMs 500     // Longest streamed text waits for the rest of its line before it is drawn
+
+#define GreedyLineBreaks 0  // Wraps as soon as the next word does not fit
+#define OptimalLineBreaks 1 // Chooses breaks over the whole paragraph for the fewest, most even lines
+
+// STRUCTS
+
+typedef struct // Struct to hold the page model
+{
+    float Height; // Distance from the origin to the bottom edge of the drawing area
+    float TopMargin;
+    float BottomMargin;
+    float LeftMargin;
+    float LineLength; // Maximum width of a line, measured from the left margin
+    int LineBreakMode;
+} PageSettings;
+
+typedef struct // Struct to hold a word positioned on a page
+{
+    char Word[MaxWordLength];
+    Fixed X, Y; // Origin of the first character in page coordinates, in the fixed units G-code is generated in
+    int Page;   // Sheet number, starting from 1
+    const Font *pFont;
+} PlacedWord;
+
+typedef struct // Struct to hold a document being laid out by the background thread
+{
+    FILE *pInput;
+    float FontSize;
+    PageSettings Settings;
+
+    const Font *pJobFont;                   // Owned by the caller
+    const Font *pFont;                      // Font for the next word, changed by markup
+    const Font *pMarkupFonts[MaxLayoutFonts]; // Held from the font cache until FinishLayout
+    int MarkupFontCount;
+
+    PlacedWord *pWords; // Grows as the layout thread places words, or a ring of StreamWindow words when streaming
+    int WordCount;
+    int Capacity;
+    int Streaming;  // Memory stays bounded however long the input runs
+    int LatencyMs;  // When streaming, how long a partial line may wait for more input
+    int WordsTaken; // Words the sender has copied out, freeing their place in the ring
+    int PageCount; // Pages placed so far
+    int Finished;  // Set once the whole input has been laid out, or the layout has stopped short
+    int Failed;    // Memory ran out, so the words placed are not the whole document
+    Arena Memory;  // Words and paragraph buffers, used only by the layout thread and given back by FinishLayout
+
+    pthread_t Thread;
+    pthread_mutex_t Lock;
+    pthread_cond_t WordsAdded;
+    pthread_cond_t WordsFreed;
+} Layout;
+
+// FUNCTION DECLARATIONS
+
+void DefaultPageSettings(PageSettings *pSettings);
+int StartLayout(Layout *pLayout, const char *FileName, const Font *pFont, float FontSize, const PageSettings *pSettings);
+int StartLayoutStream(Layout *pLayout, FILE *pInput, const Font *pFont, float FontSize, const PageSettings *pSettings);
+int StartLayoutLive(Layout *pLayout, FILE *pInput, const Font *pFont, float FontSize, const PageSettings *pSettings, int LatencyMs);
+int WaitForWord(Layout *pLayout, int Index, PlacedWord *pWord); // -1 once every word is out, -2 if the layout failed
+void FinishLayout(Layout *pLayout);
+
+#endif // LAYOUT_H_INCLUDED
@@ -0,0 +1,162 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "platform.h"
+
+// Diagnostics from the serial link used to be printed as each line went out, so a slow console held up the
+// robot. Messages are now queued and written by a thread of their own. Each message spends a credit; credits
+// come back at LogRatePerSecond up to LogBurstLines, and a message that finds none (or a full queue) is
+// counted and reported as a single line instead.
+
+// STRUCTS
+
+typedef struct // Struct to hold one message waiting for the console
+{
+    char Text[LogLineLength];
+} LogEntry;
+
+// GLOBAL VARIABLES
+
+static pthread_once_t LogStarted = PTHREAD_ONCE_INIT;
+static pthread_mutex_t LogLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t LogQueued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t LogWritten = PTHREAD_COND_INITIALIZER;
+static pthread_t LogThread;
+
+static LogEntry Queue[LogQueueLength];
+static int QueueHead = 0, QueueCount = 0;
+static long long TotalQueued = 0, TotalWritten = 0; // Compared by FlushLog
+static long Dropped = 0;
+static long long Credit = LogBurstLines * 1000LL; // Thousandths of a message
+static long long LastRefillMs = 0;
+
+// FUNCTION DECLARATIONS
+
+static void StartLog(void);
+static void *WriteLog(void *pArgument);
+static int TakeCredit(void);
+
+// FUNCTIONS
+
+void LogMessage(const char *Format, ...)
+{
+    char Text[LogLineLength];
+    va_list Arguments;
+
+    va_start(Arguments, Format);
+    vsnprintf(Text, sizeof(Text), Format, Arguments);
+    va_end(Arguments);
+
+    size_t Length = strlen(Text); // Commands carry their own line ending, the writer adds one
+    while (Length > 0 && (Text[Length - 1] == '\n' || Text[Length - 1] == '\r'))
+    {
+        Text[--Length] = 0;
+    }
+
+    pthread_once(&LogStarted, StartLog);
+    pthread_mutex_lock(&LogLock);
+    if (QueueCount == LogQueueLength || !TakeCredit())
+    {
+        Dropped++;
+    }
+    else
+    {
+        memcpy(Queue[(QueueHead + QueueCount) % LogQueueLength].Text, Text, Length + 1);
+        QueueCount++;
+        TotalQueued++;
+        pthread_cond_signal(&LogQueued);
+    }
+    pthread_mutex_unlock(&LogLock);
+}
+
+void FlushLog(void)
+{
+    pthread_once(&LogStarted, StartLog);
+    pthread_mutex_lock(&LogLock);
+    long long Target = TotalQueued;
+    while (TotalWritten < Target || Dropped > 0)
+    {
+        pthread_cond_signal(&LogQueued); // Drops alone do not wake the writer, so it is woken to report them
+        pthread_cond_wait(&LogWritten, &LogLock);
+    }
+    pthread_mutex_unlock(&LogLock);
+}
+
+static void StartLog(void)
+{
+    LastRefillMs = MillisecondsNow();
+    if (pthread_create(&LogThread, NULL, WriteLog, NULL) != 0)
+    {
+        printf("Unable to start the log thread\n");
+        exit(1);
+    }
+    pthread_detach(LogThread);
+    atexit(FlushLog); // Messages queued just before the program ends still reach the console
+}
+
+// Called with LogLock held
+static int TakeCredit(void)
+{
+    long long Now = MillisecondsNow();
+
+    Credit += (Now - LastRefillMs) * LogRatePerSecond;
+    LastRefillMs = Now;
+    if (Credit > LogBurstLines * 1000LL)
+    {
+        Credit = LogBurstLines * 1000LL;
+    }
+    if (Credit < 1000)
+    {
+        return 0;
+    }
+    Credit -= 1000;
+    return 1;
+}
+
+static void *WriteLog(void *pArgument)
+{
+    (void)pArgument;
+    LogEntry Batch[LogQueueLength];
+
+    pthread_mutex_lock(&LogLock);
+    while (1)
+    {
+        while (QueueCount == 0 && Dropped == 0)
+        {
+            pthread_cond_wait(&LogQueued, &LogLock);
+        }
+
+        // Everything waiting is copied out at once so callers are never held up by the console
+        int Count = QueueCount;
+        for (int i = 0; i < Count; i++)
+        {
+            Batch[i] = Queue[(QueueHead + i) % LogQueueLength];
+        }
+        QueueHead = (QueueHead + Count) % LogQueueLength;
+        QueueCount = 0;
+        long Lost = Dropped;
+        Dropped = 0;
+        pthread_mutex_unlock(&LogLock);
+
+        for (int i = 0; i < Count; i++)
+        {
+            fputs(Batch[i].Text, stdout);
+            fputc('\n', stdout);
+        }
+        if (Lost > 0)
+        {
+            printf("(%ld log messages dropped)\n", Lost);
+        }
+        fflush(stdout);
+
+        pthread_mutex_lock(&LogLock);
+        TotalWritten += Count;
+        pthread_cond_broadcast(&LogWritten);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,16 @@
+#ifndef LOG_H_INCLUDED
+#define LOG_H_INCLUDED
+
+// GLOBAL CONSTANTS
+
+#define LogQueueLength 256   // Messages waiting for the console before further ones are dropped
+#define LogLineLength 160    // Longer messages are cut short
+#define LogRatePerSecond 100 // Messages written per second once a burst has used up its allowance
+#define LogBurstLines 200
+
+// FUNCTION DECLARATIONS
+
+void LogMessage(const char *Format, ...); // Queues one line for the console without waiting for it
+void FlushLog(void);                      // Returns once everything queued so far has been written
+
+#endif // LOG_H_INCLUDED
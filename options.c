@@ -0,0 +1,464 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "font.h"
+#include "gcodecache.h"
+#include "layout.h"
+#include "options.h"
+#include "serial.h"
+
+// Every setting can be given on the command line as --name value or --name=value, or in a config file as
+// "name = value" lines, with # starting a comment. RobotWriter.conf is read when it exists, or the file named by
+// --config instead, and the command line is applied after it so a run can override any line of the file.
+
+// GLOBAL CONSTANTS
+
+#define MaxConfigLine 512
+#define Quote(Value) #Value
+#define QuoteValue(Value) Quote(Value) // Puts a numeric default into the help text
+
+// STRUCTS
+
+typedef struct // Struct to hold the help text for one option
+{
+    const char *Name;
+    const char *Value;
+    const char *Help;
+} OptionHelp;
+
+// GLOBAL VARIABLES
+
+static const OptionHelp Usage[] = {
+    {"config", "FILE", "read settings from FILE instead of " DefaultConfigFile},
+    {"input", "FILE", "text to write (default " DefaultInputFile "), an .svg drawing to plot, or " StandardInput " to stream text from stdin"},
+    {"output", "SINK", RobotOutput " for the serial port, " ConsoleOutput " for the console, or a file for the G-code"},
+    {"font", "FILE", "font file (default " DefaultFontFile "); a job for a daemon names one in the daemon's font folder"},
+    {"size", "MM", "font size between 4 and 10; asked for when not given"},
+    {"port", "PORT", "comports[] index, a device path, or " AutoPort " to look for the robot (default " QuoteValue(DefaultSerialPort) ")"},
+    {"baud", "RATE|auto", "serial baud rate, any the adapter can do, or auto to find the fastest (default " QuoteValue(DefaultBaudRate) ")"},
+    {"low-latency", "on|off", "have the serial driver pass on each reply at once"},
+    {"feed", "RATE", "drawing feed rate in mm/min (default " QuoteValue(DefaultFeedRate) ")"},
+    {"kerning", "on|off", "tighten awkward character pairs (default off); a daemon uses its own setting for every job"},
+    {"arcs", "on|off", "draw runs of strokes that follow a circle as single G2/G3 arcs"},
+    {"line-breaks", "greedy|optimal", "how paragraphs are broken into lines"},
+    {"pipeline", "on|off", "keep the robot's receive buffer full instead of waiting for each ok"},
+    {"cache", "on|off", "replay repeated jobs from " GCodeCacheFolder},
+    {"page-height", "MM", "usable height of one sheet"},
+    {"top-margin", "MM", "space kept clear above the first line"},
+    {"bottom-margin", "MM", "space kept clear at the foot of each sheet"},
+    {"left-margin", "MM", "where each line starts"},
+    {"line-length", "MM", "longest line, measured from the left margin"},
+    {"socket", "PATH", "where the daemon takes jobs (default " DefaultSocketPath ")"},
+    {"priority", "N", "jobs with a higher priority leave the daemon's queue first (default 0)"},
+    {"daemon", NULL, "keep the robot awake and the fonts loaded, taking jobs over the socket"},
+    {"submit", NULL, "send the input to the daemon instead of drawing it here"},
+    {"latency", "MS", "longest streamed text waits for the rest of its line (default " QuoteValue(DefaultLatencyMs) ")"},
+    {"resume", NULL, "carry on from the last checkpoint"},
+    {"help", NULL, "show this list"},
+};
+
+// FUNCTION DECLARATIONS
+
+static int ParseSwitch(const char *Value, int *pSwitch);
+static int ParseFloat(const char *Value, float Min, float Max, float *pNumber);
+static int ParseInteger(const char *Value, long Min, long Max, int *pNumber);
+static int CopyText(const char *Value, char *Text);
+static char *Trim(char *Text);
+
+// FUNCTIONS
+
+void DefaultJobOptions(JobOptions *pOptions)
+{
+    memset(pOptions, 0, sizeof(JobOptions));
+    strcpy(pOptions->InputFile, DefaultInputFile);
+    strcpy(pOptions->OutputFile, ConsoleOutput);
+    strcpy(pOptions->FontFile, DefaultFontFile);
+    snprintf(pOptions->Port, sizeof(pOptions->Port), "%d", DefaultSerialPort);
+    pOptions->BaudRate = DefaultBaudRate;
+    pOptions->LowLatency = 1;
+    pOptions->FeedRate = DefaultFeedRate;
+    pOptions->Kerning = 0; // Off unless asked for, so existing jobs draw as they always have
+    pOptions->Cache = 1;
+    DefaultPageSettings(&pOptions->Page);
+    strcpy(pOptions->SocketPath, DefaultSocketPath);
+    pOptions->LatencyMs = DefaultLatencyMs;
+}
+
+int ParseArguments(JobOptions *pOptions, int argc, char *argv[])
+{
+    // The config file comes first wherever --config appears, so the rest of the command line overrides it
+    const char *ConfigFile = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+        {
+            ConfigFile = argv[i + 1];
+        }
+        else if (strncmp(argv[i], "--config=", 9) == 0)
+        {
+            ConfigFile = argv[i] + 9;
+        }
+    }
+
+    if (ConfigFile != NULL)
+    {
+        if (ReadConfigFile(pOptions, ConfigFile) != 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        FILE *pDefault = fopen(DefaultConfigFile, "r");
+        if (pDefault != NULL)
+        {
+            fclose(pDefault);
+            if (ReadConfigFile(pOptions, DefaultConfigFile) != 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *Argument = argv[i];
+
+        if (strcmp(Argument, "--help") == 0 || strcmp(Argument, "-h") == 0)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        if (strcmp(Argument, "--resume") == 0)
+        {
+            pOptions->Resume = 1;
+            continue;
+        }
+        if (strcmp(Argument, "--daemon") == 0)
+        {
+            pOptions->Daemon = 1;
+            continue;
+        }
+        if (strcmp(Argument, "--submit") == 0)
+        {
+            pOptions->Submit = 1;
+            continue;
+        }
+        if (strncmp(Argument, "--", 2) != 0) // A bare argument is the text to write, or - for stdin
+        {
+            if (SetOption(pOptions, "input", Argument) != 0)
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        char Name[64];
+        const char *Value;
+        const char *pEquals = strchr(Argument, '=');
+        if (pEquals != NULL)
+        {
+            snprintf(Name, sizeof(Name), "%.*s", (int)(pEquals - Argument - 2), Argument + 2);
+            Value = pEquals + 1;
+        }
+        else if (i + 1 < argc)
+        {
+            snprintf(Name, sizeof(Name), "%s", Argument + 2);
+            Value = argv[++i];
+        }
+        else
+        {
+            printf("%s needs a value, see --help\n", Argument);
+            return -1;
+        }
+
+        if (strcmp(Name, "config") == 0) // Already read
+        {
+            continue;
+        }
+        if (SetOption(pOptions, Name, Value) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int ReadConfigFile(JobOptions *pOptions, const char *FileName)
+{
+    FILE *pFile = fopen(FileName, "r");
+    if (pFile == NULL)
+    {
+        printf("Could not open %s\n", FileName);
+        return -1;
+    }
+
+    int Result = ReadSettings(pOptions, pFile, FileName, NULL);
+    fclose(pFile);
+    return Result;
+}
+
+int ReadSettings(JobOptions *pOptions, FILE *pFile, const char *Source, const char *EndLine)
+{
+    char Line[MaxConfigLine];
+    int LineNumber = 0;
+    while (fgets(Line, sizeof(Line), pFile) != NULL)
+    {
+        LineNumber++;
+        Line[strcspn(Line, "#\r\n")] = '\0';
+
+        char *Name = Trim(Line);
+        if (EndLine != NULL && strcmp(Name, EndLine) == 0)
+        {
+            return 0;
+        }
+        if (*Name == '\0')
+        {
+            continue;
+        }
+
+        char *pEquals = strchr(Name, '=');
+        if (pEquals == NULL)
+        {
+            printf("%s:%d: expected name = value\n", Source, LineNumber);
+            return -1;
+        }
+        *pEquals = '\0';
+
+        if (SetOption(pOptions, Trim(Name), Trim(pEquals + 1)) != 0)
+        {
+            printf("  in %s at line %d\n", Source, LineNumber);
+            return -1;
+        }
+    }
+
+    if (EndLine != NULL) // Ran out before the settings were finished
+    {
+        printf("%s: no \"%s\" line after the settings\n", Source, EndLine);
+        return -1;
+    }
+    return 0;
+}
+
+void WriteJobSettings(const JobOptions *pOptions, FILE *pFile) // Only what can change from one job to the next
+{
+    const PageSettings *pPage = &pOptions->Page;
+
+    fprintf(pFile, "input = %s\n", pOptions->InputFile);
+    fprintf(pFile, "font = %s\n", pOptions->FontFile);
+    if (pOptions->FontSize != 0.0f) // Left out for a drawing, which is fitted to the page instead
+    {
+        fprintf(pFile, "size = %g\n", pOptions->FontSize);
+    }
+    fprintf(pFile, "line-breaks = %s\n", pPage->LineBreakMode == OptimalLineBreaks ? "optimal" : "greedy");
+    fprintf(pFile, "kerning = %s\n", pOptions->Kerning ? "on" : "off");
+    fprintf(pFile, "arcs = %s\n", pOptions->Arcs ? "on" : "off");
+    fprintf(pFile, "cache = %s\n", pOptions->Cache ? "on" : "off");
+    fprintf(pFile, "page-height = %g\ntop-margin = %g\nbottom-margin = %g\nleft-margin = %g\nline-length = %g\n",
+            pPage->Height, pPage->TopMargin, pPage->BottomMargin, pPage->LeftMargin, pPage->LineLength);
+    fprintf(pFile, "priority = %d\n", pOptions->Priority);
+}
+
+int SetOption(JobOptions *pOptions, const char *Name, const char *Value)
+{
+    int Result;
+
+    if (strcmp(Name, "input") == 0)
+    {
+        Result = CopyText(Value, pOptions->InputFile);
+    }
+    else if (strcmp(Name, "output") == 0)
+    {
+        Result = CopyText(Value, pOptions->OutputFile);
+    }
+    else if (strcmp(Name, "font") == 0)
+    {
+        Result = CopyText(Value, pOptions->FontFile);
+    }
+    else if (strcmp(Name, "size") == 0)
+    {
+        Result = ParseFloat(Value, MinFontSize, MaxFontSize, &pOptions->FontSize);
+    }
+    else if (strcmp(Name, "port") == 0)
+    {
+        Result = CopyText(Value, pOptions->Port);
+    }
+    else if (strcmp(Name, "baud") == 0)
+    {
+        if (strcmp(Value, "auto") == 0)
+        {
+            pOptions->BaudRate = AutoBaudRate;
+            Result = 0;
+        }
+        else
+        {
+            Result = ParseInteger(Value, 1, 100000000, &pOptions->BaudRate);
+        }
+    }
+    else if (strcmp(Name, "low-latency") == 0)
+    {
+        Result = ParseSwitch(Value, &pOptions->LowLatency);
+    }
+    else if (strcmp(Name, "feed") == 0)
+    {
+        Result = ParseInteger(Value, 1, 100000, &pOptions->FeedRate);
+    }
+    else if (strcmp(Name, "kerning") == 0)
+    {
+        Result = ParseSwitch(Value, &pOptions->Kerning);
+    }
+    else if (strcmp(Name, "arcs") == 0)
+    {
+        Result = ParseSwitch(Value, &pOptions->Arcs);
+    }
+    else if (strcmp(Name, "pipeline") == 0)
+    {
+        Result = ParseSwitch(Value, &pOptions->Pipeline);
+    }
+    else if (strcmp(Name, "cache") == 0)
+    {
+        Result = ParseSwitch(Value, &pOptions->Cache);
+    }
+    else if (strcmp(Name, "latency") == 0)
+    {
+        Result = ParseInteger(Value, 1, 3600000, &pOptions->LatencyMs);
+    }
+    else if (strcmp(Name, "socket") == 0)
+    {
+        Result = CopyText(Value, pOptions->SocketPath);
+    }
+    else if (strcmp(Name, "priority") == 0)
+    {
+        Result = ParseInteger(Value, -1000, 1000, &pOptions->Priority);
+    }
+    else if (strcmp(Name, "line-breaks") == 0)
+    {
+        Result = 0;
+        if (strcmp(Value, "greedy") == 0)
+        {
+            pOptions->Page.LineBreakMode = GreedyLineBreaks;
+        }
+        else if (strcmp(Value, "optimal") == 0)
+        {
+            pOptions->Page.LineBreakMode = OptimalLineBreaks;
+        }
+        else
+        {
+            Result = -1;
+        }
+    }
+    else if (strcmp(Name, "page-height") == 0)
+    {
+        Result = ParseFloat(Value, 1.0f, 10000.0f, &pOptions->Page.Height);
+    }
+    else if (strcmp(Name, "top-margin") == 0)
+    {
+        Result = ParseFloat(Value, 0.0f, 10000.0f, &pOptions->Page.TopMargin);
+    }
+    else if (strcmp(Name, "bottom-margin") == 0)
+    {
+        Result = ParseFloat(Value, 0.0f, 10000.0f, &pOptions->Page.BottomMargin);
+    }
+    else if (strcmp(Name, "left-margin") == 0)
+    {
+        Result = ParseFloat(Value, 0.0f, 10000.0f, &pOptions->Page.LeftMargin);
+    }
+    else if (strcmp(Name, "line-length") == 0)
+    {
+        Result = ParseFloat(Value, 1.0f, 10000.0f, &pOptions->Page.LineLength);
+    }
+    else
+    {
+        printf("Unknown option %s, see --help\n", Name);
+        return -1;
+    }
+
+    if (Result != 0)
+    {
+        printf("Invalid value for %s: %s\n", Name, Value);
+    }
+    return Result;
+}
+
+void PrintUsage(const char *Program)
+{
+    printf("Usage: %s [options] [input file]\n\n", Program);
+    for (size_t i = 0; i < sizeof(Usage) / sizeof(Usage[0]); i++)
+    {
+        char Option[48];
+        snprintf(Option, sizeof(Option), "--%s%s%s", Usage[i].Name, Usage[i].Value ? " " : "", Usage[i].Value ? Usage[i].Value : "");
+        printf("  %-30s %s\n", Option, Usage[i].Help);
+    }
+    printf("\nThe same names can be used as \"name = value\" lines in %s\n", DefaultConfigFile);
+}
+
+static int ParseSwitch(const char *Value, int *pSwitch)
+{
+    if (strcmp(Value, "on") == 0 || strcmp(Value, "yes") == 0 || strcmp(Value, "1") == 0)
+    {
+        *pSwitch = 1;
+    }
+    else if (strcmp(Value, "off") == 0 || strcmp(Value, "no") == 0 || strcmp(Value, "0") == 0)
+    {
+        *pSwitch = 0;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static int ParseFloat(const char *Value, float Min, float Max, float *pNumber)
+{
+    char *pEnd;
+    errno = 0;
+    float Number = strtof(Value, &pEnd);
+    if (pEnd == Value || *pEnd != '\0' || errno != 0 || !(Number >= Min && Number <= Max))
+    {
+        return -1;
+    }
+    *pNumber = Number;
+    return 0;
+}
+
+static int ParseInteger(const char *Value, long Min, long Max, int *pNumber)
+{
+    char *pEnd;
+    errno = 0;
+    long Number = strtol(Value, &pEnd, 10);
+    if (pEnd == Value || *pEnd != '\0' || errno != 0 || Number < Min || Number > Max)
+    {
+        return -1;
+    }
+    *pNumber = (int)Number;
+    return 0;
+}
+
+static int CopyText(const char *Value, char *Text)
+{
+    if (*Value == '\0' || strlen(Value) >= MaxOptionLength)
+    {
+        return -1;
+    }
+    strcpy(Text, Value);
+    return 0;
+}
+
+static char *Trim(char *Text)
+{
+    while (isspace((unsigned char)*Text))
+    {
+        Text++;
+    }
+    size_t Length = strlen(Text);
+    while (Length > 0 && isspace((unsigned char)Text[Length - 1]))
+    {
+        Text[--Length] = '\0';
+    }
+    return Text;
+}
@@ -0,0 +1,62 @@
+#ifndef OPTIONS_H_INCLUDED
+#define OPTIONS_H_INCLUDED
+
+#include <stdio.h>
+
+#include "layout.h"
+
+// GLOBAL CONSTANTS
+
+#define DefaultConfigFile "RobotWriter.conf" // Read when present, before the command line
+#define DefaultInputFile "TestData.txt"
+#define MaxOptionLength 260
+
+#define RobotOutput "robot" // Output sink that sends the G-code over the serial port
+#define ConsoleOutput "-"   // Output sink that prints the G-code; anything else names a file
+#define StandardInput "-"   // Input that streams text from stdin as it arrives
+#define AutoPort "auto"     // Port that has every comports[] entry probed for the robot
+
+#define MinFontSize 4.0f
+#define MaxFontSize 10.0f
+#define DefaultFeedRate 1000 // Drawing speed set by the start-up G1 (mm/min)
+#define DefaultSocketPath "/tmp/RobotWriter.sock" // Where the daemon takes jobs
+
+// STRUCTS
+
+typedef struct // Struct to hold everything that decides how one job is run
+{
+    char InputFile[MaxOptionLength];
+    char OutputFile[MaxOptionLength]; // RobotOutput, ConsoleOutput or a file to write the G-code to
+    char FontFile[MaxOptionLength];
+    float FontSize; // 0 until given, in which case the job asks for it
+
+    char Port[MaxOptionLength]; // comports[] index, a device path such as /dev/ttyUSB0, or AutoPort
+    int BaudRate;   // AutoBaudRate to probe for the fastest the controller answers at
+    int LowLatency; // Ask USB serial adapters to pass on replies at once
+    int FeedRate;
+
+    int Kerning;
+    int Arcs; // Write runs of strokes that follow a circle as single G2/G3 arcs
+    int Pipeline;
+    int Cache;
+    PageSettings Page; // Includes the line breaking pass
+    int LatencyMs;     // How long streamed text waits for the rest of its line
+
+    int Resume;
+    int Daemon;   // Keep the robot and fonts ready and take jobs over SocketPath
+    int Submit;   // Hand the job to a running daemon instead of drawing it
+    int Priority; // Higher priority jobs are taken from the daemon's queue first
+    char SocketPath[MaxOptionLength];
+} JobOptions;
+
+// FUNCTION DECLARATIONS
+
+void DefaultJobOptions(JobOptions *pOptions);
+int ParseArguments(JobOptions *pOptions, int argc, char *argv[]); // 0 to run, 1 when only help was asked for, -1 on error
+int ReadConfigFile(JobOptions *pOptions, const char *FileName);
+int ReadSettings(JobOptions *pOptions, FILE *pFile, const char *Source, const char *EndLine); // Stops at EndLine if given
+void WriteJobSettings(const JobOptions *pOptions, FILE *pFile);
+int SetOption(JobOptions *pOptions, const char *Name, const char *Value);
+void PrintUsage(const char *Program);
+
+#endif // OPTIONS_H_INCLUDED
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+
+#if !defined(_WIN32)
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+
+void Sleep(unsigned int Milliseconds)
+{
+    struct timespec Delay = {(time_t)(Milliseconds / 1000), (long)(Milliseconds % 1000) * 1000000L};
+    nanosleep(&Delay, NULL);
+}
+
+int getch(void) // Reads one key without waiting for Enter or echoing it, like the conio version
+{
+    struct termios Saved, Raw;
+
+    if (tcgetattr(STDIN_FILENO, &Saved) != 0) // Not a terminal, so just read the next character
+    {
+        return getchar();
+    }
+
+    Raw = Saved;
+    Raw.c_lflag &= ~(tcflag_t)(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &Raw);
+    int Key = getchar();
+    tcsetattr(STDIN_FILENO, TCSANOW, &Saved);
+
+    return Key;
+}
+
+int MakeFolder(const char *Folder) // Succeeds if the folder is already there
+{
+    return (mkdir(Folder, 0777) == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+int ListFiles(const char *Folder, const char *Suffix, FileInfo **ppFiles) // Returns the count, or -1
+{
+    DIR *pFolder = opendir(Folder);
+    if (pFolder == NULL)
+    {
+        return -1;
+    }
+
+    int Count = 0, Capacity = 0;
+    *ppFiles = NULL;
+    struct dirent *pEntry;
+    size_t SuffixLength = strlen(Suffix);
+
+    while ((pEntry = readdir(pFolder)) != NULL)
+    {
+        size_t Length = strlen(pEntry->d_name);
+        if (Length < SuffixLength || Length >= MaxFileNameLength || strcmp(pEntry->d_name + Length - SuffixLength, Suffix) != 0)
+        {
+            continue;
+        }
+
+        char Path[2 * MaxFileNameLength];
+        struct stat Status;
+        snprintf(Path, sizeof(Path), "%s/%s", Folder, pEntry->d_name);
+        if (stat(Path, &Status) != 0 || !S_ISREG(Status.st_mode))
+        {
+            continue;
+        }
+
+        if (Count == Capacity)
+        {
+            Capacity = Capacity ? Capacity * 2 : 64;
+            FileInfo *pGrown = realloc(*ppFiles, (size_t)Capacity * sizeof(FileInfo));
+            if (pGrown == NULL)
+            {
+                break;
+            }
+            *ppFiles = pGrown;
+        }
+
+        FileInfo *pFile = &(*ppFiles)[Count++];
+        memcpy(pFile->Name, pEntry->d_name, Length + 1);
+        pFile->Bytes = (long long)Status.st_size;
+        pFile->Modified = (long long)Status.st_mtime;
+    }
+
+    closedir(pFolder);
+    return Count;
+}
+
+void TouchFile(const char *Path) // Marks a file as just used
+{
+    utime(Path, NULL);
+}
+
+int MoveIntoPlace(const char *From, const char *To) // Atomic where the system allows it
+{
+    return rename(From, To);
+}
+
+int ProcessId(void)
+{
+    return (int)getpid();
+}
+
+long long MillisecondsNow(void)
+{
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (long long)Now.tv_sec * 1000 + Now.tv_nsec / 1000000;
+}
+
+int WaitForInput(FILE *pFile, int TimeoutMs) // pFile must be unbuffered, or bytes already read ahead are not seen
+{
+    struct pollfd Input = {fileno(pFile), POLLIN, 0};
+    int Ready;
+    do
+    {
+        Ready = poll(&Input, 1, TimeoutMs);
+    } while (Ready < 0 && errno == EINTR);
+
+    return Ready == 0 ? 0 : 1; // Errors and hang-ups are left for the next read to report
+}
+
+#else
+
+#include <direct.h>
+#include <sys/utime.h>
+
+int MakeFolder(const char *Folder)
+{
+    return (CreateDirectoryA(Folder, NULL) || GetLastError() == ERROR_ALREADY_EXISTS) ? 0 : -1;
+}
+
+int ListFiles(const char *Folder, const char *Suffix, FileInfo **ppFiles)
+{
+    char Pattern[2 * MaxFileNameLength];
+    snprintf(Pattern, sizeof(Pattern), "%s\\*%s", Folder, Suffix);
+
+    WIN32_FIND_DATAA Found;
+    HANDLE Search = FindFirstFileA(Pattern, &Found);
+    *ppFiles = NULL;
+    if (Search == INVALID_HANDLE_VALUE)
+    {
+        return (GetLastError() == ERROR_FILE_NOT_FOUND) ? 0 : -1;
+    }
+
+    int Count = 0, Capacity = 0;
+    do
+    {
+        if (Found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            continue;
+        }
+        if (Count == Capacity)
+        {
+            Capacity = Capacity ? Capacity * 2 : 64;
+            FileInfo *pGrown = realloc(*ppFiles, (size_t)Capacity * sizeof(FileInfo));
+            if (pGrown == NULL)
+            {
+                break;
+            }
+            *ppFiles = pGrown;
+        }
+
+        FileInfo *pFile = &(*ppFiles)[Count++];
+        snprintf(pFile->Name, sizeof(pFile->Name), "%s", Found.cFileName);
+        pFile->Bytes = ((long long)Found.nFileSizeHigh << 32) | Found.nFileSizeLow;
+        ULARGE_INTEGER Time = {{Found.ftLastWriteTime.dwLowDateTime, Found.ftLastWriteTime.dwHighDateTime}};
+        pFile->Modified = (long long)(Time.QuadPart / 10000000ULL) - 11644473600LL; // 100 ns ticks since 1601
+    } while (FindNextFileA(Search, &Found));
+
+    FindClose(Search);
+    return Count;
+}
+
+void TouchFile(const char *Path)
+{
+    _utime(Path, NULL);
+}
+
+int MoveIntoPlace(const char *From, const char *To)
+{
+    return MoveFileExA(From, To, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+}
+
+int ProcessId(void)
+{
+    return (int)GetCurrentProcessId();
+}
+
+long long MillisecondsNow(void)
+{
+    return (long long)GetTickCount64();
+}
+
+int WaitForInput(FILE *pFile, int TimeoutMs) // Pipes and consoles cannot be waited on alike here, so reads just block
+{
+    (void)pFile;
+    (void)TimeoutMs;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef PLATFORM_H_INCLUDED
+#define PLATFORM_H_INCLUDED
+
+// Windows provides Sleep() and getch() itself; everywhere else they are supplied by platform.c. The folder
+// helpers below are implemented for both.
+
+#include <stdio.h>
+
+#if defined(_WIN32)
+
+#include <conio.h>
+#include <windows.h>
+
+#else
+
+void Sleep(unsigned int Milliseconds);
+int getch(void);
+
+#endif
+
+// GLOBAL CONSTANTS
+
+#define MaxFileNameLength 260
+
+// STRUCTS
+
+typedef struct // Struct to hold one file found in a folder
+{
+    char Name[MaxFileNameLength]; // Without the folder
+    long long Bytes;
+    long long Modified; // Seconds since the epoch
+} FileInfo;
+
+// FUNCTION DECLARATIONS
+
+int MakeFolder(const char *Folder);
+int ListFiles(const char *Folder, const char *Suffix, FileInfo **ppFiles);
+void TouchFile(const char *Path);
+int MoveIntoPlace(const char *From, const char *To);
+int ProcessId(void);
+long long MillisecondsNow(void);                    // Monotonic clock for timeouts
+int WaitForInput(FILE *pFile, int TimeoutMs);       // 1 once pFile has data or has ended, 0 if none came in time
+
+#endif // PLATFORM_H_INCLUDED
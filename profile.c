@@ -0,0 +1,182 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "profile.h"
+
+#if PROFILING == 1
+
+#if !defined(__linux__) && !defined(__FreeBSD__)
+#include <windows.h>
+#endif
+
+#ifdef SIGUSR1
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// STRUCTS
+
+typedef struct // Struct to hold the running totals for one stage
+{
+    atomic_llong Calls;
+    atomic_llong TotalNs;
+    atomic_llong MaxNs;
+} StageTimer;
+
+// GLOBAL VARIABLES
+
+// Stages are updated from both the layout thread and the sender, so every total is atomic
+static StageTimer Timers[StageCount];
+static atomic_llong Counters[CounterCount];
+static atomic_llong Histograms[HistogramCount][HistogramBuckets];
+#ifdef SIGUSR1
+static int DumpPipe[2] = {-1, -1}; // The signal handler writes a byte here and the watcher thread prints the table
+#endif
+
+static const char *StageNames[StageCount] = {"Font load", "Kerning", "Layout", "Measure words", "Line breaking",
+                                             "Emit G-code", "Write", "Reply wait", "Sleep"};
+static const char *CounterNames[CounterCount] = {"Words", "Commands", "Bytes sent", "Retries", "Errors", "Timeouts"};
+static const char *HistogramNames[HistogramCount] = {"Reply latency (us)", "Bytes per line"};
+
+// FUNCTIONS
+
+long long ProfileNow(void) // Monotonic time in nanoseconds
+{
+#if defined(__linux__) || defined(__FreeBSD__)
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (long long)Now.tv_sec * 1000000000 + Now.tv_nsec;
+#else
+    static LARGE_INTEGER Frequency;
+    LARGE_INTEGER Now;
+    if (Frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&Frequency);
+    }
+    QueryPerformanceCounter(&Now);
+    return (long long)(Now.QuadPart * (1000000000.0 / (double)Frequency.QuadPart));
+#endif
+}
+
+long long ProfileRecord(int Stage, long long StartTime)
+{
+    long long Elapsed = ProfileNow() - StartTime;
+    StageTimer *pTimer = &Timers[Stage];
+
+    atomic_fetch_add_explicit(&pTimer->Calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pTimer->TotalNs, Elapsed, memory_order_relaxed);
+
+    long long Max = atomic_load_explicit(&pTimer->MaxNs, memory_order_relaxed);
+    while (Elapsed > Max && !atomic_compare_exchange_weak(&pTimer->MaxNs, &Max, Elapsed))
+    {
+    }
+
+    return Elapsed;
+}
+
+void ProfileCount(int Counter, long long Amount)
+{
+    atomic_fetch_add_explicit(&Counters[Counter], Amount, memory_order_relaxed);
+}
+
+void ProfileSample(int Histogram, long long Value)
+{
+    int Bucket = 0;
+    while (Value > 1 && Bucket < HistogramBuckets - 1) // Bucket n holds values from 2^(n-1) + 1 up to 2^n
+    {
+        Value = (Value + 1) / 2;
+        Bucket++;
+    }
+    atomic_fetch_add_explicit(&Histograms[Histogram][Bucket], 1, memory_order_relaxed);
+}
+
+#ifdef SIGUSR1
+static void RequestDump(int Signal) // Printing is not safe inside a signal handler, but write() is
+{
+    char Byte = 0;
+    ssize_t Written = write(DumpPipe[1], &Byte, 1);
+    (void)Signal;
+    (void)Written; // A full pipe already has a dump on the way
+}
+
+// Prints the table whenever it is asked for, so a job that is idle or blocked on the robot still answers
+static void *WatchForDumps(void *pArgument)
+{
+    char Byte;
+    ssize_t Read;
+    (void)pArgument;
+
+    while ((Read = read(DumpPipe[0], &Byte, 1)) != 0)
+    {
+        if (Read > 0)
+        {
+            PrintProfile();
+        }
+        else if (errno != EINTR)
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+#endif
+
+static void PrintProfileAtExit(void)
+{
+    PrintProfile();
+}
+
+void StartProfiling(void)
+{
+    atexit(PrintProfileAtExit);
+#ifdef SIGUSR1
+    pthread_t Watcher;
+    if (pipe(DumpPipe) == 0 && fcntl(DumpPipe[1], F_SETFL, O_NONBLOCK) == 0 && pthread_create(&Watcher, NULL, WatchForDumps, NULL) == 0)
+    {
+        pthread_detach(Watcher);
+        signal(SIGUSR1, RequestDump); // kill -USR1 <pid> prints the table without stopping the job
+    }
+#endif
+}
+
+void PrintProfile(void)
+{
+    fprintf(stderr, "\n%-16s %10s %12s %12s %12s\n", "Stage", "Calls", "Total ms", "Mean us", "Max us");
+    for (int Stage = 0; Stage < StageCount; Stage++)
+    {
+        long long Calls = atomic_load(&Timers[Stage].Calls);
+        long long TotalNs = atomic_load(&Timers[Stage].TotalNs);
+        if (Calls == 0)
+        {
+            continue;
+        }
+        fprintf(stderr, "%-16s %10lld %12.3f %12.3f %12.3f\n", StageNames[Stage], Calls, TotalNs / 1e6,
+                TotalNs / 1e3 / (double)Calls, atomic_load(&Timers[Stage].MaxNs) / 1e3);
+    }
+
+    fprintf(stderr, "\n");
+    for (int Counter = 0; Counter < CounterCount; Counter++)
+    {
+        fprintf(stderr, "%-16s %10lld\n", CounterNames[Counter], (long long)atomic_load(&Counters[Counter]));
+    }
+
+    for (int Histogram = 0; Histogram < HistogramCount; Histogram++)
+    {
+        fprintf(stderr, "\n%s\n", HistogramNames[Histogram]);
+        for (int Bucket = 0; Bucket < HistogramBuckets; Bucket++)
+        {
+            long long Samples = atomic_load(&Histograms[Histogram][Bucket]);
+            if (Samples > 0)
+            {
+                fprintf(stderr, "  <= %-12lld %10lld\n", 1LL << Bucket, Samples);
+            }
+        }
+    }
+}
+
+#endif
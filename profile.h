@@ -0,0 +1,69 @@
+#ifndef PROFILE_H_INCLUDED
+#define PROFILE_H_INCLUDED
+
+// MODE OPTIONS
+
+#ifndef PROFILING
+#define PROFILING 1 // Set to 0 (or build with -DPROFILING=0) to compile every timer and counter out
+#endif
+
+// GLOBAL CONSTANTS
+
+// Timed stages, reported in this order
+#define StageFontLoad 0
+#define StageKerning 1
+#define StageLayout 2 // Whole layout thread, includes measuring and line breaking
+#define StageMeasure 3 // CalculateWordWidth
+#define StageLineBreak 4
+#define StageEmit 5 // GenerateGCode per word, includes writing and waiting in robot mode
+#define StageWrite 6 // Serial writes by the I/O thread
+#define StageReplyWait 7 // Waiting for the I/O thread to bring back replies
+#define StageSleep 8 // Fixed delay after each command
+#define StageCount 9
+
+// Event counters
+#define CounterWords 0
+#define CounterCommands 1
+#define CounterBytesSent 2
+#define CounterRetries 3
+#define CounterErrors 4
+#define CounterTimeouts 5
+#define CounterCount 6
+
+// Histograms
+#define HistogramReplyLatency 0 // Microseconds from a line being written to its reply, power-of-two buckets
+#define HistogramLineBytes 1 // Bytes per command, power-of-two buckets
+#define HistogramCount 2
+
+#define HistogramBuckets 32
+
+// FUNCTION DECLARATIONS
+
+#if PROFILING == 1
+
+long long ProfileNow(void);
+long long ProfileRecord(int Stage, long long StartTime);
+void ProfileCount(int Counter, long long Amount);
+void ProfileSample(int Histogram, long long Value);
+void StartProfiling(void);
+void PrintProfile(void);
+
+#define PROFILE_START(Name) long long ProfileStart_##Name = ProfileNow()
+#define PROFILE_STOP(Stage, Name) ProfileRecord(Stage, ProfileStart_##Name)
+#define PROFILE_STOP_SAMPLE(Stage, Name, Histogram) ProfileSample(Histogram, ProfileRecord(Stage, ProfileStart_##Name) / 1000)
+#define PROFILE_COUNT(Counter, Amount) ProfileCount(Counter, Amount)
+#define PROFILE_SAMPLE(Histogram, Value) ProfileSample(Histogram, Value)
+
+#else
+
+#define PROFILE_START(Name)
+#define PROFILE_STOP(Stage, Name)
+#define PROFILE_STOP_SAMPLE(Stage, Name, Histogram)
+#define PROFILE_COUNT(Counter, Amount)
+#define PROFILE_SAMPLE(Histogram, Value)
+#define StartProfiling()
+#define PrintProfile()
+
+#endif
+
+#endif // PROFILE_H_INCLUDED
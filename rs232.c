@@ -45,6 +45,31 @@ int Cport[RS232_PORTNR],
 struct termios new_port_settings,
            old_port_settings[RS232_PORTNR];
 
+#if defined(__linux__) && defined(TCGETS2)
+
+#define RS232_TERMIOS2
+
+/* <asm/termbits.h> has this too but cannot be included alongside <termios.h> */
+struct termios2
+{
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t c_line;
+    cc_t c_cc[19];
+    speed_t c_ispeed;
+    speed_t c_ospeed;
+};
+
+#ifndef BOTHER
+#define BOTHER CBAUDEX
+#endif
+
+static int RS232_SetCustomBaud(int, int);
+
+#endif
+
 char *comports[RS232_PORTNR]= {"/dev/ttyS0","/dev/ttyS1","/dev/ttyS2","/dev/ttyS3","/dev/ttyS4","/dev/ttyS5",
                                "/dev/ttyS6","/dev/ttyS7","/dev/ttyS8","/dev/ttyS9","/dev/ttyS10","/dev/ttyS11",
                                "/dev/ttyS12","/dev/ttyS13","/dev/ttyS14","/dev/ttyS15","/dev/ttyUSB0",
@@ -58,7 +83,8 @@ char *comports[RS232_PORTNR]= {"/dev/ttyS0","/dev/ttyS1","/dev/ttyS2","/dev/ttyS
 int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
 {
     int baudr,
-        status;
+        status,
+        custom_baud=0;
 
     if((comport_number>=RS232_PORTNR)||(comport_number<0))
     {
@@ -159,9 +185,15 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
         baudr = B4000000;
         break;
     default      :
+#ifdef RS232_TERMIOS2
+        baudr = B38400;  /* replaced by the exact rate once the port is set up */
+        custom_baud = baudrate;
+        break;
+#else
         printf("invalid baudrate\n");
         return(1);
         break;
+#endif
     }
 
     int cbits=CS8,
@@ -283,10 +315,28 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
         return(1);
     }
 
+#ifdef RS232_TERMIOS2
+    if(custom_baud)
+    {
+        if(RS232_SetCustomBaud(comport_number, custom_baud))
+        {
+            tcsetattr(Cport[comport_number], TCSANOW, old_port_settings + comport_number);
+            close(Cport[comport_number]);
+            flock(Cport[comport_number], LOCK_UN);  /* free the port so that others can use it. */
+            printf("invalid baudrate\n");
+            return(1);
+        }
+    }
+#endif
+
     /* http://man7.org/linux/man-pages/man4/tty_ioctl.4.html */
 
     if(ioctl(Cport[comport_number], TIOCMGET, &status) == -1)
     {
+        if(errno == ENOTTY || errno == EINVAL)  /* pseudo terminals (emulators) have no modem lines */
+        {
+            return(0);
+        }
         tcsetattr(Cport[comport_number], TCSANOW, old_port_settings + comport_number);
         flock(Cport[comport_number], LOCK_UN);  /* free the port so that others can use it. */
         perror("unable to get portstatus");
@@ -362,21 +412,46 @@ int RS232_SendBuf(int comport_number, unsigned char *buf, int size)
 }
 
 
+/* sends several buffers with one system call, returns the bytes written, 0 if none could be and -1 on error */
+int RS232_SendBufv(int comport_number, const struct iovec *parts, int count)
+{
+    int n = writev(Cport[comport_number], parts, count);
+    if(n < 0)
+    {
+        if(errno == EAGAIN)
+        {
+            return 0;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    return(n);
+}
+
+
 void RS232_CloseComport(int comport_number)
 {
     int status;
 
     if(ioctl(Cport[comport_number], TIOCMGET, &status) == -1)
     {
-        perror("unable to get portstatus");
+        if(errno != ENOTTY && errno != EINVAL)  /* pseudo terminals have no modem lines */
+        {
+            perror("unable to get portstatus");
+        }
     }
-
-    status &= ~TIOCM_DTR;    /* turn off DTR */
-    status &= ~TIOCM_RTS;    /* turn off RTS */
-
-    if(ioctl(Cport[comport_number], TIOCMSET, &status) == -1)
+    else
     {
-        perror("unable to set portstatus");
+        status &= ~TIOCM_DTR;    /* turn off DTR */
+        status &= ~TIOCM_RTS;    /* turn off RTS */
+
+        if(ioctl(Cport[comport_number], TIOCMSET, &status) == -1)
+        {
+            perror("unable to set portstatus");
+        }
     }
 
     tcsetattr(Cport[comport_number], TCSANOW, old_port_settings + comport_number);
@@ -531,12 +606,143 @@ void RS232_flushRXTX(int comport_number)
 }
 
 
+#ifdef RS232_TERMIOS2
+
+/* sets any baudrate the driver can divide down to, not just the Bxxx constants */
+static int RS232_SetCustomBaud(int comport_number, int baudrate)
+{
+    struct termios2 tio;
+
+    if(ioctl(Cport[comport_number], TCGETS2, &tio) == -1)
+    {
+        return(1);
+    }
+
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+    tio.c_ispeed = baudrate;
+    tio.c_ospeed = baudrate;
+
+    if(ioctl(Cport[comport_number], TCSETS2, &tio) == -1)
+    {
+        return(1);
+    }
+
+    return(0);
+}
+
+#endif
+
+
+/* asks the driver to pass on received bytes at once rather than batching them up */
+/* returns 0 if a low latency setting was applied */
+int RS232_SetLowLatency(int comport_number)
+{
+    int applied = 1;
+
+#if defined(__linux__)
+    struct serial_struct serinfo;
+
+    if(ioctl(Cport[comport_number], TIOCGSERIAL, &serinfo) == 0)
+    {
+        serinfo.flags |= ASYNC_LOW_LATENCY;
+        if(ioctl(Cport[comport_number], TIOCSSERIAL, &serinfo) == 0)
+        {
+            applied = 0;
+        }
+    }
+
+    /* FTDI adapters hold bytes for up to 16 ms unless their latency timer is turned down */
+    const char *name = strrchr(comports[comport_number], '/');
+    if((name != NULL) && (strncmp(name, "/ttyUSB", 7) == 0))
+    {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/bus/usb-serial/devices%s/latency_timer", name);
+
+        FILE *timer = fopen(path, "w");
+        if(timer != NULL)
+        {
+            if(fputs("1", timer) >= 0)
+            {
+                applied = 0;
+            }
+            fclose(timer);
+        }
+    }
+#else
+    (void)comport_number;
+#endif
+
+    return(applied);
+}
+
+
+/* waits up to msec for the port to have data, or for wake_fd (when not -1) to be written to */
+/* returns 1 if the port is readable, 0 otherwise and -1 once the device has hung up */
+int RS232_WaitComport(int comport_number, int wake_fd, int msec)
+{
+    struct pollfd fds[2];
+    int nfds = 1;
+
+    fds[0].fd = Cport[comport_number];
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    if(wake_fd != -1)
+    {
+        fds[1].fd = wake_fd;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        nfds = 2;
+    }
+
+    if(poll(fds, nfds, msec) <= 0)
+    {
+        return(0);
+    }
+
+    if(fds[0].revents & (POLLHUP | POLLERR | POLLNVAL))  /* e.g. a USB adapter unplugged */
+    {
+        return(-1);
+    }
+
+    return((fds[0].revents & POLLIN) != 0);
+}
+
+
+/* writing to the wake_fd given to RS232_WaitComport() does this here */
+void RS232_WakeComport(int comport_number)
+{
+    (void)comport_number;
+}
+
+
+/* 1 if the device behind a comport number exists, so absent ports can be skipped quietly */
+int RS232_ComportPresent(int comport_number)
+{
+    if((comport_number>=RS232_PORTNR)||(comport_number<0))
+    {
+        return(0);
+    }
+
+    return(access(comports[comport_number], F_OK) == 0);
+}
+
+
 #else  /* windows */
 
 #define RS232_PORTNR  16
 
 HANDLE Cport[RS232_PORTNR];
 
+/* the port is opened for overlapped I/O so RS232_WaitComport can wait on it with a time-out and be woken */
+static HANDLE io_event[RS232_PORTNR],    /* signalled as each read or write completes */
+              wake_event[RS232_PORTNR];  /* set by RS232_WakeComport */
+static OVERLAPPED wait_ov[RS232_PORTNR]; /* the WaitCommEvent() that can still be pending between waits */
+static DWORD wait_mask[RS232_PORTNR];
+static int wait_pending[RS232_PORTNR];
+
+static int transfer(int comport_number, int writing, unsigned char *buf, int size);
+
 
 char *comports[RS232_PORTNR]= {"\\\\.\\COM1",  "\\\\.\\COM2",  "\\\\.\\COM3",  "\\\\.\\COM4",
                                "\\\\.\\COM5",  "\\\\.\\COM6",  "\\\\.\\COM7",  "\\\\.\\COM8",
@@ -681,7 +887,7 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
                                         0,                          /* no share  */
                                         NULL,                       /* no security */
                                         OPEN_EXISTING,
-                                        0,                          /* no threads */
+                                        FILE_FLAG_OVERLAPPED,       /* so a wait can time out */
                                         NULL);                      /* no templates */
 
     if(Cport[comport_number]==INVALID_HANDLE_VALUE)
@@ -723,30 +929,67 @@ int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
         return(1);
     }
 
+    memset(&wait_ov[comport_number], 0, sizeof(OVERLAPPED));
+    io_event[comport_number] = CreateEventA(NULL, TRUE, FALSE, NULL);
+    wake_event[comport_number] = CreateEventA(NULL, FALSE, FALSE, NULL);
+    wait_ov[comport_number].hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    wait_pending[comport_number] = 0;
+
+    if((io_event[comport_number] == NULL) || (wake_event[comport_number] == NULL) ||
+       (wait_ov[comport_number].hEvent == NULL) || !SetCommMask(Cport[comport_number], EV_RXCHAR | EV_ERR))
+    {
+        printf("unable to set up comport events\n");
+        RS232_CloseComport(comport_number);
+        return(1);
+    }
+
     return(0);
 }
 
 
-int RS232_PollComport(int comport_number, unsigned char *buf, int size)
+/* one overlapped read or write, waited for; the read time-outs make a read return at once with what is there */
+static int transfer(int comport_number, int writing, unsigned char *buf, int size)
 {
-    int n;
+    OVERLAPPED ov;
+    DWORD n = 0;
+    BOOL done;
 
-    /* added the void pointer cast, otherwise gcc will complain about */
-    /* "warning: dereferencing type-punned pointer will break strict aliasing rules" */
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = io_event[comport_number];
+    ResetEvent(ov.hEvent);
 
-    ReadFile(Cport[comport_number], buf, size, (LPDWORD)((void *)&n), NULL);
+    if(writing)
+    {
+        done = WriteFile(Cport[comport_number], buf, size, NULL, &ov);
+    }
+    else
+    {
+        done = ReadFile(Cport[comport_number], buf, size, NULL, &ov);
+    }
 
-    return(n);
+    if(!done && (GetLastError() != ERROR_IO_PENDING))
+    {
+        return(-1);
+    }
+
+    if(!GetOverlappedResult(Cport[comport_number], &ov, &n, TRUE))
+    {
+        return(-1);
+    }
+
+    return((int)n);
 }
 
 
-int RS232_SendByte(int comport_number, unsigned char byte)
+int RS232_PollComport(int comport_number, unsigned char *buf, int size)
 {
-    int n;
+    return(transfer(comport_number, 0, buf, size));
+}
 
-    WriteFile(Cport[comport_number], &byte, 1, (LPDWORD)((void *)&n), NULL);
 
-    if(n<0)
+int RS232_SendByte(int comport_number, unsigned char byte)
+{
+    if(transfer(comport_number, 1, &byte, 1) != 1)
         return(1);
 
     return(0);
@@ -755,20 +998,61 @@ int RS232_SendByte(int comport_number, unsigned char byte)
 
 int RS232_SendBuf(int comport_number, unsigned char *buf, int size)
 {
-    int n;
+    return(transfer(comport_number, 1, buf, size));
+}
+
+
+/* writes the buffers one after another, stopping at the first short write */
+int RS232_SendBufv(int comport_number, const struct iovec *parts, int count)
+{
+    int i, n, total = 0;
 
-    if(WriteFile(Cport[comport_number], buf, size, (LPDWORD)((void *)&n), NULL))
+    for(i=0; i<count; i++)
     {
-        return(n);
+        n = RS232_SendBuf(comport_number, (unsigned char *)parts[i].iov_base, (int)parts[i].iov_len);
+        if(n < 0)
+        {
+            return(total > 0 ? total : -1);
+        }
+        total += n;
+        if(n < (int)parts[i].iov_len)
+        {
+            break;
+        }
     }
 
-    return(-1);
+    return(total);
 }
 
 
 void RS232_CloseComport(int comport_number)
 {
+    DWORD n;
+
+    if(wait_pending[comport_number])
+    {
+        SetCommMask(Cport[comport_number], 0);  /* ends the pending WaitCommEvent() */
+        GetOverlappedResult(Cport[comport_number], &wait_ov[comport_number], &n, TRUE);
+        wait_pending[comport_number] = 0;
+    }
+
     CloseHandle(Cport[comport_number]);
+
+    if(io_event[comport_number] != NULL)
+    {
+        CloseHandle(io_event[comport_number]);
+        io_event[comport_number] = NULL;
+    }
+    if(wake_event[comport_number] != NULL)
+    {
+        CloseHandle(wake_event[comport_number]);
+        wake_event[comport_number] = NULL;
+    }
+    if(wait_ov[comport_number].hEvent != NULL)
+    {
+        CloseHandle(wait_ov[comport_number].hEvent);
+        wait_ov[comport_number].hEvent = NULL;
+    }
 }
 
 /*
@@ -860,6 +1144,95 @@ void RS232_flushRXTX(int comport_number)
 }
 
 
+/* 1 if the device behind a comport number exists, so absent ports can be skipped quietly */
+int RS232_ComportPresent(int comport_number)
+{
+    char target[256];
+
+    if((comport_number>=RS232_PORTNR)||(comport_number<0))
+    {
+        return(0);
+    }
+
+    /* skip the "\\.\" prefix to get the DOS device name */
+    return(QueryDosDeviceA(comports[comport_number] + 4, target, sizeof(target)) != 0);
+}
+
+
+/* the driver's own buffering is used as it is */
+int RS232_SetLowLatency(int comport_number)
+{
+    (void)comport_number;
+
+    return(1);
+}
+
+
+/* waits up to msec (-1 for ever) for the port to have data, or for RS232_WakeComport(); wake_fd is not used */
+/* returns 1 if the port is readable, 0 otherwise and -1 once the device has gone */
+int RS232_WaitComport(int comport_number, int wake_fd, int msec)
+{
+    COMSTAT stat;
+    DWORD errors, n;
+    HANDLE events[2];
+
+    (void)wake_fd;
+
+    if(!ClearCommError(Cport[comport_number], &errors, &stat))  /* e.g. a USB adapter unplugged */
+    {
+        return(-1);
+    }
+    if(stat.cbInQue > 0)
+    {
+        return(1);
+    }
+
+    /* a wait that timed out last time is still pending and is simply waited on again */
+    if(!wait_pending[comport_number])
+    {
+        ResetEvent(wait_ov[comport_number].hEvent);
+        if(WaitCommEvent(Cport[comport_number], &wait_mask[comport_number], &wait_ov[comport_number]))
+        {
+            return(1);
+        }
+        if(GetLastError() != ERROR_IO_PENDING)
+        {
+            return(-1);
+        }
+        wait_pending[comport_number] = 1;
+    }
+
+    events[0] = wait_ov[comport_number].hEvent;
+    events[1] = wake_event[comport_number];
+
+    switch(WaitForMultipleObjects(2, events, FALSE, msec < 0 ? INFINITE : (DWORD)msec))
+    {
+    case WAIT_OBJECT_0 :
+        wait_pending[comport_number] = 0;
+        if(!GetOverlappedResult(Cport[comport_number], &wait_ov[comport_number], &n, FALSE))
+        {
+            return(-1);
+        }
+        return(1);  /* a character, or a line error the next read will show */
+    case WAIT_OBJECT_0 + 1 :
+    case WAIT_TIMEOUT :
+        return(0);
+    default :
+        return(-1);
+    }
+}
+
+
+/* ends an RS232_WaitComport() in progress on another thread, or the next one to start */
+void RS232_WakeComport(int comport_number)
+{
+    if(wake_event[comport_number] != NULL)
+    {
+        SetEvent(wake_event[comport_number]);
+    }
+}
+
+
 #endif
 
 
@@ -870,6 +1243,40 @@ void RS232_cputs(int comport_number, const char *text)  /* sends a string to ser
 }
 
 
+/* point a comport number at another device, e.g. a pseudo terminal; the name is not copied */
+int RS232_SetComportName(int comport_number, const char *devname)
+{
+    if((comport_number>=RS232_PORTNR)||(comport_number<0))
+    {
+        printf("illegal comport number\n");
+        return(1);
+    }
+
+    comports[comport_number] = (char *)devname;
+
+    return(0);
+}
+
+
+/* name of the device behind a comport number, or NULL for an illegal number */
+const char *RS232_GetComportName(int comport_number)
+{
+    if((comport_number>=RS232_PORTNR)||(comport_number<0))
+    {
+        return(NULL);
+    }
+
+    return(comports[comport_number]);
+}
+
+
+/* number of entries in comports */
+int RS232_GetPortCount(void)
+{
+    return(RS232_PORTNR);
+}
+
+
 /* return index in comports matching to device name or -1 if not found */
 int RS232_GetPortnr(const char *devname)
 {
@@ -53,17 +53,29 @@ extern "C" {
 #include <limits.h>
 #include <sys/file.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+#if defined(__linux__)
+#include <linux/serial.h>
+#endif
 
 #else
 
 #include <windows.h>
 
+struct iovec  /* as in <sys/uio.h>, for RS232_SendBufv */
+{
+    void *iov_base;
+    size_t iov_len;
+};
+
 #endif
 
 int RS232_OpenComport(int, int, const char *);
 int RS232_PollComport(int, unsigned char *, int);
 int RS232_SendByte(int, unsigned char);
 int RS232_SendBuf(int, unsigned char *, int);
+int RS232_SendBufv(int, const struct iovec *, int);
 void RS232_CloseComport(int);
 void RS232_cputs(int, const char *);
 int RS232_IsDCDEnabled(int);
@@ -76,7 +88,14 @@ void RS232_disableRTS(int);
 void RS232_flushRX(int);
 void RS232_flushTX(int);
 void RS232_flushRXTX(int);
+int RS232_WaitComport(int, int, int);
+void RS232_WakeComport(int);
+int RS232_SetLowLatency(int);
+int RS232_ComportPresent(int);
+const char *RS232_GetComportName(int);
+int RS232_GetPortCount(void);
 int RS232_GetPortnr(const char *);
+int RS232_SetComportName(int, const char *);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -1,117 +1,1172 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "log.h"
 #include "serial.h"
 #include "rs232.h"
+#include "platform.h"
+#include "profile.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define Serial_Mode
 
 #ifdef Serial_Mode
 
+// One I/O thread owns the port from when it is opened until it is closed. Callers queue commands and return;
+// the thread gathers every waiting line the controller has room for into a single write, reads the replies
+// and matches them to the commands in the order they were sent. Replies are handed back on the caller's own
+// thread, through the reply callback when it next queues or flushes, or to the SendCommand waiting for one.
+//
+// If the port goes away, for example a USB adapter unplugged or re-enumerated, the I/O thread looks for the
+// robot again on the same device and then on every comports[] entry. Once it answers, the pen is put back where
+// the last acknowledged command left it and every unanswered command is sent again. Callers waiting for
+// replies do not time out in the meantime.
+
+// STRUCTS
+
+typedef struct // Struct to hold a command from being queued until its reply has been handed back
+{
+    char *pCommand; // In TxRing, with a NUL after it for the callback
+    int Length;
+    int Notify; // Reply goes to the callback rather than to a SendCommand waiting for it
+    int Stale;  // Nobody waits for its reply any more, so it is thrown away whenever it comes
+    int Resync; // The query sent after a timeout to find out whether the timed-out line ever arrived
+    int Status;
+    int Code;
+#if PROFILING == 1
+    long long WrittenAt;
+#endif
+} InFlight;
+
+typedef struct // Struct to hold what the acknowledged commands left the controller doing, to restore after a reconnect
+{
+    int HaveFeed;
+    double Feed;
+    int SpindleOn; // M3 given
+    int HavePen;
+    int Pen;
+    int HavePosition;
+    double X, Y;
+} StreamState;
+
+// GLOBAL VARIABLES
+
+int SerialPort = DefaultSerialPort;
+int BaudRate = DefaultBaudRate;
+int LowLatency = 1;
+
+// Tried from slowest to fastest; the fastest the controller answers at is kept
+static const int ProbeRates[] = {115200, 230400, 250000, 460800, 500000, 921600, 1000000, 2000000};
+
+// Commands move through one ring: the oldest Answered have their replies, the next Written are in the
+// controller's buffer and the rest are waiting for room there. A command that timed out stays in the ring,
+// marked Stale, so its late reply cannot be credited to the one after it.
+static InFlight Pipeline[PipelineDepth];
+static int PipelineHead = 0, PipelineCount = 0, Answered = 0, Written = 0, BytesInController = 0;
+
+// The text of every queued command, back to back in queue order, so the I/O thread can hand the lines it
+// sends straight to writev() without gathering them first. A line that does not fit before the end of the
+// ring starts again at the front rather than being split. Only callers write here, the I/O thread only reads.
+static char TxRing[TxRingSize];
+static int TxTail = 0; // Where the next command goes
+static char RawText[MaxCommandLength]; // PrintBuffer text that expects no reply, written ahead of any command
+static int RawLength = 0;
+static int SawDollar = 0;
+static long long LastReplyMs = 0;
+static int Reconnecting = 0;
+static int PortOpen = 0;
+static StreamState Stream; // Only the I/O thread touches it
+static void (*ReplyCallback)(const char *Command, int Status) = NULL;
+
+static pthread_mutex_t IoLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t IoChanged = PTHREAD_COND_INITIALIZER; // Broadcast as replies arrive or text is taken
+static pthread_t IoThread;
+static int IoRunning = 0, IoStopping = 0, IoSleeping = 0;
+static int WakePipe[2] = {-1, -1};
+
+// Replies can arrive split over several reads or several to a read, so bytes are gathered here
+// and taken one complete line at a time. Only the I/O thread, or a probe before it starts, touches them.
+static unsigned char RxBuffer[4096];
+static int RxEnd = 0;
+
+// FUNCTION DECLARATIONS
+
+static int StartOpenPort(void);
+static int ProbePort(int Port);
+static int ReadRawLine(char *Line, int Size, long long Deadline);
+static int Reconnect(void);
+static int RestoreStream(void);
+static void TrackStream(const char *Command);
+static int StartSerialIo(void);
+static void StopSerialIo(void);
+static void WakeSerialIo(void);
+static void *RunSerialIo(void *pArgument);
+static int GatherCommands(struct iovec *pParts, char *pRaw);
+static void TakeReplies(void);
+static void TakeLine(const char *Line);
+static void FinishResync(void);
+static int AppendCommand(const char *buffer, int Notify);
+static int DeliverReplies(void);
+static int DropStaleReplies(void);
+static void WaitForChange(int TimeoutMs);
+static int WaitForBanner(int TimeoutMs);
+static int ReplyOverdue(long long WaitStart);
+static int IsRetryable(int Status, int Code);
+
+// FUNCTIONS
+
 // Open port with checking
 int CanRS232PortBeOpened(void)
 {
     char mode[] = {'8', 'N', '1', 0};
-    if (RS232_OpenComport(cport_nr, bdrate, mode))
+    if (RS232_OpenComport(SerialPort, BaudRate, mode))
     {
         printf("Can not open comport\n");
 
         return (-1);
     }
+    return StartOpenPort();
+}
+
+// Open the first comports[] entry where a controller answers, in place of the fixed port number
+int FindRobotPort(void)
+{
+    for (int Port = 0; Port < RS232_GetPortCount(); Port++)
+    {
+        if (ProbePort(Port) == 0)
+        {
+            SerialPort = Port;
+            LogMessage("Found the robot on %s", RS232_GetComportName(Port));
+            return StartOpenPort();
+        }
+    }
+
+    printf("No robot answered on any serial port\n");
+    return (-1);
+}
+
+// Finishes opening a port RS232_OpenComport() has just opened
+static int StartOpenPort(void)
+{
+    PortOpen = 1;
+    if (LowLatency && RS232_SetLowLatency(SerialPort) == 0)
+    {
+        LogMessage("Low latency mode set on the serial port");
+    }
+    memset(&Stream, 0, sizeof(Stream));
+    if (StartSerialIo() != 0)
+    {
+        RS232_CloseComport(SerialPort);
+        PortOpen = 0;
+        return (-1);
+    }
     return (0); // Success
 }
 
+// Opens a port and sends a newline; a controller answers with its '$' banner, or an 'ok' if it was already
+// awake. The port is only left open if one does.
+static int ProbePort(int Port)
+{
+    char mode[] = {'8', 'N', '1', 0};
+    char Line[256];
+
+    if (!RS232_ComportPresent(Port) || RS232_OpenComport(Port, BaudRate, mode))
+    {
+        return (-1);
+    }
+
+    int Previous = SerialPort;
+    SerialPort = Port;
+    RxEnd = 0;
+    RS232_SendBuf(Port, (unsigned char *)"\n", 1);
+
+    long long Deadline = MillisecondsNow() + ProbeReplyMs;
+    while (ReadRawLine(Line, (int)sizeof(Line), Deadline) >= 0)
+    {
+        if (strchr(Line, '$') != NULL || strcmp(Line, "ok") == 0)
+        {
+            RxEnd = 0;
+            return (0);
+        }
+    }
+
+    RS232_CloseComport(Port);
+    SerialPort = Previous;
+    return (-1);
+}
+
+// Reads straight from the port, for when the I/O thread is not taking replies itself
+static int ReadRawLine(char *Line, int Size, long long Deadline)
+{
+    while (1)
+    {
+        for (int i = 0; i < RxEnd; i++)
+        {
+            if (RxBuffer[i] == '\n')
+            {
+                int Length = i;
+                if (Length > 0 && RxBuffer[i - 1] == '\r')
+                {
+                    Length--;
+                }
+                if (Length > Size - 1)
+                {
+                    Length = Size - 1;
+                }
+                memcpy(Line, RxBuffer, (size_t)Length);
+                Line[Length] = 0;
+                memmove(RxBuffer, &RxBuffer[i + 1], (size_t)(RxEnd - i - 1));
+                RxEnd -= i + 1;
+                return Length;
+            }
+        }
+        if (RxEnd == (int)sizeof(RxBuffer)) // A line this long is noise, throw it away
+        {
+            RxEnd = 0;
+        }
+
+        long long Remaining = Deadline - MillisecondsNow();
+        if (Remaining <= 0 || RS232_WaitComport(SerialPort, -1, (int)Remaining) < 0)
+        {
+            return -1;
+        }
+        int n = RS232_PollComport(SerialPort, &RxBuffer[RxEnd], (int)sizeof(RxBuffer) - RxEnd);
+        if (n < 0)
+        {
+            return -1;
+        }
+        RxEnd += n;
+    }
+}
+
+// Open a device by name in place of the fixed port number
+int OpenSerialDevice(const char *Device)
+{
+    if (RS232_SetComportName(SerialPort, Device))
+    {
+        return (-1);
+    }
+
+    return CanRS232PortBeOpened();
+}
+
 // Function to close the COM port
 void CloseRS232Port(void)
 {
-    RS232_CloseComport(cport_nr);
+    StopSerialIo();
+    if (PortOpen) // Not if the robot went away and never came back
+    {
+        RS232_CloseComport(SerialPort);
+        PortOpen = 0;
+    }
+    FlushLog();
 }
 
-// Write text out via the serial port
+// Write text out via the serial port, for text such as the wake-up newline that gets no 'ok'
 int PrintBuffer(char *buffer)
 {
-    RS232_cputs(cport_nr, buffer);
-    printf("sent: %s\n", buffer);
+    int Length = (int)strlen(buffer);
+    if (Length >= (int)sizeof(RawText))
+    {
+        printf("Text too long to send: %s", buffer);
+        return (-1);
+    }
+
+    pthread_mutex_lock(&IoLock);
+    while (RawLength + Length > (int)sizeof(RawText))
+    {
+        WaitForChange(ReplyTimeoutMs);
+    }
+    memcpy(&RawText[RawLength], buffer, (size_t)Length);
+    RawLength += Length;
+    WakeSerialIo();
+    pthread_mutex_unlock(&IoLock);
+
+    return (0);
+}
+
+// Steps up from the rate the port was opened at. GRBL's rate is fixed in its firmware, so the usual outcome is
+// that one rate answers and the next one up does not; the probe stops there and reopens at the last good rate.
+int ProbeBaudRate(void)
+{
+    int Opened = BaudRate, Best = 0; // PortOpen follows every close and reopen below
+
+    for (int i = 0; i < (int)(sizeof(ProbeRates) / sizeof(ProbeRates[0])); i++)
+    {
+        if (ProbeRates[i] < Opened)
+        {
+            continue;
+        }
+        if (BaudRate != ProbeRates[i])
+        {
+            if (PortOpen)
+            {
+                CloseRS232Port();
+            }
+            BaudRate = ProbeRates[i];
+            if (CanRS232PortBeOpened() != 0) // The driver cannot do this rate, so it cannot do any faster one either
+            {
+                break;
+            }
+        }
+
+        PrintBuffer("\n");
+        if (WaitForBanner(ProbeReplyMs) != 0)
+        {
+            LogMessage("No answer at %d baud", BaudRate);
+            if (Best != 0)
+            {
+                break;
+            }
+            continue;
+        }
+        LogMessage("Controller answered at %d baud", BaudRate);
+        Best = BaudRate;
+    }
+
+    if (Best == 0)
+    {
+        if (PortOpen)
+        {
+            CloseRS232Port();
+        }
+        printf("The controller did not answer at any baud rate\n");
+        return (-1);
+    }
+    if (BaudRate != Best || !PortOpen)
+    {
+        if (PortOpen)
+        {
+            CloseRS232Port();
+        }
+        BaudRate = Best;
+        return CanRS232PortBeOpened();
+    }
 
     return (0);
 }
 
 int WaitForDollar(void)
 {
+    while (WaitForBanner(ReplyTimeoutMs) != 0)
+    {
+    }
 
-    int i, n;
+    LogMessage("Saw the Dollar");
+    return (0);
+}
 
-    unsigned char buf[4096];
+// 0 once a '$' banner or a bare 'ok' has come in since the last one was taken, -1 if none came in time
+static int WaitForBanner(int TimeoutMs)
+{
+    long long Deadline = MillisecondsNow() + TimeoutMs;
 
-    while (1)
+    pthread_mutex_lock(&IoLock);
+    while (!SawDollar && MillisecondsNow() < Deadline)
     {
-        printf(".");
-        n = RS232_PollComport(cport_nr, buf, 4095);
+        WaitForChange((int)(Deadline - MillisecondsNow()));
+    }
+    int Seen = SawDollar;
+    SawDollar = 0; // The next wake-up waits for a banner of its own
+    pthread_mutex_unlock(&IoLock);
 
-        if (n > 0)
+    return Seen ? 0 : -1;
+}
+
+int WaitForReply(void)
+{
+    int Code;
+    return ReadReply(ReplyTimeoutMs, &Code);
+}
+
+int ReadReply(int TimeoutMs, int *pCode)
+{
+    PROFILE_START(ReplyWait);
+    long long Deadline = MillisecondsNow() + TimeoutMs;
+    int Status = ReplyTimeout;
+
+    *pCode = 0;
+    pthread_mutex_lock(&IoLock);
+    while (DropStaleReplies() == 0 && MillisecondsNow() < Deadline)
+    {
+        WaitForChange((int)(Deadline - MillisecondsNow()));
+    }
+    if (Answered > 0)
+    {
+        Status = Pipeline[PipelineHead].Status;
+        *pCode = Pipeline[PipelineHead].Code;
+        PipelineHead = (PipelineHead + 1) % PipelineDepth;
+        PipelineCount--;
+        Answered--;
+    }
+    pthread_mutex_unlock(&IoLock);
+
+    PROFILE_STOP(StageReplyWait, ReplyWait);
+    PROFILE_COUNT(CounterTimeouts, Status == ReplyTimeout);
+    return Status;
+}
+
+// GRBL errors 1 to 3 mean the line did not parse, which on a noisy link usually means it was garbled
+static int IsRetryable(int Status, int Code)
+{
+    return Status == ReplyTimeout || (Status == ReplyError && Code >= 1 && Code <= 3);
+}
+
+int SendCommand(char *buffer)
+{
+    int Status = FlushCommands(); // Anything queued earlier is answered first, so the next reply is this one's
+    if (Status == ReplyTimeout || Status == ReplyAlarm)
+    {
+        return Status;
+    }
+
+    // Every move is absolute, so sending a line twice after a lost 'ok' draws nothing extra
+    for (int Attempt = 0; Attempt <= MaxRetries; Attempt++)
+    {
+        int Code = 0;
+        if (Attempt > 0)
         {
-            printf("RCVD: N = %d ", n);
-            buf[n] = 0; /* always put a "null" at the end of a string! */
+            LogMessage("Resending (attempt %d of %d): %s", Attempt, MaxRetries, buffer);
+            PROFILE_COUNT(CounterRetries, 1);
+        }
 
-            for (i = 0; i < n; i++)
+        PROFILE_START(ReplyWait);
+        pthread_mutex_lock(&IoLock);
+        if (PipelineCount + 2 > PipelineDepth) // Room for the command and a resync after it, else the controller has long gone quiet
+        {
+            pthread_mutex_unlock(&IoLock);
+            Status = ReplyTimeout;
+            break;
+        }
+        if (AppendCommand(buffer, 0) < 0)
+        {
+            pthread_mutex_unlock(&IoLock);
+            printf("Command too long to send: %s", buffer);
+            return ReplyError;
+        }
+        int Slot = (PipelineHead + PipelineCount - 1) % PipelineDepth;
+        long long WaitStart = MillisecondsNow();
+        while (DropStaleReplies() == 0 && !ReplyOverdue(WaitStart))
+        {
+            WaitForChange(ReplyTimeoutMs);
+        }
+        if (Answered > 0) // Only stale commands were ahead of this one, so the oldest reply left is its own
+        {
+            Status = Pipeline[PipelineHead].Status;
+            Code = Pipeline[PipelineHead].Code;
+            PipelineHead = (PipelineHead + 1) % PipelineDepth;
+            PipelineCount--;
+            Answered--;
+        }
+        else
+        {
+            // Either the line or only its reply was lost. It stays counted in the controller's buffer until
+            // one or the other is known, and a $G queued behind it tells them apart for TakeLine.
+            Status = ReplyTimeout;
+            Pipeline[Slot].Stale = 1;
+            if (AppendCommand(ResyncQuery, 0) >= 0)
             {
-                if (buf[i] == '$') /* replace unreadable control-codes by dots */
-                {
-                    printf("received %i bytes: %s \n", n, (char *)buf);
-                    printf("\nSaw the Dollar");
-                    return 0;
-                }
+                InFlight *pResync = &Pipeline[(PipelineHead + PipelineCount - 1) % PipelineDepth];
+                pResync->Stale = pResync->Resync = 1;
             }
+        }
+        pthread_mutex_unlock(&IoLock);
+        PROFILE_STOP(StageReplyWait, ReplyWait);
+        PROFILE_COUNT(CounterTimeouts, Status == ReplyTimeout);
+
+        if (!IsRetryable(Status, Code))
+        {
+            break;
+        }
+    }
 
-            printf("received %i bytes: %s \n", n, (char *)buf);
+    return Status;
+}
 
-            if ((buf[0] == 'o') && (buf[1] == 'k'))
-                return 0;
+void SetReplyCallback(void (*Callback)(const char *Command, int Status))
+{
+    ReplyCallback = Callback;
+}
+
+int QueueCommand(char *buffer)
+{
+    // Only waits when PipelineDepth commands are already outstanding; the I/O thread decides when each one
+    // fits in the controller's buffer. Lines are not resent here because a late resend would be drawn out
+    // of order; a rejected line is reported through the callback instead.
+    pthread_mutex_lock(&IoLock);
+    int Status = DeliverReplies();
+    if (PipelineCount == PipelineDepth && Status != ReplyAlarm)
+    {
+        PROFILE_START(ReplyWait);
+        long long WaitStart = MillisecondsNow();
+        while (PipelineCount == PipelineDepth && Status != ReplyAlarm && Status != ReplyTimeout)
+        {
+            WaitForChange(ReplyTimeoutMs);
+            Status = DeliverReplies();
+            if (PipelineCount == PipelineDepth && ReplyOverdue(WaitStart))
+            {
+                Status = ReplyTimeout;
+            }
+        }
+        PROFILE_STOP(StageReplyWait, ReplyWait);
+    }
+    if (Status != ReplyAlarm && Status != ReplyTimeout)
+    {
+        Status = AppendCommand(buffer, 1) < 0 ? ReplyError : ReplyOk;
+    }
+    pthread_mutex_unlock(&IoLock);
+    if (Status == ReplyError)
+    {
+        printf("Command too long to queue: %s", buffer);
+    }
+
+    PROFILE_COUNT(CounterTimeouts, Status == ReplyTimeout);
+    return Status;
+}
+
+int FlushCommands(void)
+{
+    pthread_mutex_lock(&IoLock);
+    int Status = DeliverReplies();
+    if (PipelineCount > 0 && Status != ReplyAlarm)
+    {
+        PROFILE_START(ReplyWait);
+        long long WaitStart = MillisecondsNow();
+        while (PipelineCount > 0 && Status != ReplyAlarm && Status != ReplyTimeout)
+        {
+            WaitForChange(ReplyTimeoutMs);
+            Status = DeliverReplies();
+            if (PipelineCount > 0 && ReplyOverdue(WaitStart)) // The command stays queued, the caller decides whether to give up
+            {
+                Status = ReplyTimeout;
+            }
         }
+        PROFILE_STOP(StageReplyWait, ReplyWait);
+    }
+    pthread_mutex_unlock(&IoLock);
+
+    PROFILE_COUNT(CounterTimeouts, Status == ReplyTimeout);
+    return Status == ReplyAlarm || Status == ReplyTimeout ? Status : ReplyOk;
+}
+
+// Called with IoLock held. Copies a command into TxRing, measuring it on the way, and returns its length or -1
+// if it is too long to queue
+static int AppendCommand(const char *buffer, int Notify)
+{
+    int Start = TxTail;
+
+    // The ring has room for PipelineDepth full-length lines plus what the wrap can waste, so with fewer than
+    // PipelineDepth commands outstanding there is always a full line's room at the tail or at the front
+    if (PipelineCount == 0)
+    {
+        Start = 0;
+    }
+    else
+    {
+        int Head = (int)(Pipeline[PipelineHead].pCommand - TxRing);
+        if (Start >= Head && Start + MaxCommandLength > TxRingSize)
+        {
+            Start = 0;
+        }
+    }
+
+    char *pText = &TxRing[Start];
+    int Length = 0;
+    while (buffer[Length] != 0)
+    {
+        if (Length == MaxCommandLength - 1)
+        {
+            return -1;
+        }
+        pText[Length] = buffer[Length];
+        Length++;
+    }
+    pText[Length] = 0;
+    TxTail = Start + Length + 1;
+
+    InFlight *pNewest = &Pipeline[(PipelineHead + PipelineCount) % PipelineDepth];
+    pNewest->pCommand = pText;
+    pNewest->Length = Length;
+    pNewest->Notify = Notify;
+    pNewest->Stale = pNewest->Resync = 0;
+    PipelineCount++;
+    WakeSerialIo();
+
+    return Length;
+}
+
+// Called with IoLock held. Hands each answered command to the callback, oldest first, and returns ReplyAlarm
+// if any of them stopped the controller. The lock is dropped around the callback so it can take its time.
+static int DeliverReplies(void)
+{
+    int Status = ReplyOk;
+
+    while (DropStaleReplies() > 0 && Pipeline[PipelineHead].Notify)
+    {
+        InFlight Oldest = Pipeline[PipelineHead]; // The slot can be reused once the lock is dropped
+        PipelineHead = (PipelineHead + 1) % PipelineDepth;
+        PipelineCount--;
+        Answered--;
+
+        if (Oldest.Status == ReplyAlarm)
+        {
+            Status = ReplyAlarm;
+        }
+        if (ReplyCallback != NULL)
+        {
+            pthread_mutex_unlock(&IoLock);
+            ReplyCallback(Oldest.pCommand, Oldest.Status); // Its text stays put until this thread queues again
+            pthread_mutex_lock(&IoLock);
+        }
+    }
+
+    return Status;
+}
+
+// Called with IoLock held. Throws away the replies at the head of the ring that nobody waits for and returns
+// how many answered commands are left.
+static int DropStaleReplies(void)
+{
+    while (Answered > 0 && Pipeline[PipelineHead].Stale)
+    {
+        PipelineHead = (PipelineHead + 1) % PipelineDepth;
+        PipelineCount--;
+        Answered--;
+    }
+
+    return Answered;
+}
+
+// Called with IoLock held
+static void WaitForChange(int TimeoutMs)
+{
+    struct timespec Until;
+
+    clock_gettime(CLOCK_REALTIME, &Until);
+    Until.tv_sec += TimeoutMs / 1000;
+    Until.tv_nsec += (long)(TimeoutMs % 1000) * 1000000L;
+    if (Until.tv_nsec >= 1000000000L)
+    {
+        Until.tv_sec++;
+        Until.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&IoChanged, &IoLock, &Until);
+}
+
+// Called with IoLock held. A wait only gives up once nothing at all has come back for ReplyTimeoutMs, not
+// counting time spent reconnecting.
+static int ReplyOverdue(long long WaitStart)
+{
+    if (Reconnecting)
+    {
+        return 0;
+    }
+    long long Since = LastReplyMs > WaitStart ? LastReplyMs : WaitStart;
+    return MillisecondsNow() - Since >= ReplyTimeoutMs;
+}
+
+static int StartSerialIo(void)
+{
+    PipelineHead = PipelineCount = Answered = Written = BytesInController = 0;
+    TxTail = 0;
+    RawLength = 0;
+    SawDollar = 0;
+    RxEnd = 0; // Nothing left over from a previous port
+    IoStopping = IoSleeping = 0;
 
-        Sleep(100);
+#if !defined(_WIN32)
+    if (pipe(WakePipe) != 0)
+    {
+        printf("Unable to create the serial wake-up pipe\n");
+        return (-1);
     }
+    fcntl(WakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(WakePipe[1], F_SETFL, O_NONBLOCK);
+#endif
+
+    if (pthread_create(&IoThread, NULL, RunSerialIo, NULL) != 0)
+    {
+        printf("Unable to start the serial I/O thread\n");
+        return (-1);
+    }
+    IoRunning = 1;
 
     return (0);
 }
 
-int WaitForReply(void)
+static void StopSerialIo(void)
+{
+    if (!IoRunning)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&IoLock);
+    IoStopping = 1;
+    IoSleeping = 1; // Makes sure the wake-up is sent
+    WakeSerialIo();
+    pthread_mutex_unlock(&IoLock);
+    pthread_join(IoThread, NULL);
+    IoRunning = 0;
+
+#if !defined(_WIN32)
+    close(WakePipe[0]);
+    close(WakePipe[1]);
+    WakePipe[0] = WakePipe[1] = -1;
+#endif
+}
+
+// Called with IoLock held. Only costs a write when the I/O thread is actually asleep.
+static void WakeSerialIo(void)
 {
+    if (!IoSleeping)
+    {
+        return;
+    }
+    IoSleeping = 0;
 
-    int i, n;
+#if !defined(_WIN32)
+    char Byte = 1;
+    if (write(WakePipe[1], &Byte, 1) < 0) // A full pipe already holds a wake-up
+    {
+        return;
+    }
+#else
+    RS232_WakeComport(SerialPort);
+#endif
+}
 
-    unsigned char buf[4096];
+static void *RunSerialIo(void *pArgument)
+{
+    (void)pArgument;
+    struct iovec Parts[PipelineDepth + 1]; // Raw text first, then each command where it sits in TxRing
+    char Raw[MaxCommandLength];
+    int PartStart = 0, PartEnd = 0;
 
     while (1)
     {
-        printf(".");
-        n = RS232_PollComport(cport_nr, buf, 4095);
+        pthread_mutex_lock(&IoLock);
+        if (IoStopping)
+        {
+            pthread_mutex_unlock(&IoLock);
+            break;
+        }
+        if (PartStart == PartEnd)
+        {
+            PartStart = 0;
+            PartEnd = GatherCommands(Parts, Raw);
+        }
+        pthread_mutex_unlock(&IoLock);
+
+        int Lost = 0;
+        if (PartStart < PartEnd)
+        {
+            PROFILE_START(Write);
+            int n = RS232_SendBufv(SerialPort, &Parts[PartStart], PartEnd - PartStart);
+            PROFILE_STOP(StageWrite, Write);
+            while (n > 0) // A short write leaves the rest of the parts for next time
+            {
+                if ((size_t)n >= Parts[PartStart].iov_len)
+                {
+                    n -= (int)Parts[PartStart].iov_len;
+                    PartStart++;
+                }
+                else
+                {
+                    Parts[PartStart].iov_base = (char *)Parts[PartStart].iov_base + n;
+                    Parts[PartStart].iov_len -= (size_t)n;
+                    n = 0;
+                }
+            }
+            Lost = n < 0;
+        }
 
+        int n = Lost ? -1 : RS232_PollComport(SerialPort, &RxBuffer[RxEnd], (int)sizeof(RxBuffer) - RxEnd);
         if (n > 0)
         {
-            printf("RCVD: N = %d ", n);
-            buf[n] = 0; /* always put a "null" at the end of a string! */
+            RxEnd += n;
+            TakeReplies();
+            continue;
+        }
+        if (n == 0 && PartStart < PartEnd) // The port's output queue is full, so wait for it to drain a little
+        {
+            Lost = RS232_WaitComport(SerialPort, -1, 1) < 0;
+        }
+        else if (n == 0)
+        {
+            pthread_mutex_lock(&IoLock);
+            int Idle = RawLength == 0 && (Answered + Written == PipelineCount ||
+                                          (BytesInController > 0 && BytesInController + Pipeline[(PipelineHead + Answered + Written) % PipelineDepth].Length > GrblBufferSize));
+            IoSleeping = Idle && !IoStopping;
+            pthread_mutex_unlock(&IoLock);
 
-            for (i = 0; i < n; i++)
+            if (Idle)
             {
-                if (buf[i] < 32) /* replace unreadable control-codes by dots */
+                Lost = RS232_WaitComport(SerialPort, WakePipe[0], IoIdleWaitMs) < 0;
+#if !defined(_WIN32)
+                char Drain[16];
+                while (read(WakePipe[0], Drain, sizeof(Drain)) > 0)
                 {
-                    buf[i] = '.';
                 }
+#endif
+                pthread_mutex_lock(&IoLock);
+                IoSleeping = 0;
+                pthread_mutex_unlock(&IoLock);
+            }
+        }
+
+        if (n < 0 || Lost)
+        {
+            PartStart = PartEnd = 0; // Anything half written goes again with the rest of the unanswered lines
+            if (Reconnect() != 0)
+            {
+                break; // Callers time out waiting for their replies and decide what to do
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Runs on the I/O thread once the port has gone. Waits for the robot to come back on the same device or on any
+// other comports[] entry, then restores the stream. 0 once it is drawing again, -1 if it did not come back in time.
+static int Reconnect(void)
+{
+    int LostPort = SerialPort;
+    int Found = -1;
+
+    LogMessage("Lost the robot on %s, reconnecting", RS232_GetComportName(LostPort));
+    RS232_CloseComport(LostPort);
+    PortOpen = 0;
+
+    pthread_mutex_lock(&IoLock);
+    Reconnecting = 1;
+    Written = BytesInController = 0; // Whatever the controller held when it went is sent again
+    pthread_mutex_unlock(&IoLock);
+
+    long long GiveUp = MillisecondsNow() + ReconnectTimeoutMs;
+    while (Found != 0 && MillisecondsNow() < GiveUp)
+    {
+        pthread_mutex_lock(&IoLock);
+        int Stopping = IoStopping;
+        pthread_mutex_unlock(&IoLock);
+        if (Stopping)
+        {
+            break;
+        }
+
+        Found = ProbePort(LostPort);
+        for (int Port = 0; Found != 0 && Port < RS232_GetPortCount(); Port++)
+        {
+            if (Port != LostPort)
+            {
+                Found = ProbePort(Port);
             }
+        }
+        if (Found != 0)
+        {
+            Sleep(ReconnectPollMs);
+        }
+    }
+
+    if (Found == 0)
+    {
+        PortOpen = 1;
+        if (LowLatency)
+        {
+            RS232_SetLowLatency(SerialPort);
+        }
+        Found = RestoreStream();
+    }
+
+    pthread_mutex_lock(&IoLock);
+    Reconnecting = 0;
+    if (Found == 0)
+    {
+        LastReplyMs = MillisecondsNow(); // Replies are due from now, not from before the robot went away
+    }
+    pthread_cond_broadcast(&IoChanged);
+    pthread_mutex_unlock(&IoLock);
+
+    if (Found == 0)
+    {
+        LogMessage("Reconnected on %s", RS232_GetComportName(SerialPort));
+    }
+    else
+    {
+        LogMessage("The robot did not come back");
+    }
+    return Found;
+}
 
-            printf("received %i bytes: %s\n", n, (char *)buf);
+// The controller may have been reset, so the feed rate and spindle are set again and the pen is lifted,
+// taken to where the last acknowledged move left it and put back the way it was
+static int RestoreStream(void)
+{
+    char Lines[ResumeLines][MaxCommandLength];
+    char Line[256];
+    int Count = 0;
+
+    if (Stream.HaveFeed)
+    {
+        snprintf(Lines[Count++], MaxCommandLength, "G1 F%g\n", Stream.Feed);
+    }
+    if (Stream.SpindleOn)
+    {
+        snprintf(Lines[Count++], MaxCommandLength, "M3\n");
+    }
+    if (Stream.HavePen)
+    {
+        snprintf(Lines[Count++], MaxCommandLength, "S0\n");
+    }
+    if (Stream.HavePosition)
+    {
+        snprintf(Lines[Count++], MaxCommandLength, "G0 X%.2f Y%.2f\n", Stream.X, Stream.Y);
+    }
+    if (Stream.HavePen)
+    {
+        snprintf(Lines[Count++], MaxCommandLength, "S%d\n", Stream.Pen);
+    }
 
-            if ((buf[0] == 'o') && (buf[1] == 'k'))
-                return 0;
+    for (int i = 0; i < Count; i++)
+    {
+        int Length = (int)strlen(Lines[i]);
+        LogMessage("sent: %s", Lines[i]);
+        if (RS232_SendBuf(SerialPort, (unsigned char *)Lines[i], Length) != Length)
+        {
+            return (-1);
         }
 
-        Sleep(100);
+        long long Deadline = MillisecondsNow() + ReplyTimeoutMs;
+        int Reply;
+        while ((Reply = ReadRawLine(Line, (int)sizeof(Line), Deadline)) >= 0 && strcmp(Line, "ok") != 0 &&
+               strncmp(Line, "error:", 6) != 0 && strncmp(Line, "ALARM:", 6) != 0)
+        {
+        }
+        if (Reply < 0)
+        {
+            return (-1);
+        }
     }
 
+    RxEnd = 0;
     return (0);
 }
 
+// Keeps StreamState up to date as each command is acknowledged
+static void TrackStream(const char *Command)
+{
+    const char *pWord;
+
+    if (Command[0] == 'S')
+    {
+        Stream.Pen = atoi(&Command[1]);
+        Stream.HavePen = 1;
+    }
+    else if (strncmp(Command, "M3", 2) == 0)
+    {
+        Stream.SpindleOn = 1;
+    }
+    else if (strncmp(Command, "M5", 2) == 0)
+    {
+        Stream.SpindleOn = 0;
+    }
+    else if (Command[0] == 'G' && Command[1] >= '0' && Command[1] <= '3' && (Command[2] == ' ' || Command[2] == '\n')) // Arcs end at their X, Y too
+    {
+        if ((pWord = strchr(Command, 'X')) != NULL)
+        {
+            Stream.X = atof(pWord + 1);
+            Stream.HavePosition = 1;
+        }
+        if ((pWord = strchr(Command, 'Y')) != NULL)
+        {
+            Stream.Y = atof(pWord + 1);
+            Stream.HavePosition = 1;
+        }
+    }
+
+    if ((pWord = strchr(Command, 'F')) != NULL)
+    {
+        Stream.Feed = atof(pWord + 1);
+        Stream.HaveFeed = 1;
+    }
+}
+
+// Called with IoLock held. Lists text that needs no reply and then every waiting command the controller has
+// room for, so a run of short moves goes out in a single write. Only the raw text is copied, into pRaw, since
+// PrintBuffer may add to it before the write is done.
+static int GatherCommands(struct iovec *pParts, char *pRaw)
+{
+    int Count = 0;
+
+    if (RawLength > 0)
+    {
+        memcpy(pRaw, RawText, (size_t)RawLength);
+        pParts[Count].iov_base = pRaw;
+        pParts[Count].iov_len = (size_t)RawLength;
+        Count++;
+        LogMessage("sent: %.*s", RawLength, RawText);
+        RawLength = 0;
+        pthread_cond_broadcast(&IoChanged);
+    }
+
+    while (Answered + Written < PipelineCount)
+    {
+        InFlight *pNext = &Pipeline[(PipelineHead + Answered + Written) % PipelineDepth];
+
+        // Character counting: the controller never gets more than its receive buffer can hold, except that a
+        // line longer than the whole buffer goes on its own once everything before it has been answered
+        if (BytesInController > 0 && BytesInController + pNext->Length > GrblBufferSize)
+        {
+            break;
+        }
+
+        pParts[Count].iov_base = pNext->pCommand;
+        pParts[Count].iov_len = (size_t)pNext->Length;
+        Count++;
+        Written++;
+        BytesInController += pNext->Length;
+#if PROFILING == 1
+        pNext->WrittenAt = ProfileNow();
+#endif
+        LogMessage("sent: %s", pNext->pCommand);
+
+        PROFILE_COUNT(CounterCommands, 1);
+        PROFILE_COUNT(CounterBytesSent, (long long)pNext->Length);
+        PROFILE_SAMPLE(HistogramLineBytes, (long long)pNext->Length);
+    }
+
+    return Count;
+}
+
+// Splits what has arrived into lines and acts on each complete one, keeping any partial line for later
+static void TakeReplies(void)
+{
+    int Start = 0;
+
+    pthread_mutex_lock(&IoLock);
+    for (int i = 0; i < RxEnd; i++)
+    {
+        if (RxBuffer[i] == '\n')
+        {
+            int Length = i - Start;
+            if (Length > 0 && RxBuffer[i - 1] == '\r')
+            {
+                Length--;
+            }
+            RxBuffer[Start + Length] = 0;
+            TakeLine((const char *)&RxBuffer[Start]);
+            Start = i + 1;
+        }
+    }
+    pthread_cond_broadcast(&IoChanged);
+    pthread_mutex_unlock(&IoLock);
+
+    memmove(RxBuffer, &RxBuffer[Start], (size_t)(RxEnd - Start));
+    RxEnd -= Start;
+    if (RxEnd == (int)sizeof(RxBuffer)) // A line this long is noise, throw it away
+    {
+        RxEnd = 0;
+    }
+}
+
+// Called with IoLock held
+static void TakeLine(const char *Line)
+{
+    int Status, Code = 0;
+
+    if (strcmp(Line, "ok") == 0)
+    {
+        Status = ReplyOk;
+    }
+    else if (strncmp(Line, "error:", 6) == 0)
+    {
+        Status = ReplyError;
+        Code = atoi(&Line[6]);
+    }
+    else if (strncmp(Line, "ALARM:", 6) == 0)
+    {
+        Status = ReplyAlarm;
+        Code = atoi(&Line[6]);
+    }
+    else // Banners, [MSG:...] and status reports are not replies to a command
+    {
+        if (Line[0] != 0)
+        {
+            LogMessage("received %s", Line);
+        }
+        if (strchr(Line, '$') != NULL)
+        {
+            SawDollar = 1;
+        }
+        if (strncmp(Line, "[GC:", 4) == 0)
+        {
+            FinishResync();
+        }
+        return;
+    }
+
+    if (Status != ReplyOk)
+    {
+        LogMessage("received %s", Line);
+        PROFILE_COUNT(CounterErrors, 1);
+    }
+    if (Written == 0) // An 'ok' to the wake-up newline, which also shows the robot is listening
+    {
+        SawDollar = 1;
+        return;
+    }
+
+    InFlight *pOldest = &Pipeline[(PipelineHead + Answered) % PipelineDepth]; // Replies come back in the order the commands were sent
+    pOldest->Status = Status;
+    pOldest->Code = Code;
+    Answered++;
+    Written--;
+    BytesInController -= pOldest->Length;
+    LastReplyMs = MillisecondsNow();
+    if (Status == ReplyOk)
+    {
+        TrackStream(pOldest->pCommand);
+    }
+#if PROFILING == 1
+    PROFILE_SAMPLE(HistogramReplyLatency, (ProfileNow() - pOldest->WrittenAt) / 1000);
+#endif
+}
+
+// Called with IoLock held. GRBL answers lines in the order they arrive, so when the parser state asked for by a
+// resync comes back, any line written before it that still has no reply never reached the controller. Those
+// are answered as timed out, which frees their room in the controller's buffer.
+static void FinishResync(void)
+{
+    int Before = 0;
+    while (Before < Written && !Pipeline[(PipelineHead + Answered + Before) % PipelineDepth].Resync)
+    {
+        Before++;
+    }
+    if (Before == Written) // A $G sent some other way
+    {
+        return;
+    }
+
+    for (int i = 0; i < Before; i++)
+    {
+        InFlight *pLost = &Pipeline[(PipelineHead + Answered) % PipelineDepth];
+        LogMessage("lost: %s", pLost->pCommand);
+        pLost->Status = ReplyTimeout;
+        pLost->Code = 0;
+        Answered++;
+        Written--;
+        BytesInController -= pLost->Length;
+    }
+}
+
 // Error was here - this should be 'ELSE' not 'ELSEIF'
 
 #else
@@ -122,6 +1177,22 @@ int CanRS232PortBeOpened(void)
     return (0); // Success
 }
 
+int OpenSerialDevice(const char *Device)
+{
+    (void)Device;
+    return (0);
+}
+
+int ProbeBaudRate(void)
+{
+    return (0);
+}
+
+int FindRobotPort(void)
+{
+    return (0);
+}
+
 // Function to close the COM port
 void CloseRS232Port(void)
 {
@@ -142,6 +1213,40 @@ int WaitForReply(void)
     return (0);
 }
 
+int ReadReply(int TimeoutMs, int *pCode)
+{
+    *pCode = 0;
+    return WaitForReply();
+}
+
+int SendCommand(char *buffer)
+{
+    PrintBuffer(buffer);
+    return WaitForReply();
+}
+
+static void (*ReplyCallback)(const char *Command, int Status) = NULL;
+
+void SetReplyCallback(void (*Callback)(const char *Command, int Status))
+{
+    ReplyCallback = Callback;
+}
+
+int QueueCommand(char *buffer)
+{
+    int Status = SendCommand(buffer);
+    if (ReplyCallback != NULL)
+    {
+        ReplyCallback(buffer, Status);
+    }
+    return Status;
+}
+
+int FlushCommands(void)
+{
+    return (0);
+}
+
 int WaitForDollar(void)
 {
     char c;
@@ -6,13 +6,45 @@
 #define SERIAL_H_INCLUDED
 
 
-#define cport_nr    3                  /* COM number minus 1 */
-#define bdrate      115200              /* 115200  */
+#define DefaultSerialPort 3             /* COM number minus 1 */
+#define DefaultBaudRate 115200
+#define AutoBaudRate    0               /* BaudRate that has ProbeBaudRate() find the fastest rate that works */
+#define ProbeReplyMs    2500            /* Wait for a banner at each probed rate, long enough for a board reset by DTR */
 
-int PrintBuffer (char *buffer);                 //JIB: Needed to match the function
+#define ReplyTimeoutMs  10000           /* Longest wait for a reply before a command counts as lost */
+#define MaxRetries      3               /* Resends allowed for a lost or garbled command */
+#define GrblBufferSize  127             /* Bytes the controller can hold in its receive buffer */
+#define MaxCommandLength 128
+#define PipelineDepth   64              /* Most commands that can be queued and waiting for an 'ok' at once */
+#define TxRingSize      ((PipelineDepth + 2) * MaxCommandLength) /* Text of the queued commands, with room for the wrap */
+#define IoIdleWaitMs    100             /* Longest the I/O thread sleeps before checking the port again */
+#define ReconnectTimeoutMs 120000       /* How long a lost robot is looked for before the job gives up */
+#define ReconnectPollMs 250             /* Pause between looks */
+#define ResumeLines     5               /* Most commands sent to put the robot back after a reconnect */
+#define ResyncQuery     "$G\n"          /* Sent after a timeout; everything before its [GC:...] report has been answered or is lost */
+
+/* Reply classes returned by the functions below */
+#define ReplyOk         0               /* "ok" */
+#define ReplyError      -1              /* "error:N", the controller rejected the line */
+#define ReplyAlarm      -2              /* "ALARM:N", the controller has stopped */
+#define ReplyTimeout    -3              /* Nothing came back in time */
+
+extern int SerialPort;                  /* comports[] entry in use, set before the port is opened */
+extern int BaudRate;                    /* Rates outside the usual list are set exactly where the driver allows it */
+extern int LowLatency;                  /* Ask the driver to pass on each reply at once */
+
+int PrintBuffer (char *buffer);                 // Sends text that gets no 'ok', such as the wake-up newline
 int WaitForReply (void);                        // Wit for OK function
+int ReadReply (int TimeoutMs, int *pCode);      // Waits for one ok/error/alarm line, skipping anything else
+int SendCommand (char *buffer);                 // Sends and waits, resending lost or garbled lines
+int QueueCommand (char *buffer);                // Pipelined send, only waits when PipelineDepth commands are outstanding
+int FlushCommands (void);                       // Waits for every queued command to be answered
+void SetReplyCallback (void (*Callback)(const char *Command, int Status)); // Called on the caller's thread as each queued command is answered
 int WaitForDollar (void);                       // Wait for '$' function (for startup)
 int CanRS232PortBeOpened ( void );              // Port open check
+int OpenSerialDevice (const char *Device);      // Opens a named device (e.g. an emulator's pseudo terminal) in place of SerialPort
+int FindRobotPort (void);                       // Opens the first comports[] entry that answers with a GRBL banner
 void CloseRS232Port (void);
+int ProbeBaudRate (void);                       // Reopens the open port at rising rates while the controller still answers
 
 #endif // SERIAL_H_INCLUDED
@@ -0,0 +1,263 @@
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "font.h"
+#include "transform.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TransformSimd 1 // The vector kernels are built, each behind a check of what the processor can run
+#include <immintrin.h>
+#else
+#define TransformSimd 0
+#endif
+
+// STRUCTS
+
+typedef struct // Struct to hold one way of placing strokes
+{
+    const char *Name;
+    void (*Place)(const Strokes *pStrokes, int Count, const StrokeScale *pScale, int32_t *pX, int32_t *pY);
+} Transform;
+
+// FUNCTION DECLARATIONS
+
+static void ChooseKernel(void);
+static int KernelSupported(int Kernel);
+static void PlaceScalar(const Strokes *pStrokes, int Count, const StrokeScale *pScale, int32_t *pX, int32_t *pY);
+#if TransformSimd
+static void PlaceSse2(const Strokes *pStrokes, int Count, const StrokeScale *pScale, int32_t *pX, int32_t *pY);
+static void PlaceAvx2(const Strokes *pStrokes, int Count, const StrokeScale *pScale, int32_t *pX, int32_t *pY);
+#endif
+
+// GLOBAL VARIABLES
+
+static const Transform Transforms[TransformKernelCount] = {
+    {"scalar", PlaceScalar},
+#if TransformSimd
+    {"sse2", PlaceSse2},
+    {"avx2", PlaceAvx2},
+#else
+    {"sse2", NULL},
+    {"avx2", NULL},
+#endif
+};
+
+static int CurrentKernel = ScalarTransform;
+static pthread_once_t KernelChosen = PTHREAD_ONCE_INIT;
+
+// FUNCTIONS
+
+StrokeScale MakeStrokeScale(double Scale)
+{
+    StrokeScale Result = {0, 1, MaxStrokeReach}; // Places everything at the origin
+    if (!(Scale > 0.0)) // Also catches NaN
+    {
+        return Result;
+    }
+
+    // Scale is Mantissa * 2^Exponent with Mantissa in [0.5, 1), so the multiplier gets all 32 bits. Strokes stay
+    // within MaxStrokeReach, so the product always fits 62 bits.
+    int Exponent;
+    double Mantissa = frexp(fmin(Scale, (double)MaxPlacedReach), &Exponent);
+    uint64_t Multiplier = (uint64_t)llround(ldexp(Mantissa, 32));
+    int Shift = 32 - Exponent;
+    if (Multiplier == (UINT64_C(1) << 32)) // Rounded up into the next power of two
+    {
+        Multiplier >>= 1;
+        Shift--;
+    }
+    if (Shift > 62) // Too small to move any stroke by a fixed unit
+    {
+        return Result;
+    }
+    Result.Multiplier = (uint32_t)Multiplier;
+    Result.Shift = Shift;
+
+    // Clamping the stroke rather than the product keeps every lane in 64 bits. With a shift of 32 or more, even the
+    // furthest stroke lands well inside the reach.
+    if (Shift < 32)
+    {
+        uint64_t Bound = (((uint64_t)MaxPlacedReach + 1) << Shift) - (UINT64_C(1) << (Shift - 1)) - 1;
+        uint64_t Limit = Bound / Multiplier;
+        Result.Limit = Limit < MaxStrokeReach ? (uint32_t)Limit : MaxStrokeReach;
+    }
+    return Result;
+}
+
+void PlaceStrokes(const Strokes *pStrokes, int Count, const StrokeScale *pScale, int32_t *pX, int32_t *pY)
+{
+    pthread_once(&KernelChosen, ChooseKernel);
+    Transforms[CurrentKernel].Place(pStrokes, Count, pScale, pX, pY);
+}
+
+int32_t PlaceCoordinate(int32_t Value, const StrokeScale *pScale)
+{
+    uint32_t Magnitude = Value < 0 ? 0u - (uint32_t)Value : (uint32_t)Value;
+    if (Magnitude > pScale->Limit)
+    {
+        Magnitude = pScale->Limit;
+    }
+    uint64_t Half = UINT64_C(1) << (pScale->Shift - 1);
+    int32_t Placed = (int32_t)(((uint64_t)Magnitude * pScale->Multiplier + Half) >> pScale->Shift);
+    return Value < 0 ? -Placed : Placed;
+}
+
+int SetTransformKernel(int Kernel)
+{
+    pthread_once(&KernelChosen, ChooseKernel); // So the automatic choice cannot come along later and undo this one
+    if (!KernelSupported(Kernel))
+    {
+        return -1;
+    }
+    CurrentKernel = Kernel;
+    return 0;
+}
+
+int TransformKernel(void)
+{
+    pthread_once(&KernelChosen, ChooseKernel);
+    return CurrentKernel;
+}
+
+const char *TransformName(int Kernel)
+{
+    return (Kernel >= 0 && Kernel < TransformKernelCount) ? Transforms[Kernel].Name : "unknown";
+}
+
+static void ChooseKernel(void) // The widest kernel the processor can run
+{
+    for (int Kernel = TransformKernelCount - 1; Kernel > ScalarTransform; Kernel--)
+    {
+        if (KernelSupported(Kernel))
+        {
+            CurrentKernel = Kernel;
+            return;
+        }
+    }
+}
+
+static int KernelSupported(int Kernel)
+{
+    if (Kernel < 0 || Kernel >= TransformKernelCount || Transforms[Kernel].Place == NULL)
+    {
+        return 0;
+    }
+#if TransformSimd
+    __builtin_cpu_init();
+    if (Kernel == Sse2Transform)
+    {
+        return __builtin_cpu_supports("sse2");
+    }
+    if (Kernel == Avx2Transform)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return 1;
+}
+
+static void PlaceScalar(const Strokes *pStrokes, int Count, const StrokeScale *pScale, int32_t *pX, int32_t *pY)
+{
+    for (int i = 0; i < Count; i++)
+    {
+        pX[i] = PlaceCoordinate(pStrokes[i].X, pScale);
+        pY[i] = PlaceCoordinate(pStrokes[i].Y, pScale);
+    }
+}
+
+#if TransformSimd
+
+_Static_assert(sizeof(Strokes) == 3 * sizeof(int32_t) && offsetof(Strokes, Y) == sizeof(int32_t),
+               "the vector kernels read strokes as X, Y, Pen in three 32-bit words");
+
+// Splits four strokes, X Y P X | Y P X Y | P X Y P in memory, into their four Xs and four Ys
+__attribute__((target("sse2"))) static inline void Deinterleave(const Strokes *pStrokes, __m128i *pX, __m128i *pY)
+{
+    const __m128i *pWords = (const __m128i *)pStrokes;
+    __m128 A = _mm_castsi128_ps(_mm_loadu_si128(pWords));
+    __m128 B = _mm_castsi128_ps(_mm_loadu_si128(pWords + 1));
+    __m128 C = _mm_castsi128_ps(_mm_loadu_si128(pWords + 2));
+
+    __m128 XHigh = _mm_shuffle_ps(B, C, _MM_SHUFFLE(1, 1, 2, 2));
+    *pX = _mm_castps_si128(_mm_shuffle_ps(A, XHigh, _MM_SHUFFLE(2, 0, 3, 0)));
+
+    __m128 YLow = _mm_shuffle_ps(A, B, _MM_SHUFFLE(0, 0, 1, 1));
+    __m128 YHigh = _mm_shuffle_ps(B, C, _MM_SHUFFLE(2, 2, 3, 3));
+    *pY = _mm_castps_si128(_mm_shuffle_ps(YLow, YHigh, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+// As PlaceCoordinate, four at a time: the magnitudes are clamped (compared unsigned, by flipping the top bit),
+// multiplied into 64-bit lanes, odd and even words separately, then rounded, shifted back and given their signs
+__attribute__((target("sse2"))) static inline __m128i PlaceLanesSse2(__m128i Value, __m128i Limit, __m128i Multiplier, __m128i Half, __m128i Shift)
+{
+    __m128i Sign = _mm_srai_epi32(Value, 31);
+    __m128i Magnitude = _mm_sub_epi32(_mm_xor_si128(Value, Sign), Sign);
+    __m128i TopBit = _mm_set1_epi32(INT32_MIN);
+    __m128i Over = _mm_cmpgt_epi32(_mm_xor_si128(Magnitude, TopBit), _mm_xor_si128(Limit, TopBit));
+    Magnitude = _mm_or_si128(_mm_and_si128(Over, Limit), _mm_andnot_si128(Over, Magnitude));
+
+    __m128i Even = _mm_srl_epi64(_mm_add_epi64(_mm_mul_epu32(Magnitude, Multiplier), Half), Shift);
+    __m128i Odd = _mm_srl_epi64(_mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(Magnitude, 32), Multiplier), Half), Shift);
+    __m128i Placed = _mm_or_si128(Even, _mm_slli_epi64(Odd, 32)); // Inside MaxPlacedReach, so the top words are clear
+    return _mm_sub_epi32(_mm_xor_si128(Placed, Sign), Sign);
+}
+
+__attribute__((target("sse2"))) static void PlaceSse2(const Strokes *pStrokes, int Count, const StrokeScale *pScale, int32_t *pX, int32_t *pY)
+{
+    __m128i Limit = _mm_set1_epi32((int32_t)pScale->Limit);
+    __m128i Multiplier = _mm_set1_epi32((int32_t)pScale->Multiplier);
+    __m128i Half = _mm_set1_epi64x((int64_t)(UINT64_C(1) << (pScale->Shift - 1)));
+    __m128i Shift = _mm_cvtsi32_si128(pScale->Shift);
+    int i = 0;
+
+    for (; i + 4 <= Count; i += 4)
+    {
+        __m128i X, Y;
+        Deinterleave(&pStrokes[i], &X, &Y);
+        _mm_storeu_si128((__m128i *)&pX[i], PlaceLanesSse2(X, Limit, Multiplier, Half, Shift));
+        _mm_storeu_si128((__m128i *)&pY[i], PlaceLanesSse2(Y, Limit, Multiplier, Half, Shift));
+    }
+
+    PlaceScalar(pStrokes + i, Count - i, pScale, pX + i, pY + i); // The last few
+}
+
+__attribute__((target("avx2"))) static inline __m256i PlaceLanesAvx2(__m256i Value, __m256i Limit, __m256i Multiplier, __m256i Half, __m128i Shift) // As PlaceLanesSse2, eight at a time
+{
+    __m256i Sign = _mm256_srai_epi32(Value, 31);
+    __m256i Magnitude = _mm256_sub_epi32(_mm256_xor_si256(Value, Sign), Sign);
+    __m256i TopBit = _mm256_set1_epi32(INT32_MIN);
+    __m256i Over = _mm256_cmpgt_epi32(_mm256_xor_si256(Magnitude, TopBit), _mm256_xor_si256(Limit, TopBit));
+    Magnitude = _mm256_blendv_epi8(Magnitude, Limit, Over);
+
+    __m256i Even = _mm256_srl_epi64(_mm256_add_epi64(_mm256_mul_epu32(Magnitude, Multiplier), Half), Shift);
+    __m256i Odd = _mm256_srl_epi64(_mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(Magnitude, 32), Multiplier), Half), Shift);
+    __m256i Placed = _mm256_or_si256(Even, _mm256_slli_epi64(Odd, 32));
+    return _mm256_sub_epi32(_mm256_xor_si256(Placed, Sign), Sign);
+}
+
+__attribute__((target("avx2"))) static void PlaceAvx2(const Strokes *pStrokes, int Count, const StrokeScale *pScale, int32_t *pX, int32_t *pY)
+{
+    __m256i Limit = _mm256_set1_epi32((int32_t)pScale->Limit);
+    __m256i Multiplier = _mm256_set1_epi32((int32_t)pScale->Multiplier);
+    __m256i Half = _mm256_set1_epi64x((int64_t)(UINT64_C(1) << (pScale->Shift - 1)));
+    __m128i Shift = _mm_cvtsi32_si128(pScale->Shift);
+    int i = 0;
+
+    for (; i + 8 <= Count; i += 8)
+    {
+        __m128i X0, Y0, X1, Y1;
+        Deinterleave(&pStrokes[i], &X0, &Y0);
+        Deinterleave(&pStrokes[i + 4], &X1, &Y1);
+
+        __m256i X = _mm256_inserti128_si256(_mm256_castsi128_si256(X0), X1, 1);
+        __m256i Y = _mm256_inserti128_si256(_mm256_castsi128_si256(Y0), Y1, 1);
+        _mm256_storeu_si256((__m256i *)&pX[i], PlaceLanesAvx2(X, Limit, Multiplier, Half, Shift));
+        _mm256_storeu_si256((__m256i *)&pY[i], PlaceLanesAvx2(Y, Limit, Multiplier, Half, Shift));
+    }
+
+    PlaceScalar(pStrokes + i, Count - i, pScale, pX + i, pY + i);
+}
+
+#endif // TransformSimd
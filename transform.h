@@ -0,0 +1,37 @@
+#ifndef TRANSFORM_H_INCLUDED
+#define TRANSFORM_H_INCLUDED
+
+#include <stdint.h>
+
+#include "font.h"
+
+// GLOBAL CONSTANTS
+
+#define MaxPlacedReach 1073741824 // Furthest a placed point may lie from its origin (fixed units), about 42 m
+
+#define ScalarTransform 0 // Plain C, on any machine
+#define Sse2Transform 1   // Four coordinates at a time, on every x86-64
+#define Avx2Transform 2   // Eight at a time, where the processor has AVX2
+#define TransformKernelCount 3
+
+// STRUCTS
+
+typedef struct // Struct to hold a scale as a whole multiplier and a shift, so placing a stroke is one integer multiply
+{
+    uint32_t Multiplier; // Kept in the top bit so the scale holds its full 32 bits of precision
+    int Shift;
+    uint32_t Limit; // Largest stroke coordinate, either way, that still lands inside MaxPlacedReach
+} StrokeScale;
+
+// FUNCTION DECLARATIONS
+
+StrokeScale MakeStrokeScale(double Scale); // Fixed units per stroke unit, worked out once for a run of strokes
+// Scales a run of strokes into fixed units from their origin, rounding halves away from zero, with the Xs and Ys
+// written to separate arrays. Every kernel gives exactly the same numbers.
+void PlaceStrokes(const Strokes *pStrokes, int Count, const StrokeScale *pScale, int32_t *pX, int32_t *pY);
+int32_t PlaceCoordinate(int32_t Value, const StrokeScale *pScale); // One value, as the kernels place each coordinate
+int SetTransformKernel(int Kernel); // -1 when this machine cannot run it; the fastest one is used until then
+int TransformKernel(void);
+const char *TransformName(int Kernel);
+
+#endif // TRANSFORM_H_INCLUDED